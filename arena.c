@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include "arena.h"
+
+#define INITIAL_CHUNK_SIZE 1024
+#define MAX_CHUNK_SIZE (64 * 1024)
+
+union arena_align {
+	void *ptr;
+	long long ll;
+	long double ld;
+	void (*fn)(void);
+};
+
+#define ALIGN(size) \
+	(((size) + sizeof(union arena_align) - 1) & \
+		~(sizeof(union arena_align) - 1))
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	char *pos, *end;
+};
+
+#define CHUNK_HEADER_SIZE ALIGN(sizeof(struct arena_chunk))
+
+struct mrsh_arena {
+	struct arena_chunk *chunks; // most recent first
+	size_t chunk_size; // size of the next chunk
+};
+
+static struct arena_chunk *chunk_create(size_t size) {
+	struct arena_chunk *chunk = malloc(size);
+	if (chunk == NULL) {
+		return NULL;
+	}
+	chunk->next = NULL;
+	chunk->pos = (char *)chunk + CHUNK_HEADER_SIZE;
+	chunk->end = (char *)chunk + size;
+	return chunk;
+}
+
+struct mrsh_arena *arena_create(void) {
+	// The arena lives in its first chunk, so that small programs only need a
+	// single allocation
+	struct arena_chunk *chunk = chunk_create(INITIAL_CHUNK_SIZE);
+	if (chunk == NULL) {
+		return NULL;
+	}
+	struct mrsh_arena *arena = (struct mrsh_arena *)chunk->pos;
+	chunk->pos += ALIGN(sizeof(struct mrsh_arena));
+	arena->chunks = chunk;
+	arena->chunk_size = 2 * INITIAL_CHUNK_SIZE;
+	return arena;
+}
+
+void arena_destroy(struct mrsh_arena *arena) {
+	if (arena == NULL) {
+		return;
+	}
+	struct arena_chunk *chunk = arena->chunks;
+	while (chunk != NULL) {
+		struct arena_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+}
+
+void *arena_alloc(struct mrsh_arena *arena, size_t size) {
+	if (size > SIZE_MAX - CHUNK_HEADER_SIZE - sizeof(union arena_align)) {
+		return NULL;
+	}
+	size = ALIGN(size);
+
+	struct arena_chunk *chunk = arena->chunks;
+	if ((size_t)(chunk->end - chunk->pos) < size) {
+		size_t chunk_size = arena->chunk_size;
+		if (chunk_size < CHUNK_HEADER_SIZE + size) {
+			chunk_size = CHUNK_HEADER_SIZE + size;
+		}
+		struct arena_chunk *new_chunk = chunk_create(chunk_size);
+		if (new_chunk == NULL) {
+			return NULL;
+		}
+		if (arena->chunk_size < MAX_CHUNK_SIZE) {
+			arena->chunk_size *= 2;
+		}
+
+		size_t room = chunk->end - chunk->pos;
+		size_t new_room = new_chunk->end - new_chunk->pos - size;
+		if (room > new_room) {
+			// Keep allocating from the current chunk, it has more room left
+			new_chunk->next = chunk->next;
+			chunk->next = new_chunk;
+			chunk = new_chunk;
+		} else {
+			new_chunk->next = chunk;
+			arena->chunks = new_chunk;
+			chunk = new_chunk;
+		}
+	}
+
+	void *ptr = chunk->pos;
+	chunk->pos += size;
+	return ptr;
+}
@@ -7,6 +7,83 @@
 
 #include "ast.h"
 
+void *ast_alloc(struct mrsh_arena *arena, size_t size) {
+	if (arena != NULL) {
+		return arena_alloc(arena, size);
+	}
+	return malloc(size);
+}
+
+void *ast_calloc(struct mrsh_arena *arena, size_t size) {
+	if (arena != NULL) {
+		void *ptr = arena_alloc(arena, size);
+		if (ptr != NULL) {
+			memset(ptr, 0, size);
+		}
+		return ptr;
+	}
+	return calloc(1, size);
+}
+
+char *ast_strdup(struct mrsh_arena *arena, const char *str) {
+	if (arena != NULL) {
+		size_t size = strlen(str) + 1;
+		char *dup = arena_alloc(arena, size);
+		if (dup != NULL) {
+			memcpy(dup, str, size);
+		}
+		return dup;
+	}
+	return strdup(str);
+}
+
+char *ast_buffer_steal(struct mrsh_arena *arena, struct mrsh_buffer *buf) {
+	if (arena != NULL) {
+		char *data = arena_alloc(arena, buf->len);
+		if (data != NULL) {
+			memcpy(data, buf->data, buf->len);
+		}
+		mrsh_buffer_finish(buf);
+		return data;
+	}
+	return mrsh_buffer_steal(buf);
+}
+
+ssize_t ast_array_add(struct mrsh_arena *arena, struct mrsh_array *array,
+		void *value) {
+	if (arena == NULL) {
+		return mrsh_array_add(array, value);
+	}
+
+	if (array->len == array->cap) {
+		// The previous storage is left in the arena
+		size_t new_cap = array->cap > 0 ? 2 * array->cap : 4;
+		void **new_data = arena_alloc(arena, new_cap * sizeof(void *));
+		if (new_data == NULL) {
+			return -1;
+		}
+		if (array->len > 0) {
+			memcpy(new_data, array->data, array->len * sizeof(void *));
+		}
+		array->data = new_data;
+		array->cap = new_cap;
+	}
+
+	size_t i = array->len;
+	array->data[i] = value;
+	array->len++;
+	return i;
+}
+
+void ast_array_finish(struct mrsh_arena *arena, struct mrsh_array *array) {
+	if (arena == NULL) {
+		mrsh_array_finish(array);
+	} else {
+		array->len = array->cap = 0;
+	}
+	array->data = NULL;
+}
+
 bool mrsh_position_valid(const struct mrsh_position *pos) {
 	return pos->line > 0;
 }
@@ -233,12 +310,17 @@ void mrsh_and_or_list_destroy(struct mrsh_and_or_list *and_or_list) {
 	abort();
 }
 
-struct mrsh_command_list *mrsh_command_list_create(void) {
-	struct mrsh_command_list *list = calloc(1, sizeof(struct mrsh_command_list));
+struct mrsh_command_list *ast_command_list_create(struct mrsh_arena *arena) {
+	struct mrsh_command_list *list =
+		ast_calloc(arena, sizeof(struct mrsh_command_list));
 	list->node.type = MRSH_NODE_COMMAND_LIST;
 	return list;
 }
 
+struct mrsh_command_list *mrsh_command_list_create(void) {
+	return ast_command_list_create(NULL);
+}
+
 void mrsh_command_list_destroy(struct mrsh_command_list *l) {
 	if (l == NULL) {
 		return;
@@ -248,16 +330,24 @@ void mrsh_command_list_destroy(struct mrsh_command_list *l) {
 	free(l);
 }
 
-struct mrsh_program *mrsh_program_create(void) {
-	struct mrsh_program *prog = calloc(1, sizeof(struct mrsh_program));
+struct mrsh_program *ast_program_create(struct mrsh_arena *arena) {
+	struct mrsh_program *prog = ast_calloc(arena, sizeof(struct mrsh_program));
 	prog->node.type = MRSH_NODE_PROGRAM;
 	return prog;
 }
 
+struct mrsh_program *mrsh_program_create(void) {
+	return ast_program_create(NULL);
+}
+
 void mrsh_program_destroy(struct mrsh_program *prog) {
 	if (prog == NULL) {
 		return;
 	}
+	if (prog->arena != NULL) {
+		arena_destroy(prog->arena);
+		return;
+	}
 
 	command_list_array_finish(&prog->body);
 	free(prog);
@@ -290,9 +380,10 @@ struct mrsh_program *mrsh_node_get_program(const struct mrsh_node *node) {
 	return (struct mrsh_program *)node;
 }
 
-struct mrsh_word_string *mrsh_word_string_create(char *str,
-		bool single_quoted) {
-	struct mrsh_word_string *ws = calloc(1, sizeof(struct mrsh_word_string));
+struct mrsh_word_string *ast_word_string_create(struct mrsh_arena *arena,
+		char *str, bool single_quoted) {
+	struct mrsh_word_string *ws =
+		ast_calloc(arena, sizeof(struct mrsh_word_string));
 	ws->word.node.type = MRSH_NODE_WORD;
 	ws->word.type = MRSH_WORD_STRING;
 	ws->str = str;
@@ -300,10 +391,16 @@ struct mrsh_word_string *mrsh_word_string_create(char *str,
 	return ws;
 }
 
-struct mrsh_word_parameter *mrsh_word_parameter_create(char *name,
-		enum mrsh_word_parameter_op op, bool colon, struct mrsh_word *arg) {
+struct mrsh_word_string *mrsh_word_string_create(char *str,
+		bool single_quoted) {
+	return ast_word_string_create(NULL, str, single_quoted);
+}
+
+struct mrsh_word_parameter *ast_word_parameter_create(struct mrsh_arena *arena,
+		char *name, enum mrsh_word_parameter_op op, bool colon,
+		struct mrsh_word *arg) {
 	struct mrsh_word_parameter *wp =
-		calloc(1, sizeof(struct mrsh_word_parameter));
+		ast_calloc(arena, sizeof(struct mrsh_word_parameter));
 	wp->word.node.type = MRSH_NODE_WORD;
 	wp->word.type = MRSH_WORD_PARAMETER;
 	wp->name = name;
@@ -313,10 +410,15 @@ struct mrsh_word_parameter *mrsh_word_parameter_create(char *name,
 	return wp;
 }
 
-struct mrsh_word_command *mrsh_word_command_create(struct mrsh_program *prog,
-		bool back_quoted) {
+struct mrsh_word_parameter *mrsh_word_parameter_create(char *name,
+		enum mrsh_word_parameter_op op, bool colon, struct mrsh_word *arg) {
+	return ast_word_parameter_create(NULL, name, op, colon, arg);
+}
+
+struct mrsh_word_command *ast_word_command_create(struct mrsh_arena *arena,
+		struct mrsh_program *prog, bool back_quoted) {
 	struct mrsh_word_command *wc =
-		calloc(1, sizeof(struct mrsh_word_command));
+		ast_calloc(arena, sizeof(struct mrsh_word_command));
 	wc->word.node.type = MRSH_NODE_WORD;
 	wc->word.type = MRSH_WORD_COMMAND;
 	wc->program = prog;
@@ -324,19 +426,30 @@ struct mrsh_word_command *mrsh_word_command_create(struct mrsh_program *prog,
 	return wc;
 }
 
-struct mrsh_word_arithmetic *mrsh_word_arithmetic_create(
-		struct mrsh_word *body) {
+struct mrsh_word_command *mrsh_word_command_create(struct mrsh_program *prog,
+		bool back_quoted) {
+	return ast_word_command_create(NULL, prog, back_quoted);
+}
+
+struct mrsh_word_arithmetic *ast_word_arithmetic_create(
+		struct mrsh_arena *arena, struct mrsh_word *body) {
 	struct mrsh_word_arithmetic *wa =
-		calloc(1, sizeof(struct mrsh_word_arithmetic));
+		ast_calloc(arena, sizeof(struct mrsh_word_arithmetic));
 	wa->word.node.type = MRSH_NODE_WORD;
 	wa->word.type = MRSH_WORD_ARITHMETIC;
 	wa->body = body;
 	return wa;
 }
 
-struct mrsh_word_list *mrsh_word_list_create(struct mrsh_array *children,
-		bool double_quoted) {
-	struct mrsh_word_list *wl = calloc(1, sizeof(struct mrsh_word_list));
+struct mrsh_word_arithmetic *mrsh_word_arithmetic_create(
+		struct mrsh_word *body) {
+	return ast_word_arithmetic_create(NULL, body);
+}
+
+struct mrsh_word_list *ast_word_list_create(struct mrsh_arena *arena,
+		struct mrsh_array *children, bool double_quoted) {
+	struct mrsh_word_list *wl =
+		ast_calloc(arena, sizeof(struct mrsh_word_list));
 	wl->word.node.type = MRSH_NODE_WORD;
 	wl->word.type = MRSH_WORD_LIST;
 	if (children != NULL) {
@@ -346,6 +459,11 @@ struct mrsh_word_list *mrsh_word_list_create(struct mrsh_array *children,
 	return wl;
 }
 
+struct mrsh_word_list *mrsh_word_list_create(struct mrsh_array *children,
+		bool double_quoted) {
+	return ast_word_list_create(NULL, children, double_quoted);
+}
+
 struct mrsh_word_string *mrsh_word_get_string(const struct mrsh_word *word) {
 	assert(word->type == MRSH_WORD_STRING);
 	return (struct mrsh_word_string *)word;
@@ -373,11 +491,11 @@ struct mrsh_word_list *mrsh_word_get_list(const struct mrsh_word *word) {
 	return (struct mrsh_word_list *)word;
 }
 
-struct mrsh_simple_command *mrsh_simple_command_create(struct mrsh_word *name,
-		struct mrsh_array *arguments, struct mrsh_array *io_redirects,
-		struct mrsh_array *assignments) {
+struct mrsh_simple_command *ast_simple_command_create(struct mrsh_arena *arena,
+		struct mrsh_word *name, struct mrsh_array *arguments,
+		struct mrsh_array *io_redirects, struct mrsh_array *assignments) {
 	struct mrsh_simple_command *cmd =
-		calloc(1, sizeof(struct mrsh_simple_command));
+		ast_calloc(arena, sizeof(struct mrsh_simple_command));
 	cmd->command.node.type = MRSH_NODE_COMMAND;
 	cmd->command.type = MRSH_SIMPLE_COMMAND;
 	cmd->name = name;
@@ -387,25 +505,45 @@ struct mrsh_simple_command *mrsh_simple_command_create(struct mrsh_word *name,
 	return cmd;
 }
 
-struct mrsh_brace_group *mrsh_brace_group_create(struct mrsh_array *body) {
-	struct mrsh_brace_group *bg = calloc(1, sizeof(struct mrsh_brace_group));
+struct mrsh_simple_command *mrsh_simple_command_create(struct mrsh_word *name,
+		struct mrsh_array *arguments, struct mrsh_array *io_redirects,
+		struct mrsh_array *assignments) {
+	return ast_simple_command_create(NULL, name, arguments, io_redirects,
+		assignments);
+}
+
+struct mrsh_brace_group *ast_brace_group_create(struct mrsh_arena *arena,
+		struct mrsh_array *body) {
+	struct mrsh_brace_group *bg =
+		ast_calloc(arena, sizeof(struct mrsh_brace_group));
 	bg->command.node.type = MRSH_NODE_COMMAND;
 	bg->command.type = MRSH_BRACE_GROUP;
 	bg->body = *body;
 	return bg;
 }
 
-struct mrsh_subshell *mrsh_subshell_create(struct mrsh_array *body) {
-	struct mrsh_subshell *s = calloc(1, sizeof(struct mrsh_subshell));
+struct mrsh_brace_group *mrsh_brace_group_create(struct mrsh_array *body) {
+	return ast_brace_group_create(NULL, body);
+}
+
+struct mrsh_subshell *ast_subshell_create(struct mrsh_arena *arena,
+		struct mrsh_array *body) {
+	struct mrsh_subshell *s = ast_calloc(arena, sizeof(struct mrsh_subshell));
 	s->command.node.type = MRSH_NODE_COMMAND;
 	s->command.type = MRSH_SUBSHELL;
 	s->body = *body;
 	return s;
 }
 
-struct mrsh_if_clause *mrsh_if_clause_create(struct mrsh_array *condition,
-		struct mrsh_array *body, struct mrsh_command *else_part) {
-	struct mrsh_if_clause *ic = calloc(1, sizeof(struct mrsh_if_clause));
+struct mrsh_subshell *mrsh_subshell_create(struct mrsh_array *body) {
+	return ast_subshell_create(NULL, body);
+}
+
+struct mrsh_if_clause *ast_if_clause_create(struct mrsh_arena *arena,
+		struct mrsh_array *condition, struct mrsh_array *body,
+		struct mrsh_command *else_part) {
+	struct mrsh_if_clause *ic =
+		ast_calloc(arena, sizeof(struct mrsh_if_clause));
 	ic->command.node.type = MRSH_NODE_COMMAND;
 	ic->command.type = MRSH_IF_CLAUSE;
 	ic->condition = *condition;
@@ -414,9 +552,16 @@ struct mrsh_if_clause *mrsh_if_clause_create(struct mrsh_array *condition,
 	return ic;
 }
 
-struct mrsh_for_clause *mrsh_for_clause_create(char *name, bool in,
-		struct mrsh_array *word_list, struct mrsh_array *body) {
-	struct mrsh_for_clause *fc = calloc(1, sizeof(struct mrsh_for_clause));
+struct mrsh_if_clause *mrsh_if_clause_create(struct mrsh_array *condition,
+		struct mrsh_array *body, struct mrsh_command *else_part) {
+	return ast_if_clause_create(NULL, condition, body, else_part);
+}
+
+struct mrsh_for_clause *ast_for_clause_create(struct mrsh_arena *arena,
+		char *name, bool in, struct mrsh_array *word_list,
+		struct mrsh_array *body) {
+	struct mrsh_for_clause *fc =
+		ast_calloc(arena, sizeof(struct mrsh_for_clause));
 	fc->command.node.type = MRSH_NODE_COMMAND;
 	fc->command.type = MRSH_FOR_CLAUSE;
 	fc->name = name;
@@ -426,9 +571,16 @@ struct mrsh_for_clause *mrsh_for_clause_create(char *name, bool in,
 	return fc;
 }
 
-struct mrsh_loop_clause *mrsh_loop_clause_create(enum mrsh_loop_type type,
-		struct mrsh_array *condition, struct mrsh_array *body) {
-	struct mrsh_loop_clause *lc = calloc(1, sizeof(struct mrsh_loop_clause));
+struct mrsh_for_clause *mrsh_for_clause_create(char *name, bool in,
+		struct mrsh_array *word_list, struct mrsh_array *body) {
+	return ast_for_clause_create(NULL, name, in, word_list, body);
+}
+
+struct mrsh_loop_clause *ast_loop_clause_create(struct mrsh_arena *arena,
+		enum mrsh_loop_type type, struct mrsh_array *condition,
+		struct mrsh_array *body) {
+	struct mrsh_loop_clause *lc =
+		ast_calloc(arena, sizeof(struct mrsh_loop_clause));
 	lc->command.node.type = MRSH_NODE_COMMAND;
 	lc->command.type = MRSH_LOOP_CLAUSE;
 	lc->type = type;
@@ -437,9 +589,15 @@ struct mrsh_loop_clause *mrsh_loop_clause_create(enum mrsh_loop_type type,
 	return lc;
 }
 
-struct mrsh_case_clause *mrsh_case_clause_create(struct mrsh_word *word,
-		struct mrsh_array *items) {
-	struct mrsh_case_clause *cc = calloc(1, sizeof(struct mrsh_case_clause));
+struct mrsh_loop_clause *mrsh_loop_clause_create(enum mrsh_loop_type type,
+		struct mrsh_array *condition, struct mrsh_array *body) {
+	return ast_loop_clause_create(NULL, type, condition, body);
+}
+
+struct mrsh_case_clause *ast_case_clause_create(struct mrsh_arena *arena,
+		struct mrsh_word *word, struct mrsh_array *items) {
+	struct mrsh_case_clause *cc =
+		ast_calloc(arena, sizeof(struct mrsh_case_clause));
 	cc->command.node.type = MRSH_NODE_COMMAND;
 	cc->command.type = MRSH_CASE_CLAUSE;
 	cc->word = word;
@@ -447,10 +605,16 @@ struct mrsh_case_clause *mrsh_case_clause_create(struct mrsh_word *word,
 	return cc;
 }
 
-struct mrsh_function_definition *mrsh_function_definition_create(char *name,
-		struct mrsh_command *body, struct mrsh_array *io_redirects) {
+struct mrsh_case_clause *mrsh_case_clause_create(struct mrsh_word *word,
+		struct mrsh_array *items) {
+	return ast_case_clause_create(NULL, word, items);
+}
+
+struct mrsh_function_definition *ast_function_definition_create(
+		struct mrsh_arena *arena, char *name, struct mrsh_command *body,
+		struct mrsh_array *io_redirects) {
 	struct mrsh_function_definition *fd =
-		calloc(1, sizeof(struct mrsh_function_definition));
+		ast_calloc(arena, sizeof(struct mrsh_function_definition));
 	fd->command.node.type = MRSH_NODE_COMMAND;
 	fd->command.type = MRSH_FUNCTION_DEFINITION;
 	fd->name = name;
@@ -459,6 +623,11 @@ struct mrsh_function_definition *mrsh_function_definition_create(char *name,
 	return fd;
 }
 
+struct mrsh_function_definition *mrsh_function_definition_create(char *name,
+		struct mrsh_command *body, struct mrsh_array *io_redirects) {
+	return ast_function_definition_create(NULL, name, body, io_redirects);
+}
+
 struct mrsh_simple_command *mrsh_command_get_simple_command(
 		const struct mrsh_command *cmd) {
 	assert(cmd->type == MRSH_SIMPLE_COMMAND);
@@ -507,9 +676,9 @@ struct mrsh_function_definition *mrsh_command_get_function_definition(
 	return (struct mrsh_function_definition *)cmd;
 }
 
-struct mrsh_pipeline *mrsh_pipeline_create(struct mrsh_array *commands,
-		bool bang) {
-	struct mrsh_pipeline *pl = calloc(1, sizeof(struct mrsh_pipeline));
+struct mrsh_pipeline *ast_pipeline_create(struct mrsh_arena *arena,
+		struct mrsh_array *commands, bool bang) {
+	struct mrsh_pipeline *pl = ast_calloc(arena, sizeof(struct mrsh_pipeline));
 	pl->and_or_list.node.type = MRSH_NODE_AND_OR_LIST;
 	pl->and_or_list.type = MRSH_AND_OR_LIST_PIPELINE;
 	pl->commands = *commands;
@@ -517,9 +686,15 @@ struct mrsh_pipeline *mrsh_pipeline_create(struct mrsh_array *commands,
 	return pl;
 }
 
-struct mrsh_binop *mrsh_binop_create(enum mrsh_binop_type type,
-		struct mrsh_and_or_list *left, struct mrsh_and_or_list *right) {
-	struct mrsh_binop *binop = calloc(1, sizeof(struct mrsh_binop));
+struct mrsh_pipeline *mrsh_pipeline_create(struct mrsh_array *commands,
+		bool bang) {
+	return ast_pipeline_create(NULL, commands, bang);
+}
+
+struct mrsh_binop *ast_binop_create(struct mrsh_arena *arena,
+		enum mrsh_binop_type type, struct mrsh_and_or_list *left,
+		struct mrsh_and_or_list *right) {
+	struct mrsh_binop *binop = ast_calloc(arena, sizeof(struct mrsh_binop));
 	binop->and_or_list.node.type = MRSH_NODE_AND_OR_LIST;
 	binop->and_or_list.type = MRSH_AND_OR_LIST_BINOP;
 	binop->type = type;
@@ -528,6 +703,11 @@ struct mrsh_binop *mrsh_binop_create(enum mrsh_binop_type type,
 	return binop;
 }
 
+struct mrsh_binop *mrsh_binop_create(enum mrsh_binop_type type,
+		struct mrsh_and_or_list *left, struct mrsh_and_or_list *right) {
+	return ast_binop_create(NULL, type, left, right);
+}
+
 struct mrsh_pipeline *mrsh_and_or_list_get_pipeline(
 		const struct mrsh_and_or_list *and_or_list) {
 	assert(and_or_list->type == MRSH_AND_OR_LIST_PIPELINE);
@@ -664,8 +844,8 @@ static void position_next(struct mrsh_position *dst,
 	++dst->column;
 }
 
-void mrsh_word_range(struct mrsh_word *word, struct mrsh_position *begin,
-		struct mrsh_position *end) {
+void mrsh_word_range(const struct mrsh_word *word,
+		struct mrsh_position *begin, struct mrsh_position *end) {
 	if (begin == NULL && end == NULL) {
 		return;
 	}
@@ -680,12 +860,12 @@ void mrsh_word_range(struct mrsh_word *word, struct mrsh_position *begin,
 
 	switch (word->type) {
 	case MRSH_WORD_STRING:;
-		struct mrsh_word_string *ws = mrsh_word_get_string(word);
+		const struct mrsh_word_string *ws = mrsh_word_get_string(word);
 		*begin = ws->range.begin;
 		*end = ws->range.end;
 		return;
 	case MRSH_WORD_PARAMETER:;
-		struct mrsh_word_parameter *wp = mrsh_word_get_parameter(word);
+		const struct mrsh_word_parameter *wp = mrsh_word_get_parameter(word);
 		*begin = wp->dollar_pos;
 		if (mrsh_position_valid(&wp->rbrace_pos)) {
 			position_next(end, &wp->rbrace_pos);
@@ -694,19 +874,20 @@ void mrsh_word_range(struct mrsh_word *word, struct mrsh_position *begin,
 		}
 		return;
 	case MRSH_WORD_COMMAND:;
-		struct mrsh_word_command *wc = mrsh_word_get_command(word);
+		const struct mrsh_word_command *wc = mrsh_word_get_command(word);
 		*begin = wc->range.begin;
 		*end = wc->range.end;
 		return;
 	case MRSH_WORD_ARITHMETIC:
 		abort(); // TODO
 	case MRSH_WORD_LIST:;
-		struct mrsh_word_list *wl = mrsh_word_get_list(word);
+		const struct mrsh_word_list *wl = mrsh_word_get_list(word);
 		if (wl->children.len == 0) {
 			*begin = *end = (struct mrsh_position){0};
 		} else {
-			struct mrsh_word *first = wl->children.data[0];
-			struct mrsh_word *last = wl->children.data[wl->children.len - 1];
+			const struct mrsh_word *first = wl->children.data[0];
+			const struct mrsh_word *last =
+				wl->children.data[wl->children.len - 1];
 			mrsh_word_range(first, begin, NULL);
 			mrsh_word_range(last, NULL, end);
 		}
@@ -1039,12 +1220,13 @@ struct mrsh_node *mrsh_node_copy(const struct mrsh_node *node) {
 	abort();
 }
 
-struct mrsh_word *mrsh_word_copy(const struct mrsh_word *word) {
+static struct mrsh_word *word_copy(const struct mrsh_word *word) {
 	switch (word->type) {
 	case MRSH_WORD_STRING:;
 		struct mrsh_word_string *ws = mrsh_word_get_string(word);
 		struct mrsh_word_string *ws_copy =
 			mrsh_word_string_create(strdup(ws->str), ws->single_quoted);
+		ws_copy->range = ws->range;
 		return &ws_copy->word;
 	case MRSH_WORD_PARAMETER:;
 		struct mrsh_word_parameter *wp = mrsh_word_get_parameter(word);
@@ -1056,11 +1238,17 @@ struct mrsh_word *mrsh_word_copy(const struct mrsh_word *word) {
 
 		struct mrsh_word_parameter *wp_copy = mrsh_word_parameter_create(
 			strdup(wp->name), wp->op, wp->colon, arg);
+		wp_copy->dollar_pos = wp->dollar_pos;
+		wp_copy->name_range = wp->name_range;
+		wp_copy->op_range = wp->op_range;
+		wp_copy->lbrace_pos = wp->lbrace_pos;
+		wp_copy->rbrace_pos = wp->rbrace_pos;
 		return &wp_copy->word;
 	case MRSH_WORD_COMMAND:;
 		struct mrsh_word_command *wc = mrsh_word_get_command(word);
 		struct mrsh_word_command *wc_copy = mrsh_word_command_create(
 			mrsh_program_copy(wc->program), wc->back_quoted);
+		wc_copy->range = wc->range;
 		return &wc_copy->word;
 	case MRSH_WORD_ARITHMETIC:;
 		struct mrsh_word_arithmetic *wa = mrsh_word_get_arithmetic(word);
@@ -1082,6 +1270,12 @@ struct mrsh_word *mrsh_word_copy(const struct mrsh_word *word) {
 	abort();
 }
 
+struct mrsh_word *mrsh_word_copy(const struct mrsh_word *word) {
+	struct mrsh_word *copy = word_copy(word);
+	copy->literal = word->literal;
+	return copy;
+}
+
 struct mrsh_io_redirect *mrsh_io_redirect_copy(
 		const struct mrsh_io_redirect *redir) {
 	struct mrsh_io_redirect *redir_copy =
@@ -1105,6 +1299,8 @@ struct mrsh_assignment *mrsh_assignment_copy(
 		calloc(1, sizeof(struct mrsh_assignment));
 	assign_copy->name = strdup(assign->name);
 	assign_copy->value = mrsh_word_copy(assign->value);
+	assign_copy->name_range = assign->name_range;
+	assign_copy->equal_pos = assign->equal_pos;
 	return assign_copy;
 }
 
@@ -0,0 +1,640 @@
+#define _POSIX_C_SOURCE 200809L
+#include <limits.h>
+#include <mrsh/ast.h>
+#include <mrsh/buffer.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ast.h"
+
+/*
+ * Programs are encoded in prefix order. Integers, enums and sizes are unsigned
+ * LEB128 varints, strings are a length followed by the bytes, arrays are a
+ * length followed by the elements and optional children are preceded by a
+ * presence byte.
+ */
+
+static void write_uint(struct mrsh_buffer *buf, uint64_t value) {
+	char bytes[10];
+	size_t n = 0;
+	do {
+		bytes[n] = value & 0x7F;
+		value >>= 7;
+		if (value != 0) {
+			bytes[n] |= 0x80;
+		}
+		++n;
+	} while (value != 0);
+	mrsh_buffer_append(buf, bytes, n);
+}
+
+static void write_bool(struct mrsh_buffer *buf, bool value) {
+	mrsh_buffer_append_char(buf, value);
+}
+
+static void write_str(struct mrsh_buffer *buf, const char *str) {
+	size_t len = strlen(str);
+	write_uint(buf, len);
+	mrsh_buffer_append(buf, str, len);
+}
+
+static void write_position(struct mrsh_buffer *buf,
+		const struct mrsh_position *pos) {
+	write_uint(buf, pos->offset);
+	write_uint(buf, (unsigned int)pos->line);
+	write_uint(buf, (unsigned int)pos->column);
+}
+
+static void write_range(struct mrsh_buffer *buf,
+		const struct mrsh_range *range) {
+	write_position(buf, &range->begin);
+	write_position(buf, &range->end);
+}
+
+static void write_program(struct mrsh_buffer *buf,
+	const struct mrsh_program *prog);
+static void write_command(struct mrsh_buffer *buf,
+	const struct mrsh_command *cmd);
+static void write_command_list_array(struct mrsh_buffer *buf,
+	const struct mrsh_array *array);
+
+static void write_word(struct mrsh_buffer *buf, const struct mrsh_word *word) {
+	write_uint(buf, word->type);
+	write_bool(buf, word->literal);
+	switch (word->type) {
+	case MRSH_WORD_STRING:;
+		const struct mrsh_word_string *ws = mrsh_word_get_string(word);
+		write_str(buf, ws->str);
+		write_bool(buf, ws->single_quoted);
+		write_bool(buf, ws->split_fields);
+		write_range(buf, &ws->range);
+		return;
+	case MRSH_WORD_PARAMETER:;
+		const struct mrsh_word_parameter *wp = mrsh_word_get_parameter(word);
+		write_str(buf, wp->name);
+		write_uint(buf, wp->op);
+		write_bool(buf, wp->colon);
+		write_bool(buf, wp->arg != NULL);
+		if (wp->arg != NULL) {
+			write_word(buf, wp->arg);
+		}
+		write_position(buf, &wp->dollar_pos);
+		write_range(buf, &wp->name_range);
+		write_range(buf, &wp->op_range);
+		write_position(buf, &wp->lbrace_pos);
+		write_position(buf, &wp->rbrace_pos);
+		return;
+	case MRSH_WORD_COMMAND:;
+		const struct mrsh_word_command *wc = mrsh_word_get_command(word);
+		write_bool(buf, wc->program != NULL);
+		if (wc->program != NULL) {
+			write_program(buf, wc->program);
+		}
+		write_bool(buf, wc->back_quoted);
+		write_range(buf, &wc->range);
+		return;
+	case MRSH_WORD_ARITHMETIC:;
+		const struct mrsh_word_arithmetic *wa =
+			mrsh_word_get_arithmetic(word);
+		write_word(buf, wa->body);
+		return;
+	case MRSH_WORD_LIST:;
+		const struct mrsh_word_list *wl = mrsh_word_get_list(word);
+		write_uint(buf, wl->children.len);
+		for (size_t i = 0; i < wl->children.len; ++i) {
+			write_word(buf, wl->children.data[i]);
+		}
+		write_bool(buf, wl->double_quoted);
+		write_position(buf, &wl->lquote_pos);
+		write_position(buf, &wl->rquote_pos);
+		return;
+	}
+	abort();
+}
+
+static void write_word_array(struct mrsh_buffer *buf,
+		const struct mrsh_array *array) {
+	write_uint(buf, array->len);
+	for (size_t i = 0; i < array->len; ++i) {
+		write_word(buf, array->data[i]);
+	}
+}
+
+static void write_io_redirect_array(struct mrsh_buffer *buf,
+		const struct mrsh_array *array) {
+	write_uint(buf, array->len);
+	for (size_t i = 0; i < array->len; ++i) {
+		const struct mrsh_io_redirect *redir = array->data[i];
+		// io_number is -1 if unspecified
+		write_uint(buf, (unsigned int)(redir->io_number + 1));
+		write_uint(buf, redir->op);
+		write_word(buf, redir->name);
+		write_word_array(buf, &redir->here_document);
+		write_position(buf, &redir->io_number_pos);
+		write_range(buf, &redir->op_range);
+	}
+}
+
+static void write_command(struct mrsh_buffer *buf,
+		const struct mrsh_command *cmd) {
+	write_uint(buf, cmd->type);
+	switch (cmd->type) {
+	case MRSH_SIMPLE_COMMAND:;
+		const struct mrsh_simple_command *sc =
+			mrsh_command_get_simple_command(cmd);
+		write_bool(buf, sc->name != NULL);
+		if (sc->name != NULL) {
+			write_word(buf, sc->name);
+		}
+		write_word_array(buf, &sc->arguments);
+		write_io_redirect_array(buf, &sc->io_redirects);
+		write_uint(buf, sc->assignments.len);
+		for (size_t i = 0; i < sc->assignments.len; ++i) {
+			const struct mrsh_assignment *assign = sc->assignments.data[i];
+			write_str(buf, assign->name);
+			write_word(buf, assign->value);
+			write_range(buf, &assign->name_range);
+			write_position(buf, &assign->equal_pos);
+		}
+		return;
+	case MRSH_BRACE_GROUP:;
+		const struct mrsh_brace_group *bg = mrsh_command_get_brace_group(cmd);
+		write_command_list_array(buf, &bg->body);
+		write_position(buf, &bg->lbrace_pos);
+		write_position(buf, &bg->rbrace_pos);
+		return;
+	case MRSH_SUBSHELL:;
+		const struct mrsh_subshell *s = mrsh_command_get_subshell(cmd);
+		write_command_list_array(buf, &s->body);
+		write_position(buf, &s->lparen_pos);
+		write_position(buf, &s->rparen_pos);
+		return;
+	case MRSH_IF_CLAUSE:;
+		const struct mrsh_if_clause *ic = mrsh_command_get_if_clause(cmd);
+		write_command_list_array(buf, &ic->condition);
+		write_command_list_array(buf, &ic->body);
+		write_bool(buf, ic->else_part != NULL);
+		if (ic->else_part != NULL) {
+			write_command(buf, ic->else_part);
+		}
+		write_range(buf, &ic->if_range);
+		write_range(buf, &ic->then_range);
+		write_range(buf, &ic->fi_range);
+		write_range(buf, &ic->else_range);
+		return;
+	case MRSH_FOR_CLAUSE:;
+		const struct mrsh_for_clause *fc = mrsh_command_get_for_clause(cmd);
+		write_str(buf, fc->name);
+		write_bool(buf, fc->in);
+		write_word_array(buf, &fc->word_list);
+		write_command_list_array(buf, &fc->body);
+		write_range(buf, &fc->for_range);
+		write_range(buf, &fc->name_range);
+		write_range(buf, &fc->do_range);
+		write_range(buf, &fc->done_range);
+		write_range(buf, &fc->in_range);
+		return;
+	case MRSH_LOOP_CLAUSE:;
+		const struct mrsh_loop_clause *lc = mrsh_command_get_loop_clause(cmd);
+		write_uint(buf, lc->type);
+		write_command_list_array(buf, &lc->condition);
+		write_command_list_array(buf, &lc->body);
+		write_range(buf, &lc->while_until_range);
+		write_range(buf, &lc->do_range);
+		write_range(buf, &lc->done_range);
+		return;
+	case MRSH_CASE_CLAUSE:;
+		const struct mrsh_case_clause *cc = mrsh_command_get_case_clause(cmd);
+		write_word(buf, cc->word);
+		write_uint(buf, cc->items.len);
+		for (size_t i = 0; i < cc->items.len; ++i) {
+			const struct mrsh_case_item *item = cc->items.data[i];
+			write_word_array(buf, &item->patterns);
+			write_command_list_array(buf, &item->body);
+			write_position(buf, &item->lparen_pos);
+			write_position(buf, &item->rparen_pos);
+			write_range(buf, &item->dsemi_range);
+		}
+		write_range(buf, &cc->case_range);
+		write_range(buf, &cc->in_range);
+		write_range(buf, &cc->esac_range);
+		return;
+	case MRSH_FUNCTION_DEFINITION:;
+		const struct mrsh_function_definition *fd =
+			mrsh_command_get_function_definition(cmd);
+		write_str(buf, fd->name);
+		write_command(buf, fd->body);
+		write_io_redirect_array(buf, &fd->io_redirects);
+		write_range(buf, &fd->name_range);
+		write_position(buf, &fd->lparen_pos);
+		write_position(buf, &fd->rparen_pos);
+		return;
+	}
+	abort();
+}
+
+static void write_and_or_list(struct mrsh_buffer *buf,
+		const struct mrsh_and_or_list *and_or_list) {
+	write_uint(buf, and_or_list->type);
+	switch (and_or_list->type) {
+	case MRSH_AND_OR_LIST_PIPELINE:;
+		const struct mrsh_pipeline *pl =
+			mrsh_and_or_list_get_pipeline(and_or_list);
+		write_uint(buf, pl->commands.len);
+		for (size_t i = 0; i < pl->commands.len; ++i) {
+			write_command(buf, pl->commands.data[i]);
+		}
+		write_bool(buf, pl->bang);
+		write_position(buf, &pl->bang_pos);
+		return;
+	case MRSH_AND_OR_LIST_BINOP:;
+		const struct mrsh_binop *binop =
+			mrsh_and_or_list_get_binop(and_or_list);
+		write_uint(buf, binop->type);
+		write_and_or_list(buf, binop->left);
+		write_and_or_list(buf, binop->right);
+		write_range(buf, &binop->op_range);
+		return;
+	}
+	abort();
+}
+
+static void write_command_list_array(struct mrsh_buffer *buf,
+		const struct mrsh_array *array) {
+	write_uint(buf, array->len);
+	for (size_t i = 0; i < array->len; ++i) {
+		const struct mrsh_command_list *l = array->data[i];
+		write_and_or_list(buf, l->and_or_list);
+		write_bool(buf, l->ampersand);
+		write_position(buf, &l->separator_pos);
+	}
+}
+
+static void write_program(struct mrsh_buffer *buf,
+		const struct mrsh_program *prog) {
+	write_command_list_array(buf, &prog->body);
+}
+
+void mrsh_program_serialize(struct mrsh_buffer *buf,
+		const struct mrsh_program *prog) {
+	write_program(buf, prog);
+}
+
+/**
+ * Errors are sticky: once the input is found to be invalid, readers return
+ * placeholder values so that a well-formed tree is still built. The caller
+ * destroys it afterwards.
+ */
+struct reader {
+	const char *data, *end;
+	struct mrsh_arena *arena; // where the nodes are allocated
+	bool error;
+};
+
+static uint64_t read_uint(struct reader *r) {
+	uint64_t value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (r->error || r->data == r->end) {
+			r->error = true;
+			return 0;
+		}
+		unsigned char byte = *r->data++;
+		value |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return value;
+		}
+	}
+	r->error = true;
+	return 0;
+}
+
+static unsigned int read_enum(struct reader *r, unsigned int max) {
+	uint64_t value = read_uint(r);
+	if (value > max) {
+		r->error = true;
+		return 0;
+	}
+	return value;
+}
+
+static int read_int(struct reader *r) {
+	return read_enum(r, INT_MAX);
+}
+
+static bool read_bool(struct reader *r) {
+	return read_enum(r, 1);
+}
+
+/**
+ * Reads the length of an array. Each element takes at least one byte, which
+ * bounds allocations on invalid input.
+ */
+static size_t read_len(struct reader *r) {
+	uint64_t len = read_uint(r);
+	if (len > (uint64_t)(r->end - r->data)) {
+		r->error = true;
+		return 0;
+	}
+	return len;
+}
+
+static char *read_str(struct reader *r) {
+	size_t len = read_len(r);
+	char *str = ast_alloc(r->arena, len + 1);
+	if (str == NULL) {
+		r->error = true;
+		return ast_strdup(r->arena, "");
+	}
+	memcpy(str, r->data, len);
+	str[len] = '\0';
+	r->data += len;
+	return str;
+}
+
+static void read_position(struct reader *r, struct mrsh_position *pos) {
+	pos->offset = read_uint(r);
+	pos->line = read_int(r);
+	pos->column = read_int(r);
+}
+
+static void read_range(struct reader *r, struct mrsh_range *range) {
+	read_position(r, &range->begin);
+	read_position(r, &range->end);
+}
+
+static void array_add(struct reader *r, struct mrsh_array *array, void *value) {
+	if (ast_array_add(r->arena, array, value) < 0) {
+		r->error = true;
+	}
+}
+
+static struct mrsh_program *read_program(struct reader *r);
+static struct mrsh_word *read_word(struct reader *r);
+static struct mrsh_command *read_command(struct reader *r);
+static void read_command_list_array(struct reader *r,
+	struct mrsh_array *array);
+
+static struct mrsh_word *read_word_of_type(struct reader *r,
+		enum mrsh_word_type type) {
+	switch (type) {
+	case MRSH_WORD_STRING:;
+		char *str = read_str(r);
+		bool single_quoted = read_bool(r);
+		struct mrsh_word_string *ws =
+			ast_word_string_create(r->arena, str, single_quoted);
+		ws->split_fields = read_bool(r);
+		read_range(r, &ws->range);
+		return &ws->word;
+	case MRSH_WORD_PARAMETER:;
+		char *name = read_str(r);
+		enum mrsh_word_parameter_op op = read_enum(r, MRSH_PARAM_DHASH);
+		bool colon = read_bool(r);
+		struct mrsh_word *arg = NULL;
+		if (read_bool(r)) {
+			arg = read_word(r);
+		}
+		struct mrsh_word_parameter *wp =
+			ast_word_parameter_create(r->arena, name, op, colon, arg);
+		read_position(r, &wp->dollar_pos);
+		read_range(r, &wp->name_range);
+		read_range(r, &wp->op_range);
+		read_position(r, &wp->lbrace_pos);
+		read_position(r, &wp->rbrace_pos);
+		return &wp->word;
+	case MRSH_WORD_COMMAND:;
+		struct mrsh_program *prog = NULL;
+		if (read_bool(r)) {
+			prog = read_program(r);
+		}
+		bool back_quoted = read_bool(r);
+		struct mrsh_word_command *wc =
+			ast_word_command_create(r->arena, prog, back_quoted);
+		read_range(r, &wc->range);
+		return &wc->word;
+	case MRSH_WORD_ARITHMETIC:;
+		struct mrsh_word *body = read_word(r);
+		struct mrsh_word_arithmetic *wa =
+			ast_word_arithmetic_create(r->arena, body);
+		return &wa->word;
+	case MRSH_WORD_LIST:;
+		struct mrsh_array children = {0};
+		size_t len = read_len(r);
+		for (size_t i = 0; i < len; ++i) {
+			array_add(r, &children, read_word(r));
+		}
+		bool double_quoted = read_bool(r);
+		struct mrsh_word_list *wl =
+			ast_word_list_create(r->arena, &children, double_quoted);
+		read_position(r, &wl->lquote_pos);
+		read_position(r, &wl->rquote_pos);
+		return &wl->word;
+	}
+	abort();
+}
+
+static struct mrsh_word *read_word(struct reader *r) {
+	enum mrsh_word_type type = read_enum(r, MRSH_WORD_LIST);
+	bool literal = read_bool(r);
+	struct mrsh_word *word = read_word_of_type(r, type);
+	word->literal = literal;
+	return word;
+}
+
+static void read_word_array(struct reader *r, struct mrsh_array *array) {
+	size_t len = read_len(r);
+	for (size_t i = 0; i < len; ++i) {
+		array_add(r, array, read_word(r));
+	}
+}
+
+static void read_io_redirect_array(struct reader *r,
+		struct mrsh_array *array) {
+	size_t len = read_len(r);
+	for (size_t i = 0; i < len; ++i) {
+		struct mrsh_io_redirect *redir =
+			ast_calloc(r->arena, sizeof(struct mrsh_io_redirect));
+		redir->io_number = read_int(r) - 1;
+		redir->op = read_enum(r, MRSH_IO_DLESSDASH);
+		redir->name = read_word(r);
+		read_word_array(r, &redir->here_document);
+		read_position(r, &redir->io_number_pos);
+		read_range(r, &redir->op_range);
+		array_add(r, array, redir);
+	}
+}
+
+static struct mrsh_command *read_command(struct reader *r) {
+	switch (read_enum(r, MRSH_FUNCTION_DEFINITION)) {
+	case MRSH_SIMPLE_COMMAND:;
+		struct mrsh_word *name = NULL;
+		if (read_bool(r)) {
+			name = read_word(r);
+		}
+		struct mrsh_array arguments = {0};
+		read_word_array(r, &arguments);
+		struct mrsh_array io_redirects = {0};
+		read_io_redirect_array(r, &io_redirects);
+		struct mrsh_array assignments = {0};
+		size_t assignments_len = read_len(r);
+		for (size_t i = 0; i < assignments_len; ++i) {
+			struct mrsh_assignment *assign =
+				ast_calloc(r->arena, sizeof(struct mrsh_assignment));
+			assign->name = read_str(r);
+			assign->value = read_word(r);
+			read_range(r, &assign->name_range);
+			read_position(r, &assign->equal_pos);
+			array_add(r, &assignments, assign);
+		}
+		struct mrsh_simple_command *sc = ast_simple_command_create(r->arena,
+			name, &arguments, &io_redirects, &assignments);
+		return &sc->command;
+	case MRSH_BRACE_GROUP:;
+		struct mrsh_array bg_body = {0};
+		read_command_list_array(r, &bg_body);
+		struct mrsh_brace_group *bg =
+			ast_brace_group_create(r->arena, &bg_body);
+		read_position(r, &bg->lbrace_pos);
+		read_position(r, &bg->rbrace_pos);
+		return &bg->command;
+	case MRSH_SUBSHELL:;
+		struct mrsh_array s_body = {0};
+		read_command_list_array(r, &s_body);
+		struct mrsh_subshell *s = ast_subshell_create(r->arena, &s_body);
+		read_position(r, &s->lparen_pos);
+		read_position(r, &s->rparen_pos);
+		return &s->command;
+	case MRSH_IF_CLAUSE:;
+		struct mrsh_array ic_condition = {0}, ic_body = {0};
+		read_command_list_array(r, &ic_condition);
+		read_command_list_array(r, &ic_body);
+		struct mrsh_command *else_part = NULL;
+		if (read_bool(r)) {
+			else_part = read_command(r);
+		}
+		struct mrsh_if_clause *ic =
+			ast_if_clause_create(r->arena, &ic_condition, &ic_body, else_part);
+		read_range(r, &ic->if_range);
+		read_range(r, &ic->then_range);
+		read_range(r, &ic->fi_range);
+		read_range(r, &ic->else_range);
+		return &ic->command;
+	case MRSH_FOR_CLAUSE:;
+		char *fc_name = read_str(r);
+		bool in = read_bool(r);
+		struct mrsh_array word_list = {0}, fc_body = {0};
+		read_word_array(r, &word_list);
+		read_command_list_array(r, &fc_body);
+		struct mrsh_for_clause *fc =
+			ast_for_clause_create(r->arena, fc_name, in, &word_list, &fc_body);
+		read_range(r, &fc->for_range);
+		read_range(r, &fc->name_range);
+		read_range(r, &fc->do_range);
+		read_range(r, &fc->done_range);
+		read_range(r, &fc->in_range);
+		return &fc->command;
+	case MRSH_LOOP_CLAUSE:;
+		enum mrsh_loop_type type = read_enum(r, MRSH_LOOP_UNTIL);
+		struct mrsh_array lc_condition = {0}, lc_body = {0};
+		read_command_list_array(r, &lc_condition);
+		read_command_list_array(r, &lc_body);
+		struct mrsh_loop_clause *lc =
+			ast_loop_clause_create(r->arena, type, &lc_condition, &lc_body);
+		read_range(r, &lc->while_until_range);
+		read_range(r, &lc->do_range);
+		read_range(r, &lc->done_range);
+		return &lc->command;
+	case MRSH_CASE_CLAUSE:;
+		struct mrsh_word *word = read_word(r);
+		struct mrsh_array items = {0};
+		size_t items_len = read_len(r);
+		for (size_t i = 0; i < items_len; ++i) {
+			struct mrsh_case_item *item =
+				ast_calloc(r->arena, sizeof(struct mrsh_case_item));
+			read_word_array(r, &item->patterns);
+			read_command_list_array(r, &item->body);
+			read_position(r, &item->lparen_pos);
+			read_position(r, &item->rparen_pos);
+			read_range(r, &item->dsemi_range);
+			array_add(r, &items, item);
+		}
+		struct mrsh_case_clause *cc =
+			ast_case_clause_create(r->arena, word, &items);
+		read_range(r, &cc->case_range);
+		read_range(r, &cc->in_range);
+		read_range(r, &cc->esac_range);
+		return &cc->command;
+	case MRSH_FUNCTION_DEFINITION:;
+		char *fd_name = read_str(r);
+		struct mrsh_command *fd_body = read_command(r);
+		struct mrsh_array fd_io_redirects = {0};
+		read_io_redirect_array(r, &fd_io_redirects);
+		struct mrsh_function_definition *fd =
+			ast_function_definition_create(r->arena, fd_name, fd_body,
+				&fd_io_redirects);
+		read_range(r, &fd->name_range);
+		read_position(r, &fd->lparen_pos);
+		read_position(r, &fd->rparen_pos);
+		return &fd->command;
+	}
+	abort();
+}
+
+static struct mrsh_and_or_list *read_and_or_list(struct reader *r) {
+	switch (read_enum(r, MRSH_AND_OR_LIST_BINOP)) {
+	case MRSH_AND_OR_LIST_PIPELINE:;
+		struct mrsh_array commands = {0};
+		size_t len = read_len(r);
+		for (size_t i = 0; i < len; ++i) {
+			array_add(r, &commands, read_command(r));
+		}
+		bool bang = read_bool(r);
+		struct mrsh_pipeline *pl =
+			ast_pipeline_create(r->arena, &commands, bang);
+		read_position(r, &pl->bang_pos);
+		return &pl->and_or_list;
+	case MRSH_AND_OR_LIST_BINOP:;
+		enum mrsh_binop_type type = read_enum(r, MRSH_BINOP_OR);
+		struct mrsh_and_or_list *left = read_and_or_list(r);
+		struct mrsh_and_or_list *right = read_and_or_list(r);
+		struct mrsh_binop *binop =
+			ast_binop_create(r->arena, type, left, right);
+		read_range(r, &binop->op_range);
+		return &binop->and_or_list;
+	}
+	abort();
+}
+
+static void read_command_list_array(struct reader *r,
+		struct mrsh_array *array) {
+	size_t len = read_len(r);
+	for (size_t i = 0; i < len; ++i) {
+		struct mrsh_command_list *l = ast_command_list_create(r->arena);
+		l->and_or_list = read_and_or_list(r);
+		l->ampersand = read_bool(r);
+		read_position(r, &l->separator_pos);
+		array_add(r, array, l);
+	}
+}
+
+static struct mrsh_program *read_program(struct reader *r) {
+	struct mrsh_program *prog = ast_program_create(r->arena);
+	read_command_list_array(r, &prog->body);
+	return prog;
+}
+
+struct mrsh_program *mrsh_program_deserialize(const char **data_ptr,
+		const char *end) {
+	struct mrsh_arena *arena = arena_create();
+	if (arena == NULL) {
+		return NULL;
+	}
+	struct reader r = { .data = *data_ptr, .end = end, .arena = arena };
+	struct mrsh_program *prog = read_program(&r);
+	prog->arena = arena;
+	if (r.error) {
+		mrsh_program_destroy(prog);
+		return NULL;
+	}
+	*data_ptr = r.data;
+	return prog;
+}
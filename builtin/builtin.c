@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <mrsh/buffer.h>
 #include <mrsh/builtin.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,12 +18,14 @@ static const struct builtin builtins[] = {
 	// Keep alpha sorted
 	{ ".", builtin_dot, true },
 	{ ":", builtin_colon, true },
+	{ "[", builtin_test, false },
 	{ "alias", builtin_alias, false },
 	{ "bg", builtin_bg, false },
 	{ "break", builtin_break, true },
 	{ "cd", builtin_cd, false },
 	{ "command", builtin_command, false },
 	{ "continue", builtin_break, true },
+	{ "echo", builtin_echo, false },
 	{ "eval", builtin_eval, true },
 	{ "exec", builtin_exec, true },
 	{ "exit", builtin_exit, true },
@@ -35,12 +38,14 @@ static const struct builtin builtins[] = {
 	{ "jobs", builtin_jobs, false },
 //	{ "kill", builtin_kill, false },
 //	{ "newgrp", builtin_newgrp, false },
+	{ "printf", builtin_printf, false },
 	{ "pwd", builtin_pwd, false },
 	{ "read", builtin_read, false },
 	{ "readonly", builtin_export, true },
 	{ "return", builtin_return, true },
 	{ "set", builtin_set, true },
 	{ "shift", builtin_shift, true },
+	{ "test", builtin_test, false },
 	{ "times", builtin_times, true },
 	{ "trap", builtin_trap, true },
 	{ "true", builtin_true, false },
@@ -135,6 +140,44 @@ void print_escaped(const char *value) {
 	}
 }
 
+int escape_char(char c) {
+	static const char escapes[] = "a\ab\bf\fn\nr\rt\tv\v\\\\";
+	for (size_t i = 0; escapes[i] != '\0'; i += 2) {
+		if (escapes[i] == c) {
+			return escapes[i + 1];
+		}
+	}
+	return -1;
+}
+
+bool expand_escapes(struct mrsh_buffer *buf, const char *str) {
+	for (size_t i = 0; str[i] != '\0'; ++i) {
+		if (str[i] != '\\' || str[i + 1] == '\0') {
+			mrsh_buffer_append_char(buf, str[i]);
+			continue;
+		}
+
+		++i;
+		if (str[i] == 'c') {
+			return false;
+		} else if (str[i] == '0') {
+			// \0num, with up to 3 octal digits
+			int value = 0;
+			for (int j = 0; j < 3 && str[i + 1] >= '0' && str[i + 1] <= '7';
+					++j) {
+				++i;
+				value = 8 * value + (str[i] - '0');
+			}
+			mrsh_buffer_append_char(buf, (char)value);
+		} else if (escape_char(str[i]) >= 0) {
+			mrsh_buffer_append_char(buf, (char)escape_char(str[i]));
+		} else {
+			mrsh_buffer_append(buf, &str[i - 1], 2);
+		}
+	}
+	return true;
+}
+
 struct collect_iter {
 	size_t cap, len;
 	uint32_t attribs;
@@ -142,7 +185,7 @@ struct collect_iter {
 };
 
 static void collect_vars_iterator(const char *key, void *_var, void *data) {
-	const struct mrsh_variable *var = _var;
+	struct mrsh_variable *var = _var;
 	struct collect_iter *iter = data;
 	if (iter->attribs != MRSH_VAR_ATTRIB_NONE
 			&& !(var->attribs & iter->attribs)) {
@@ -154,7 +197,7 @@ static void collect_vars_iterator(const char *key, void *_var, void *data) {
 				iter->cap * sizeof(struct mrsh_collect_var));
 	}
 	iter->values[iter->len].key = key;
-	iter->values[iter->len++].value = var->value;
+	iter->values[iter->len++].value = variable_get_value(var);
 }
 
 static int varcmp(const void *p1, const void *p2) {
@@ -47,7 +47,12 @@ static int verify_command(struct mrsh_state *state, const char *command_name,
 		}
 	}
 
-	char *expanded = expand_path(state, command_name, true, default_path);
+	char *expanded;
+	if (default_path) {
+		expanded = expand_path(state, command_name, true, true);
+	} else {
+		expanded = find_utility(state, command_name, false);
+	}
 	if (expanded != NULL) {
 		printf("%s\n", expanded);
 		free(expanded);
@@ -63,7 +68,12 @@ static int run_command(struct mrsh_state *state, int argc, char *argv[],
 		return mrsh_run_builtin(state, argc - _mrsh_optind, &argv[_mrsh_optind]);
 	}
 
-	char *path = expand_path(state, argv[0], true, default_path);
+	char *path;
+	if (default_path) {
+		path = expand_path(state, argv[0], true, true);
+	} else {
+		path = find_utility(state, argv[0], true);
+	}
 	if (path == NULL) {
 		fprintf(stderr, "%s: not found\n", argv[0]);
 		return 127;
@@ -75,7 +85,8 @@ static int run_command(struct mrsh_state *state, int argc, char *argv[],
 		perror("fork");
 		return 126;
 	} else if (pid == 0) {
-		execv(path, argv);
+		struct mrsh_state_priv *priv = state_get_priv(state);
+		execve(path, argv, (char **)priv->envp.data);
 
 		// Something went wrong
 		perror(argv[0]);
@@ -85,7 +96,9 @@ static int run_command(struct mrsh_state *state, int argc, char *argv[],
 	free(path);
 
 	struct mrsh_process *proc = process_create(state, pid);
-	return job_wait_process(proc);
+	int ret = job_wait_process(proc);
+	process_release(proc);
+	return ret;
 }
 
 int builtin_command(struct mrsh_state *state, int argc, char *argv[]) {
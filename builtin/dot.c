@@ -9,7 +9,9 @@
 #include <string.h>
 #include <unistd.h>
 #include "builtin.h"
+#include "shell/cache.h"
 #include "shell/path.h"
+#include "shell/shell.h"
 
 static const char source_usage[] = "usage: . <path>\n";
 
@@ -32,12 +34,13 @@ int builtin_dot(struct mrsh_state *state, int argc, char *argv[]) {
 	if (fd < 0) {
 		fprintf(stderr, "unable to open %s for reading: %s\n",
 			argv[1], strerror(errno));
+		free(path);
 		goto error;
 	}
-	free(path);
 
-	struct mrsh_parser *parser = mrsh_parser_with_fd(fd);
-	struct mrsh_program *program = mrsh_parse_program(parser);
+	struct mrsh_parser *parser = mrsh_parser_with_file(fd);
+	struct mrsh_program *program =
+		cache_parse_program(state, path, fd, parser);
 
 	int ret;
 	struct mrsh_position err_pos;
@@ -47,11 +50,16 @@ int builtin_dot(struct mrsh_state *state, int argc, char *argv[]) {
 			argv[1], err_pos.line, err_pos.column, err_msg);
 		ret = 1;
 	} else if (program != NULL) {
+		struct mrsh_state_priv *priv = state_get_priv(state);
+		const char *prev_source = priv->source;
+		priv->source = path;
 		ret = mrsh_run_program(state, program);
+		priv->source = prev_source;
 	} else {
 		ret = 0;
 	}
 
+	free(path);
 	mrsh_program_destroy(program);
 	mrsh_parser_destroy(parser);
 	close(fd);
@@ -0,0 +1,40 @@
+#define _POSIX_C_SOURCE 200809L
+#include <mrsh/buffer.h>
+#include <mrsh/shell.h>
+#include <stdio.h>
+#include <string.h>
+#include "builtin.h"
+
+int builtin_echo(struct mrsh_state *state, int argc, char *argv[]) {
+	// echo doesn't accept options, except the XSI-unspecified -n which is
+	// widely relied upon
+	bool newline = true;
+	int i = 1;
+	if (i < argc && strcmp(argv[i], "-n") == 0) {
+		newline = false;
+		++i;
+	}
+
+	struct mrsh_buffer buf = {0};
+	for (; i < argc; ++i) {
+		if (!expand_escapes(&buf, argv[i])) {
+			newline = false;
+			break;
+		}
+		if (i < argc - 1) {
+			mrsh_buffer_append_char(&buf, ' ');
+		}
+	}
+	if (newline) {
+		mrsh_buffer_append_char(&buf, '\n');
+	}
+
+	// Output is flushed by the caller once the builtin returns
+	int ret = 0;
+	if (buf.len > 0 && fwrite(buf.data, 1, buf.len, stdout) != buf.len) {
+		perror("echo: write");
+		ret = 1;
+	}
+	mrsh_buffer_finish(&buf);
+	return ret;
+}
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "builtin.h"
+#include "shell/shell.h"
 
 static const char eval_usage[] = "usage: eval [cmds...]\n";
 
@@ -39,7 +40,11 @@ int builtin_eval(struct mrsh_state *state, int argc, char *argv[]) {
 			argv[1], err_pos.line, err_pos.column, err_msg);
 		ret = 1;
 	} else if (program != NULL) {
+		struct mrsh_state_priv *priv = state_get_priv(state);
+		const char *prev_source = priv->source;
+		priv->source = "eval";
 		ret = mrsh_run_program(state, program);
+		priv->source = prev_source;
 	} else {
 		ret = 0;
 	}
@@ -3,6 +3,7 @@
 #include "builtin.h"
 #include "mrsh_getopt.h"
 #include "shell/path.h"
+#include "shell/shell.h"
 
 static const char exec_usage[] = "usage: exec [command [argument...]]\n";
 
@@ -27,7 +28,8 @@ int builtin_exec(struct mrsh_state *state, int argc, char *argv[]) {
 		return 126;
 	}
 
-	execv(path, &argv[_mrsh_optind]);
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	execve(path, &argv[_mrsh_optind], (char **)priv->envp.data);
 	perror("exec");
 	return 1;
 }
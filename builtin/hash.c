@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <mrsh/builtin.h>
 #include <shell/path.h>
 #include <stdio.h>
@@ -5,18 +6,66 @@
 #include <string.h>
 #include "builtin.h"
 #include "mrsh_getopt.h"
+#include "shell/shell.h"
 
 static const char hash_usage[] = "usage: hash -r|utility...\n";
 
+struct utility_entry {
+	const char *name;
+	const struct mrsh_utility *utility;
+};
+
+struct collect_utilities_iter {
+	size_t cap, len;
+	struct utility_entry *entries;
+};
+
+static void collect_utilities_iterator(const char *key, void *value,
+		void *data) {
+	struct collect_utilities_iter *iter = data;
+	if (iter->len == iter->cap) {
+		iter->cap = iter->cap == 0 ? 16 : 2 * iter->cap;
+		iter->entries = realloc(iter->entries,
+			iter->cap * sizeof(struct utility_entry));
+	}
+	iter->entries[iter->len].name = key;
+	iter->entries[iter->len].utility = value;
+	++iter->len;
+}
+
+static int utility_entry_cmp(const void *p1, const void *p2) {
+	const struct utility_entry *e1 = p1;
+	const struct utility_entry *e2 = p2;
+	return strcmp(e1->name, e2->name);
+}
+
+static void print_utilities(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	struct collect_utilities_iter iter = {0};
+	mrsh_hashtable_for_each(&priv->utilities, collect_utilities_iterator,
+		&iter);
+	if (iter.len == 0) {
+		return;
+	}
+	qsort(iter.entries, iter.len, sizeof(struct utility_entry),
+		utility_entry_cmp);
+
+	printf("hits\tcommand\n");
+	for (size_t i = 0; i < iter.len; ++i) {
+		const struct mrsh_utility *utility = iter.entries[i].utility;
+		printf("%4d\t%s\n", utility->hits, utility->path);
+	}
+	free(iter.entries);
+}
+
 int builtin_hash(struct mrsh_state *state, int argc, char *argv[]) {
-	/* Hashing and remembering executable location isn't implemented. Thus most
-	 * of this builtin just does nothing. */
 	_mrsh_optind = 0;
 	int opt;
 	while ((opt = _mrsh_getopt(argc, argv, ":r")) != -1) {
 		switch (opt) {
 		case 'r':
-			/* no-op: reset list of cached utilities */
+			forget_utilities(state);
 			return 0;
 		default:
 			fprintf(stderr, "hash: unknown option -- %c\n", _mrsh_optopt);
@@ -26,7 +75,7 @@ int builtin_hash(struct mrsh_state *state, int argc, char *argv[]) {
 	}
 
 	if (argc == 1) {
-		/* no-op: print list of cached utilities */
+		print_utilities(state);
 		return 0;
 	}
 
@@ -42,7 +91,7 @@ int builtin_hash(struct mrsh_state *state, int argc, char *argv[]) {
 			continue;
 		}
 
-		char *path = expand_path(state, utility, true, false);
+		char *path = find_utility(state, utility, false);
 		if (path == NULL) {
 			fprintf(stderr, "hash: command not found: %s\n", utility);
 			return 1;
@@ -0,0 +1,303 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <mrsh/buffer.h>
+#include <mrsh/shell.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "builtin.h"
+
+static const char printf_usage[] = "usage: printf format [argument...]\n";
+
+struct printf_state {
+	char **args;
+	int len, pos;
+	int ret;
+	bool stop; // set when \c is encountered in a %b argument
+};
+
+static const char *next_arg(struct printf_state *p) {
+	if (p->pos >= p->len) {
+		return NULL;
+	}
+	return p->args[p->pos++];
+}
+
+static void check_number(struct printf_state *p, const char *arg,
+		const char *end) {
+	if (end == arg) {
+		fprintf(stderr, "printf: %s: expected numeric value\n", arg);
+		p->ret = 1;
+	} else if (end[0] != '\0') {
+		fprintf(stderr, "printf: %s: not completely converted\n", arg);
+		p->ret = 1;
+	} else if (errno != 0) {
+		fprintf(stderr, "printf: %s: %s\n", arg, strerror(errno));
+		p->ret = 1;
+	}
+}
+
+/**
+ * Numeric arguments may be a leading quote followed by a character, in which
+ * case the value is the character's code.
+ */
+static bool is_char_constant(const char *arg) {
+	return arg[0] == '\'' || arg[0] == '"';
+}
+
+static intmax_t next_intmax(struct printf_state *p) {
+	const char *arg = next_arg(p);
+	if (arg == NULL || arg[0] == '\0') {
+		return 0;
+	} else if (is_char_constant(arg)) {
+		return (unsigned char)arg[1];
+	}
+	char *end;
+	errno = 0;
+	intmax_t value = strtoimax(arg, &end, 0);
+	check_number(p, arg, end);
+	return value;
+}
+
+static uintmax_t next_uintmax(struct printf_state *p) {
+	const char *arg = next_arg(p);
+	if (arg == NULL || arg[0] == '\0') {
+		return 0;
+	} else if (is_char_constant(arg)) {
+		return (unsigned char)arg[1];
+	}
+	char *end;
+	errno = 0;
+	uintmax_t value = strtoumax(arg, &end, 0);
+	check_number(p, arg, end);
+	return value;
+}
+
+static double next_double(struct printf_state *p) {
+	const char *arg = next_arg(p);
+	if (arg == NULL || arg[0] == '\0') {
+		return 0;
+	} else if (is_char_constant(arg)) {
+		return (unsigned char)arg[1];
+	}
+	char *end;
+	errno = 0;
+	double value = strtod(arg, &end);
+	check_number(p, arg, end);
+	return value;
+}
+
+static int next_int(struct printf_state *p) {
+	intmax_t value = next_intmax(p);
+	if (value > INT_MAX) {
+		return INT_MAX;
+	} else if (value < -INT_MAX) {
+		return -INT_MAX;
+	}
+	return (int)value;
+}
+
+/**
+ * Prints a single conversion. `spec` has been validated by print_format.
+ */
+static void print_conversion(const char *spec, ...) {
+	va_list args;
+	va_start(args, spec);
+	vprintf(spec, args);
+	va_end(args);
+}
+
+/**
+ * Parses a decimal field width or precision from the format string.
+ */
+static int parse_decimal(const char **fmt_ptr) {
+	const char *fmt = *fmt_ptr;
+	int value = 0;
+	while (fmt[0] >= '0' && fmt[0] <= '9') {
+		if (value <= (INT_MAX - 9) / 10) {
+			value = 10 * value + (fmt[0] - '0');
+		}
+		++fmt;
+	}
+	*fmt_ptr = fmt;
+	return value;
+}
+
+/**
+ * Prints the format string once, consuming arguments as needed. Returns false
+ * on error.
+ */
+static bool print_format(struct printf_state *p, const char *fmt) {
+	while (fmt[0] != '\0' && !p->stop) {
+		if (fmt[0] == '\\') {
+			++fmt;
+			if (fmt[0] >= '0' && fmt[0] <= '7') {
+				// \ddd, with up to 3 octal digits
+				int value = 0;
+				for (int i = 0; i < 3 && fmt[0] >= '0' && fmt[0] <= '7'; ++i) {
+					value = 8 * value + (fmt[0] - '0');
+					++fmt;
+				}
+				putchar(value);
+			} else if (escape_char(fmt[0]) >= 0) {
+				putchar(escape_char(fmt[0]));
+				++fmt;
+			} else {
+				putchar('\\');
+			}
+			continue;
+		} else if (fmt[0] != '%') {
+			putchar(fmt[0]);
+			++fmt;
+			continue;
+		}
+
+		const char *directive = fmt;
+		++fmt;
+		if (fmt[0] == '%') {
+			putchar('%');
+			++fmt;
+			continue;
+		}
+
+		char spec[64] = "%";
+		size_t spec_len = 1;
+		while (fmt[0] != '\0' && strchr("-+ #0", fmt[0]) != NULL) {
+			if (strchr(spec, fmt[0]) == NULL) {
+				spec[spec_len++] = fmt[0];
+			}
+			++fmt;
+		}
+
+		if (fmt[0] == '*') {
+			++fmt;
+			spec_len += sprintf(&spec[spec_len], "%d", next_int(p));
+		} else if (fmt[0] >= '0' && fmt[0] <= '9') {
+			spec_len += sprintf(&spec[spec_len], "%d", parse_decimal(&fmt));
+		}
+
+		if (fmt[0] == '.') {
+			++fmt;
+			int precision;
+			if (fmt[0] == '*') {
+				++fmt;
+				precision = next_int(p);
+			} else {
+				precision = parse_decimal(&fmt);
+			}
+			// A negative precision is taken as if it were omitted
+			if (precision >= 0) {
+				spec_len += sprintf(&spec[spec_len], ".%d", precision);
+			}
+		}
+
+		char conv = fmt[0];
+		if (conv == '\0') {
+			fprintf(stderr, "printf: %s: missing format character\n",
+				directive);
+			return false;
+		}
+		++fmt;
+
+		if (strchr("diouxX", conv) != NULL) {
+			spec[spec_len++] = 'j';
+		}
+		spec[spec_len++] = strchr("cb", conv) != NULL ? 's' : conv;
+		spec[spec_len] = '\0';
+
+		switch (conv) {
+		case 'd':
+		case 'i':
+			print_conversion(spec, next_intmax(p));
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			print_conversion(spec, next_uintmax(p));
+			break;
+		case 'a':
+		case 'A':
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+			print_conversion(spec, next_double(p));
+			break;
+		case 'c':;
+			const char *c_arg = next_arg(p);
+			char c_str[2] = { c_arg != NULL ? c_arg[0] : '\0', '\0' };
+			print_conversion(spec, c_str);
+			break;
+		case 's':;
+			const char *s_arg = next_arg(p);
+			print_conversion(spec, s_arg != NULL ? s_arg : "");
+			break;
+		case 'b':;
+			const char *b_arg = next_arg(p);
+			struct mrsh_buffer buf = {0};
+			if (b_arg != NULL && !expand_escapes(&buf, b_arg)) {
+				p->stop = true;
+			}
+			if (spec_len == 2) {
+				// Without field width nor precision, NUL bytes can be written
+				if (buf.len > 0) {
+					fwrite(buf.data, 1, buf.len, stdout);
+				}
+			} else {
+				mrsh_buffer_append_char(&buf, '\0');
+				print_conversion(spec, buf.data);
+			}
+			mrsh_buffer_finish(&buf);
+			break;
+		default:
+			fprintf(stderr, "printf: %%%c: invalid directive\n", conv);
+			return false;
+		}
+	}
+	return true;
+}
+
+int builtin_printf(struct mrsh_state *state, int argc, char *argv[]) {
+	int first = 1;
+	if (first < argc && strcmp(argv[first], "--") == 0) {
+		++first;
+	}
+	if (first >= argc) {
+		fprintf(stderr, printf_usage);
+		return 1;
+	}
+
+	struct printf_state p = {
+		.args = &argv[first + 1],
+		.len = argc - first - 1,
+	};
+	const char *fmt = argv[first];
+
+	// The format is reused as many times as needed to consume all arguments.
+	// Formats which don't consume any argument are printed only once.
+	while (true) {
+		int pos = p.pos;
+		if (!print_format(&p, fmt)) {
+			p.ret = 1;
+			break;
+		}
+		if (p.stop || p.pos == pos || p.pos >= p.len) {
+			break;
+		}
+	}
+
+	// Output is flushed by the caller once the builtin returns
+	if (ferror(stdout)) {
+		fprintf(stderr, "printf: write error\n");
+		clearerr(stdout);
+		return 1;
+	}
+	return p.ret;
+}
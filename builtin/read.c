@@ -57,7 +57,7 @@ int builtin_read(struct mrsh_state *state, int argc, char *argv[]) {
 	struct mrsh_array fields = {0};
 
 	struct mrsh_word_string *ws = mrsh_word_string_create(mrsh_buffer_steal(&buf), false);
-	split_fields(&fields, &ws->word, mrsh_env_get(state, "IFS", NULL));
+	split_fields(&fields, &ws->word, get_ifs_table(state));
 	mrsh_word_destroy(&ws->word);
 
 	struct mrsh_array strs = {0};
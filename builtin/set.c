@@ -38,6 +38,8 @@ static const struct option_map options[] = {
 	{ "nounset", 'u', MRSH_OPT_NOUNSET },
 	{ "verbose", 'v', MRSH_OPT_VERBOSE },
 	{ "xtrace", 'x', MRSH_OPT_XTRACE },
+	{ "profile", 0, MRSH_OPT_PROFILE },
+	{ "bytecode", 0, MRSH_OPT_BYTECODE },
 };
 
 const char *state_get_options(struct mrsh_state *state) {
@@ -0,0 +1,373 @@
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <mrsh/shell.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "builtin.h"
+
+// Exit statuses: 0 if the expression is true, 1 if it is false, and >1 if an
+// error occured
+#define TEST_TRUE 0
+#define TEST_FALSE 1
+#define TEST_ERROR 2
+
+struct test_parser {
+	const char *name; // "test" or "["
+	char **args;
+	int len, pos;
+};
+
+static bool is_unary_primary(const char *op) {
+	if (op[0] != '-' || op[1] == '\0' || op[2] != '\0') {
+		return false;
+	}
+	return strchr("bcdefghLnprSstuwxz", op[1]) != NULL;
+}
+
+static bool is_binary_primary(const char *op) {
+	static const char *binary_primaries[] = {
+		"=", "!=", "<", ">", "-eq", "-ne", "-gt", "-ge", "-lt", "-le",
+		"-nt", "-ot", "-ef",
+	};
+	for (size_t i = 0;
+			i < sizeof(binary_primaries) / sizeof(binary_primaries[0]); ++i) {
+		if (strcmp(op, binary_primaries[i]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static int test_bool(bool b) {
+	return b ? TEST_TRUE : TEST_FALSE;
+}
+
+static int test_negate(int ret) {
+	if (ret == TEST_ERROR) {
+		return ret;
+	}
+	return test_bool(ret != TEST_TRUE);
+}
+
+static int test_file_access(const char *path, int mode) {
+	return test_bool(faccessat(AT_FDCWD, path, mode, AT_EACCESS) == 0);
+}
+
+static int test_unary(struct test_parser *p, const char *op, const char *arg) {
+	if (op[1] == 'n') {
+		return test_bool(arg[0] != '\0');
+	} else if (op[1] == 'z') {
+		return test_bool(arg[0] == '\0');
+	} else if (op[1] == 't') {
+		char *end;
+		errno = 0;
+		long fd = strtol(arg, &end, 10);
+		if (end == arg || end[0] != '\0' || errno != 0) {
+			fprintf(stderr, "%s: %s: invalid file descriptor\n", p->name, arg);
+			return TEST_ERROR;
+		}
+		return test_bool(fd >= 0 && fd <= INT_MAX && isatty(fd));
+	}
+
+	switch (op[1]) {
+	case 'r':
+		return test_file_access(arg, R_OK);
+	case 'w':
+		return test_file_access(arg, W_OK);
+	case 'x':
+		return test_file_access(arg, X_OK);
+	}
+
+	struct stat st;
+	if (op[1] == 'h' || op[1] == 'L') {
+		if (lstat(arg, &st) != 0) {
+			return TEST_FALSE;
+		}
+		return test_bool(S_ISLNK(st.st_mode));
+	}
+	if (stat(arg, &st) != 0) {
+		return TEST_FALSE;
+	}
+	switch (op[1]) {
+	case 'b':
+		return test_bool(S_ISBLK(st.st_mode));
+	case 'c':
+		return test_bool(S_ISCHR(st.st_mode));
+	case 'd':
+		return test_bool(S_ISDIR(st.st_mode));
+	case 'e':
+		return TEST_TRUE;
+	case 'f':
+		return test_bool(S_ISREG(st.st_mode));
+	case 'g':
+		return test_bool(st.st_mode & S_ISGID);
+	case 'p':
+		return test_bool(S_ISFIFO(st.st_mode));
+	case 'S':
+		return test_bool(S_ISSOCK(st.st_mode));
+	case 's':
+		return test_bool(st.st_size > 0);
+	case 'u':
+		return test_bool(st.st_mode & S_ISUID);
+	}
+	abort(); // unreachable
+}
+
+static bool parse_integer(struct test_parser *p, const char *str, long *out) {
+	char *end;
+	errno = 0;
+	*out = strtol(str, &end, 10);
+	while (isspace((unsigned char)end[0])) {
+		++end;
+	}
+	if (end == str || end[0] != '\0' || errno != 0) {
+		fprintf(stderr, "%s: %s: integer expression expected\n", p->name, str);
+		return false;
+	}
+	return true;
+}
+
+static bool timespec_newer(const struct timespec *a, const struct timespec *b) {
+	if (a->tv_sec != b->tv_sec) {
+		return a->tv_sec > b->tv_sec;
+	}
+	return a->tv_nsec > b->tv_nsec;
+}
+
+static int test_files(const char *op, const char *a, const char *b) {
+	struct stat st_a, st_b;
+	bool has_a = stat(a, &st_a) == 0;
+	bool has_b = stat(b, &st_b) == 0;
+
+	if (strcmp(op, "-ef") == 0) {
+		return test_bool(has_a && has_b && st_a.st_dev == st_b.st_dev &&
+			st_a.st_ino == st_b.st_ino);
+	}
+
+	if (strcmp(op, "-ot") == 0) {
+		const char *tmp = a;
+		a = b;
+		b = tmp;
+		bool has_tmp = has_a;
+		has_a = has_b;
+		has_b = has_tmp;
+		struct stat st_tmp = st_a;
+		st_a = st_b;
+		st_b = st_tmp;
+	}
+	// A file is newer than a nonexistent one
+	if (!has_a) {
+		return TEST_FALSE;
+	} else if (!has_b) {
+		return TEST_TRUE;
+	}
+	return test_bool(timespec_newer(&st_a.st_mtim, &st_b.st_mtim));
+}
+
+static int test_binary(struct test_parser *p, const char *a, const char *op,
+		const char *b) {
+	if (strcmp(op, "=") == 0) {
+		return test_bool(strcmp(a, b) == 0);
+	} else if (strcmp(op, "!=") == 0) {
+		return test_bool(strcmp(a, b) != 0);
+	} else if (strcmp(op, "<") == 0) {
+		return test_bool(strcoll(a, b) < 0);
+	} else if (strcmp(op, ">") == 0) {
+		return test_bool(strcoll(a, b) > 0);
+	} else if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 ||
+			strcmp(op, "-ef") == 0) {
+		return test_files(op, a, b);
+	}
+
+	long n, m;
+	if (!parse_integer(p, a, &n) || !parse_integer(p, b, &m)) {
+		return TEST_ERROR;
+	}
+	if (strcmp(op, "-eq") == 0) {
+		return test_bool(n == m);
+	} else if (strcmp(op, "-ne") == 0) {
+		return test_bool(n != m);
+	} else if (strcmp(op, "-gt") == 0) {
+		return test_bool(n > m);
+	} else if (strcmp(op, "-ge") == 0) {
+		return test_bool(n >= m);
+	} else if (strcmp(op, "-lt") == 0) {
+		return test_bool(n < m);
+	} else if (strcmp(op, "-le") == 0) {
+		return test_bool(n <= m);
+	}
+	abort(); // unreachable
+}
+
+/**
+ * Expressions with more than 4 arguments, or which don't fit the POSIX
+ * algorithm, are parsed with the XSI grammar. Operators by decreasing
+ * precedence: `( )`, `!`, `-a`, `-o`.
+ */
+static int parse_or(struct test_parser *p);
+
+static const char *parser_peek(struct test_parser *p, int offset) {
+	if (p->pos + offset >= p->len) {
+		return NULL;
+	}
+	return p->args[p->pos + offset];
+}
+
+static int parse_primary(struct test_parser *p) {
+	const char *arg = parser_peek(p, 0);
+	if (arg == NULL) {
+		fprintf(stderr, "%s: argument expected\n", p->name);
+		return TEST_ERROR;
+	}
+
+	const char *next = parser_peek(p, 1);
+	if (next != NULL && parser_peek(p, 2) != NULL &&
+			is_binary_primary(next)) {
+		p->pos += 3;
+		return test_binary(p, arg, next, p->args[p->pos - 1]);
+	}
+
+	if (strcmp(arg, "(") == 0) {
+		++p->pos;
+		int ret = parse_or(p);
+		const char *rparen = parser_peek(p, 0);
+		if (rparen == NULL || strcmp(rparen, ")") != 0) {
+			fprintf(stderr, "%s: missing )\n", p->name);
+			return TEST_ERROR;
+		}
+		++p->pos;
+		return ret;
+	}
+
+	if (next != NULL && is_unary_primary(arg)) {
+		p->pos += 2;
+		return test_unary(p, arg, next);
+	}
+
+	++p->pos;
+	return test_bool(arg[0] != '\0');
+}
+
+static int parse_not(struct test_parser *p) {
+	const char *arg = parser_peek(p, 0);
+	if (arg != NULL && strcmp(arg, "!") == 0) {
+		++p->pos;
+		return test_negate(parse_not(p));
+	}
+	return parse_primary(p);
+}
+
+static int parse_and(struct test_parser *p) {
+	int ret = parse_not(p);
+	while (ret != TEST_ERROR) {
+		const char *arg = parser_peek(p, 0);
+		if (arg == NULL || strcmp(arg, "-a") != 0) {
+			break;
+		}
+		++p->pos;
+		int rhs = parse_not(p);
+		if (rhs == TEST_ERROR) {
+			return rhs;
+		}
+		ret = test_bool(ret == TEST_TRUE && rhs == TEST_TRUE);
+	}
+	return ret;
+}
+
+static int parse_or(struct test_parser *p) {
+	int ret = parse_and(p);
+	while (ret != TEST_ERROR) {
+		const char *arg = parser_peek(p, 0);
+		if (arg == NULL || strcmp(arg, "-o") != 0) {
+			break;
+		}
+		++p->pos;
+		int rhs = parse_and(p);
+		if (rhs == TEST_ERROR) {
+			return rhs;
+		}
+		ret = test_bool(ret == TEST_TRUE || rhs == TEST_TRUE);
+	}
+	return ret;
+}
+
+static int parse_expr(struct test_parser *p, int begin) {
+	struct test_parser sub = *p;
+	sub.pos = begin;
+	int ret = parse_or(&sub);
+	if (ret != TEST_ERROR && sub.pos != sub.len) {
+		fprintf(stderr, "%s: %s: unexpected operator\n", p->name,
+			sub.args[sub.pos]);
+		return TEST_ERROR;
+	}
+	return ret;
+}
+
+/**
+ * Evaluates the arguments starting at `begin`, following the algorithm
+ * specified by POSIX depending on the number of arguments.
+ */
+static int test_args(struct test_parser *p, int begin) {
+	char **args = &p->args[begin];
+	switch (p->len - begin) {
+	case 0:
+		return TEST_FALSE;
+	case 1:
+		return test_bool(args[0][0] != '\0');
+	case 2:
+		if (strcmp(args[0], "!") == 0) {
+			return test_negate(test_args(p, begin + 1));
+		} else if (is_unary_primary(args[0])) {
+			return test_unary(p, args[0], args[1]);
+		}
+		break;
+	case 3:
+		if (is_binary_primary(args[1])) {
+			return test_binary(p, args[0], args[1], args[2]);
+		} else if (strcmp(args[1], "-a") == 0) {
+			return test_bool(args[0][0] != '\0' && args[2][0] != '\0');
+		} else if (strcmp(args[1], "-o") == 0) {
+			return test_bool(args[0][0] != '\0' || args[2][0] != '\0');
+		} else if (strcmp(args[0], "!") == 0) {
+			return test_negate(test_args(p, begin + 1));
+		} else if (strcmp(args[0], "(") == 0 && strcmp(args[2], ")") == 0) {
+			return test_bool(args[1][0] != '\0');
+		}
+		break;
+	case 4:
+		if (strcmp(args[0], "!") == 0) {
+			return test_negate(test_args(p, begin + 1));
+		} else if (strcmp(args[0], "(") == 0 && strcmp(args[3], ")") == 0) {
+			struct test_parser sub = *p;
+			sub.len = begin + 3;
+			return test_args(&sub, begin + 1);
+		}
+		break;
+	}
+	return parse_expr(p, begin);
+}
+
+int builtin_test(struct mrsh_state *state, int argc, char *argv[]) {
+	struct test_parser p = {
+		.name = argv[0],
+		.args = argv,
+		.len = argc,
+	};
+
+	if (strcmp(argv[0], "[") == 0) {
+		if (strcmp(argv[argc - 1], "]") != 0) {
+			fprintf(stderr, "[: missing ]\n");
+			return TEST_ERROR;
+		}
+		--p.len;
+	}
+
+	return test_args(&p, 1);
+}
@@ -42,7 +42,7 @@ int builtin_type(struct mrsh_state *state, int argc, char *argv[]) {
 			continue;
 		}
 
-		char *path = expand_path(state, name, true, false);
+		char *path = find_utility(state, name, false);
 		if (path != NULL) {
 			fprintf(stdout, "%s is %s\n", name, path);
 			free(path);
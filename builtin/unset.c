@@ -48,7 +48,7 @@ int builtin_unset(struct mrsh_state *state, int argc, char *argv[]) {
 		} else {
 			struct mrsh_function *oldfn =
 				mrsh_hashtable_del(&priv->functions, argv[i]);
-			function_destroy(oldfn);
+			function_unref(oldfn);
 		}
 	}
 	return 0;
@@ -1,117 +1,103 @@
 #define _POSIX_C_SOURCE 200112L
-#include <errno.h>
+#include <mrsh/array.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <string.h>
-#include <sys/wait.h>
 #include "builtin.h"
+#include "shell/job.h"
 #include "shell/process.h"
 #include "shell/shell.h"
 
-struct wait_handle {
-	pid_t pid;
-	int status;
-};
-
-int builtin_wait(struct mrsh_state *state, int argc, char *argv[]) {
-	struct mrsh_state_priv *priv = state_get_priv(state);
-
-	int npids = argc - 1;
-	if (npids == 0) {
-		npids = priv->processes.len;
+static void collect_async_iterator(struct mrsh_process *process,
+		void *user_data) {
+	struct mrsh_array *processes = user_data;
+	if (process->async && process->terminated && !process->released) {
+		mrsh_array_add(processes, process);
 	}
-	struct wait_handle *pids = malloc(npids * sizeof(struct wait_handle));
-	if (pids == NULL) {
-		fprintf(stderr, "wait: unable to allocate pid list");
-		return EXIT_FAILURE;
+}
+
+/**
+ * Forget about the terminated asynchronous processes, once their status can't
+ * be waited for anymore.
+ */
+static void release_async(struct mrsh_state *state) {
+	struct mrsh_array processes = {0};
+	process_for_each(state, collect_async_iterator, &processes);
+	for (size_t i = 0; i < processes.len; ++i) {
+		process_release(processes.data[i]);
 	}
+	mrsh_array_finish(&processes);
+}
 
-	if (argc == 1) {
-		/* All known processes */
-		int _npids = 0;
-		for (size_t j = 0; j < priv->processes.len; ++j) {
-			struct mrsh_process *process = priv->processes.data[j];
-			if (process->terminated) {
-				continue;
-			}
-			pids[_npids].pid = process->pid;
-			pids[_npids].status = -1;
-			++_npids;
+/**
+ * Wait for the process `pid` to terminate and return its status.
+ */
+static int wait_pid(struct mrsh_state *state, pid_t pid) {
+	while (true) {
+		struct mrsh_process *process = process_by_pid(state, pid);
+		if (process == NULL) {
+			/* Unknown pids are assumed to have exited 127 */
+			return 127;
 		}
-		npids = _npids;
-	} else {
-		for (int i = 1; i < argc; ++i) {
-			if (argv[i][0] == '%') {
-				struct mrsh_job *job = job_by_id(state, argv[i], true);
-				if (!job) {
-					goto failure;
-				}
-				pids[i - 1].pid = job->pgid;
-				pids[i - 1].status = -1;
-			} else {
-				char *endptr;
-				pid_t pid = (pid_t)strtol(argv[i], &endptr, 10);
-				if (*endptr != '\0' || argv[i][0] == '\0') {
-					fprintf(stderr, "wait: error parsing pid '%s'", argv[i]);
-					goto failure;
-				}
-				if (pid <= 0) {
-					fprintf(stderr, "wait: invalid process ID\n");
-					goto failure;
-				}
-				pids[i - 1].pid = pid;
-				pids[i - 1].status = -1;
-				/* Check if this pid is known */
-				bool found = false;
-				for (size_t j = 0; j < priv->processes.len; ++j) {
-					struct mrsh_process *process = priv->processes.data[j];
-					if (process->pid == pid) {
-						if (process->terminated) {
-							pids[i - 1].status = process->stat;
-						}
-						found = true;
-						break;
-					}
-				}
-				if (!found) {
-					/* Unknown pids are assumed to have exited 127 */
-					pids[i - 1].status = 127;
-				}
+		if (process->terminated) {
+			int status = process_poll(process);
+			if (process->async) {
+				process_release(process);
 			}
+			return status;
+		}
+
+		int ret = reap_children(state, true);
+		if (ret < 0) {
+			return -1;
+		} else if (ret == 0) {
+			/* Not one of our children */
+			return 127;
 		}
 	}
+}
 
-	for (int i = 0; i < npids; ++i) {
-		int stat;
-		pid_t waited = waitpid(pids[i].pid, &stat, 0);
-		// TODO: update jobs internal state?
-		if (waited == -1) {
-			if (errno == ECHILD) {
-				continue;
+int builtin_wait(struct mrsh_state *state, int argc, char *argv[]) {
+	if (argc == 1) {
+		/* All known processes: reap children until there are none left */
+		while (true) {
+			int ret = reap_children(state, true);
+			if (ret < 0) {
+				return EXIT_FAILURE;
+			} else if (ret == 0) {
+				release_async(state);
+				return EXIT_SUCCESS;
 			}
-			perror("wait");
-			goto failure;
 		}
-		update_process(state, waited, stat);
-		if (WIFEXITED(stat)) {
-			pids[i].status = WEXITSTATUS(stat);
+	}
+
+	int status = EXIT_SUCCESS;
+	for (int i = 1; i < argc; ++i) {
+		pid_t pid;
+		if (argv[i][0] == '%') {
+			struct mrsh_job *job = job_by_id(state, argv[i], true);
+			if (!job) {
+				return EXIT_FAILURE;
+			}
+			pid = job->pgid;
 		} else {
-			pids[i].status = 129;
+			char *endptr;
+			pid = (pid_t)strtol(argv[i], &endptr, 10);
+			if (*endptr != '\0' || argv[i][0] == '\0') {
+				fprintf(stderr, "wait: error parsing pid '%s'", argv[i]);
+				return EXIT_FAILURE;
+			}
+			if (pid <= 0) {
+				fprintf(stderr, "wait: invalid process ID\n");
+				return EXIT_FAILURE;
+			}
 		}
-	}
 
-	int status;
-	if (argc == 1) {
-		status = EXIT_SUCCESS;
-	} else {
-		status = pids[npids - 1].status;
+		status = wait_pid(state, pid);
+		if (status < 0) {
+			return EXIT_FAILURE;
+		}
 	}
 
-	free(pids);
 	return status;
-
-failure:
-	free(pids);
-	return EXIT_FAILURE;
 }
@@ -1,118 +1,157 @@
 #define _POSIX_C_SOURCE 200809L
 #include <mrsh/hashtable.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
-static unsigned int djb2(const char *str) {
-	unsigned int hash = 5381;
-	char c;
-	while ((c = *str++)) {
-		hash = ((hash << 5) + hash) + c;
+#define HASHTABLE_INITIAL_CAP 16
+
+// Deleted entries keep their slot so that probe sequences going through them
+// aren't broken. They are dropped when the table is rehashed.
+static char deleted_key[] = "";
+
+static uint32_t fnv1a(const char *str) {
+	uint32_t hash = UINT32_C(2166136261);
+	for (; *str != '\0'; ++str) {
+		hash ^= (unsigned char)*str;
+		hash *= UINT32_C(16777619);
 	}
 	return hash;
 }
 
-void *mrsh_hashtable_get(struct mrsh_hashtable *table, const char *key) {
-	unsigned int hash = djb2(key);
-	unsigned int bucket = hash % MRSH_HASHTABLE_BUCKETS;
-	struct mrsh_hashtable_entry *entry = table->buckets[bucket];
+static bool entry_matches(const struct mrsh_hashtable_entry *entry,
+		uint32_t hash, const char *key) {
+	return entry->hash == hash && entry->key != deleted_key &&
+		strcmp(entry->key, key) == 0;
+}
 
-	while (entry != NULL) {
-		if (entry->hash == hash && strcmp(entry->key, key) == 0) {
-			return entry->value;
-		}
-		entry = entry->next;
+static struct mrsh_hashtable_entry *table_find(struct mrsh_hashtable *table,
+		uint32_t hash, const char *key) {
+	if (table->cap == 0) {
+		return NULL;
 	}
 
+	size_t mask = table->cap - 1;
+	for (size_t i = hash & mask; table->entries[i].key != NULL;
+			i = (i + 1) & mask) {
+		if (entry_matches(&table->entries[i], hash, key)) {
+			return &table->entries[i];
+		}
+	}
 	return NULL;
 }
 
-void *mrsh_hashtable_set(struct mrsh_hashtable *table, const char *key,
-		void *value) {
-	unsigned int hash = djb2(key);
-	unsigned int bucket = hash % MRSH_HASHTABLE_BUCKETS;
-	struct mrsh_hashtable_entry *entry = table->buckets[bucket];
-
-	struct mrsh_hashtable_entry *previous = NULL;
-	while (entry != NULL) {
-		if (entry->hash == hash && strcmp(entry->key, key) == 0) {
-			break;
-		}
-		previous = entry;
-		entry = entry->next;
+static bool table_rehash(struct mrsh_hashtable *table) {
+	// Keep the load factor under 1/2 after rehashing, so that a few insertions
+	// can happen before the next one
+	size_t new_cap = table->cap > 0 ? table->cap : HASHTABLE_INITIAL_CAP;
+	while ((table->len + 1) * 2 > new_cap) {
+		new_cap *= 2;
 	}
 
-	if (entry == NULL) {
-		entry = calloc(1, sizeof(struct mrsh_hashtable_entry));
-		entry->hash = hash;
-		entry->key = strdup(key);
-		if (previous != NULL) {
-			previous->next = entry;
-		} else {
-			table->buckets[bucket] = entry;
+	struct mrsh_hashtable_entry *new_entries =
+		calloc(new_cap, sizeof(struct mrsh_hashtable_entry));
+	if (new_entries == NULL) {
+		return false;
+	}
+
+	size_t mask = new_cap - 1;
+	for (size_t i = 0; i < table->cap; ++i) {
+		struct mrsh_hashtable_entry *entry = &table->entries[i];
+		if (entry->key == NULL || entry->key == deleted_key) {
+			continue;
 		}
+		size_t j = entry->hash & mask;
+		while (new_entries[j].key != NULL) {
+			j = (j + 1) & mask;
+		}
+		new_entries[j] = *entry;
 	}
 
-	void *old_value = entry->value;
-	entry->value = value;
-	return old_value;
+	free(table->entries);
+	table->entries = new_entries;
+	table->cap = new_cap;
+	table->used = table->len;
+	return true;
 }
 
-static void hashtable_entry_destroy(struct mrsh_hashtable_entry *entry) {
+void *mrsh_hashtable_get(struct mrsh_hashtable *table, const char *key) {
+	struct mrsh_hashtable_entry *entry = table_find(table, fnv1a(key), key);
 	if (entry == NULL) {
-		return;
+		return NULL;
 	}
-	free(entry->key);
-	free(entry);
+	return entry->value;
 }
 
-void *mrsh_hashtable_del(struct mrsh_hashtable *table, const char *key) {
-	unsigned int hash = djb2(key);
-	unsigned int bucket = hash % MRSH_HASHTABLE_BUCKETS;
-	struct mrsh_hashtable_entry *entry = table->buckets[bucket];
-
-	struct mrsh_hashtable_entry *previous = NULL;
-	while (entry != NULL) {
-		if (entry->hash == hash && strcmp(entry->key, key) == 0) {
-			break;
+void *mrsh_hashtable_set(struct mrsh_hashtable *table, const char *key,
+		void *value) {
+	uint32_t hash = fnv1a(key);
+	struct mrsh_hashtable_entry *entry = table_find(table, hash, key);
+	if (entry != NULL) {
+		void *old_value = entry->value;
+		entry->value = value;
+		return old_value;
+	}
+
+	// Keep the load factor, deleted entries included, under 3/4
+	if ((table->used + 1) * 4 > table->cap * 3) {
+		if (!table_rehash(table)) {
+			abort();
 		}
-		previous = entry;
-		entry = entry->next;
 	}
 
+	// Re-use the first deleted slot of the probe sequence, if any
+	size_t mask = table->cap - 1;
+	size_t i = hash & mask;
+	while (table->entries[i].key != NULL &&
+			table->entries[i].key != deleted_key) {
+		i = (i + 1) & mask;
+	}
+
+	entry = &table->entries[i];
+	if (entry->key == NULL) {
+		++table->used;
+	}
+	entry->key = strdup(key);
+	entry->value = value;
+	entry->hash = hash;
+	++table->len;
+	return NULL;
+}
+
+void *mrsh_hashtable_del(struct mrsh_hashtable *table, const char *key) {
+	struct mrsh_hashtable_entry *entry = table_find(table, fnv1a(key), key);
 	if (entry == NULL) {
 		return NULL;
 	}
 
-	if (previous != NULL) {
-		previous->next = entry->next;
-	} else {
-		table->buckets[bucket] = entry->next;
-	}
 	void *old_value = entry->value;
-	hashtable_entry_destroy(entry);
+	free(entry->key);
+	entry->key = deleted_key;
+	entry->value = NULL;
+	--table->len;
 	return old_value;
 }
 
 void mrsh_hashtable_finish(struct mrsh_hashtable *table) {
-	for (size_t i = 0; i < MRSH_HASHTABLE_BUCKETS; ++i) {
-		struct mrsh_hashtable_entry *entry = table->buckets[i];
-		while (entry != NULL) {
-			struct mrsh_hashtable_entry *next = entry->next;
-			hashtable_entry_destroy(entry);
-			entry = next;
+	for (size_t i = 0; i < table->cap; ++i) {
+		char *key = table->entries[i].key;
+		if (key != deleted_key) {
+			free(key);
 		}
 	}
+	free(table->entries);
+	table->entries = NULL;
+	table->len = table->used = table->cap = 0;
 }
 
 void mrsh_hashtable_for_each(struct mrsh_hashtable *table,
 		mrsh_hashtable_iterator_func iterator, void *user_data) {
-	for (size_t i = 0; i < MRSH_HASHTABLE_BUCKETS; ++i) {
-		struct mrsh_hashtable_entry *entry = table->buckets[i];
-		while (entry != NULL) {
-			struct mrsh_hashtable_entry *next = entry->next;
-			iterator(entry->key, entry->value, user_data);
-			entry = next;
+	for (size_t i = 0; i < table->cap; ++i) {
+		struct mrsh_hashtable_entry *entry = &table->entries[i];
+		if (entry->key == NULL || entry->key == deleted_key) {
+			continue;
 		}
+		iterator(entry->key, entry->value, user_data);
 	}
 }
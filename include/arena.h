@@ -0,0 +1,21 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ * An arena hands out memory from large chunks by bumping a pointer. Allocations
+ * can't be freed individually, they are all released when the arena is
+ * destroyed.
+ */
+struct mrsh_arena;
+
+struct mrsh_arena *arena_create(void);
+void arena_destroy(struct mrsh_arena *arena);
+/**
+ * Allocates uninitialized memory suitably aligned for any type. Returns NULL
+ * on failure.
+ */
+void *arena_alloc(struct mrsh_arena *arena, size_t size);
+
+#endif
@@ -2,8 +2,70 @@
 #define AST_H
 
 #include <mrsh/ast.h>
+#include <mrsh/buffer.h>
+#include <sys/types.h>
+#include "arena.h"
 
 void command_list_array_finish(struct mrsh_array *cmds);
 void case_item_destroy(struct mrsh_case_item *item);
 
+/**
+ * Allocation helpers for the AST. Memory is carved out of `arena`, or taken
+ * from the heap if it's NULL. Nodes allocated in an arena must not be
+ * destroyed individually: they're released along with the arena.
+ */
+void *ast_alloc(struct mrsh_arena *arena, size_t size);
+void *ast_calloc(struct mrsh_arena *arena, size_t size);
+char *ast_strdup(struct mrsh_arena *arena, const char *str);
+/**
+ * Get the buffer's current data and reset it, like mrsh_buffer_steal.
+ */
+char *ast_buffer_steal(struct mrsh_arena *arena, struct mrsh_buffer *buf);
+ssize_t ast_array_add(struct mrsh_arena *arena, struct mrsh_array *array,
+	void *value);
+void ast_array_finish(struct mrsh_arena *arena, struct mrsh_array *array);
+
+/**
+ * Node constructors allocating in `arena`, see the mrsh_*_create functions.
+ */
+struct mrsh_command_list *ast_command_list_create(struct mrsh_arena *arena);
+struct mrsh_program *ast_program_create(struct mrsh_arena *arena);
+struct mrsh_word_string *ast_word_string_create(struct mrsh_arena *arena,
+	char *str, bool single_quoted);
+struct mrsh_word_parameter *ast_word_parameter_create(struct mrsh_arena *arena,
+	char *name, enum mrsh_word_parameter_op op, bool colon,
+	struct mrsh_word *arg);
+struct mrsh_word_command *ast_word_command_create(struct mrsh_arena *arena,
+	struct mrsh_program *prog, bool back_quoted);
+struct mrsh_word_arithmetic *ast_word_arithmetic_create(
+	struct mrsh_arena *arena, struct mrsh_word *body);
+struct mrsh_word_list *ast_word_list_create(struct mrsh_arena *arena,
+	struct mrsh_array *children, bool double_quoted);
+struct mrsh_simple_command *ast_simple_command_create(struct mrsh_arena *arena,
+	struct mrsh_word *name, struct mrsh_array *arguments,
+	struct mrsh_array *io_redirects, struct mrsh_array *assignments);
+struct mrsh_brace_group *ast_brace_group_create(struct mrsh_arena *arena,
+	struct mrsh_array *body);
+struct mrsh_subshell *ast_subshell_create(struct mrsh_arena *arena,
+	struct mrsh_array *body);
+struct mrsh_if_clause *ast_if_clause_create(struct mrsh_arena *arena,
+	struct mrsh_array *condition, struct mrsh_array *body,
+	struct mrsh_command *else_part);
+struct mrsh_for_clause *ast_for_clause_create(struct mrsh_arena *arena,
+	char *name, bool in, struct mrsh_array *word_list,
+	struct mrsh_array *body);
+struct mrsh_loop_clause *ast_loop_clause_create(struct mrsh_arena *arena,
+	enum mrsh_loop_type type, struct mrsh_array *condition,
+	struct mrsh_array *body);
+struct mrsh_case_clause *ast_case_clause_create(struct mrsh_arena *arena,
+	struct mrsh_word *word, struct mrsh_array *items);
+struct mrsh_function_definition *ast_function_definition_create(
+	struct mrsh_arena *arena, char *name, struct mrsh_command *body,
+	struct mrsh_array *io_redirects);
+struct mrsh_pipeline *ast_pipeline_create(struct mrsh_arena *arena,
+	struct mrsh_array *commands, bool bang);
+struct mrsh_binop *ast_binop_create(struct mrsh_arena *arena,
+	enum mrsh_binop_type type, struct mrsh_and_or_list *left,
+	struct mrsh_and_or_list *right);
+
 #endif
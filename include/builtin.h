@@ -3,12 +3,24 @@
 
 #include <mrsh/builtin.h>
 
+struct mrsh_buffer;
 struct mrsh_state;
 
 typedef int (*mrsh_builtin_func)(struct mrsh_state *state,
 	int argc, char *argv[]);
 
 void print_escaped(const char *value);
+/**
+ * Returns the character represented by the backslash escape `\<c>`, or -1 if
+ * `c` isn't one of `abfnrtv\`.
+ */
+int escape_char(char c);
+/**
+ * Appends `str` to `buf`, interpreting the backslash escapes supported by echo
+ * and printf's %b conversion. Returns false if `\c` was encountered, in which
+ * case any further output should be suppressed.
+ */
+bool expand_escapes(struct mrsh_buffer *buf, const char *str);
 
 int builtin_alias(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_bg(struct mrsh_state *state, int argc, char *argv[]);
@@ -17,6 +29,7 @@ int builtin_cd(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_command(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_colon(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_dot(struct mrsh_state *state, int argc, char *argv[]);
+int builtin_echo(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_eval(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_exec(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_exit(struct mrsh_state *state, int argc, char *argv[]);
@@ -26,11 +39,13 @@ int builtin_fg(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_getopts(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_hash(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_jobs(struct mrsh_state *state, int argc, char *argv[]);
+int builtin_printf(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_pwd(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_read(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_return(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_set(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_shift(struct mrsh_state *state, int argc, char *argv[]);
+int builtin_test(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_times(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_trap(struct mrsh_state *state, int argc, char *argv[]);
 int builtin_true(struct mrsh_state *state, int argc, char *argv[]);
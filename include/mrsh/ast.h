@@ -4,6 +4,9 @@
 #include <mrsh/array.h>
 #include <stdbool.h>
 
+struct mrsh_arena;
+struct mrsh_buffer;
+
 /**
  * Position describes an arbitrary source position including line and column
  * location.
@@ -53,6 +56,10 @@ enum mrsh_word_type {
 struct mrsh_word {
 	struct mrsh_node node;
 	enum mrsh_word_type type;
+	// Set by the parser if the word is made of strings only, without unquoted
+	// pattern characters nor leading tilde: its expansion as a command
+	// argument is the word itself, as a single field
+	bool literal;
 };
 
 /**
@@ -398,10 +405,16 @@ struct mrsh_command_list {
 
 /**
  * A shell program. It contains command lists.
+ *
+ * Programs returned by the parser own an arena holding all of their nodes,
+ * strings and arrays. Destroying such a program releases the arena at once.
+ * Their nodes must not be destroyed individually.
  */
 struct mrsh_program {
 	struct mrsh_node node;
 	struct mrsh_array body; // struct mrsh_command_list *
+
+	struct mrsh_arena *arena; // can be NULL
 };
 
 typedef void (*mrsh_node_iterator_func)(struct mrsh_node *node,
@@ -492,8 +505,8 @@ struct mrsh_binop *mrsh_and_or_list_get_binop(
 void mrsh_node_for_each(struct mrsh_node *node,
 	mrsh_node_iterator_func iterator, void *user_data);
 
-void mrsh_word_range(struct mrsh_word *word, struct mrsh_position *begin,
-	struct mrsh_position *end);
+void mrsh_word_range(const struct mrsh_word *word,
+	struct mrsh_position *begin, struct mrsh_position *end);
 void mrsh_command_range(struct mrsh_command *cmd, struct mrsh_position *begin,
 	struct mrsh_position *end);
 char *mrsh_word_str(const struct mrsh_word *word);
@@ -513,4 +526,19 @@ struct mrsh_command_list *mrsh_command_list_copy(
 	const struct mrsh_command_list *l);
 struct mrsh_program *mrsh_program_copy(const struct mrsh_program *prog);
 
+/**
+ * Appends a compact binary encoding of the program to the buffer, including
+ * source positions. The encoding is only meant to be read back by the same
+ * version of mrsh.
+ */
+void mrsh_program_serialize(struct mrsh_buffer *buf,
+	const struct mrsh_program *prog);
+/**
+ * Decodes a program written by mrsh_program_serialize. Reading starts at
+ * `*data_ptr`, which is advanced past the program. Returns NULL if the data is
+ * invalid.
+ */
+struct mrsh_program *mrsh_program_deserialize(const char **data_ptr,
+	const char *end);
+
 #endif
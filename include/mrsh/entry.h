@@ -1,6 +1,7 @@
 #ifndef MRSH_ENTRY_H
 #define MRSH_ENTRY_H
 
+#include <mrsh/parser.h>
 #include <mrsh/shell.h>
 #include <stdbool.h>
 
@@ -44,4 +45,28 @@ void mrsh_source_env(struct mrsh_state *state);
  */
 bool mrsh_run_exit_trap(struct mrsh_state *state);
 
+/**
+ * The parsed lines of a script file, cached in the directory named by
+ * $MRSH_CACHE_DIR.
+ */
+struct mrsh_script_cache;
+
+/**
+ * Loads the parsed lines of the script file opened as `fd` from the cache
+ * directory. If the file has been modified since it was cached, it is parsed
+ * again and the cache is updated, unless the file has just been modified.
+ * Returns NULL if $MRSH_CACHE_DIR isn't set or if the script can't be cached,
+ * e.g. because it isn't a regular file or because it contains a syntax error.
+ */
+struct mrsh_script_cache *mrsh_script_cache_load(struct mrsh_state *state,
+	const char *path, int fd);
+/**
+ * Like mrsh_parse_line, but returns the next cached line while no alias is
+ * defined. `parser` must read the script file from its beginning and must be
+ * used for all calls.
+ */
+struct mrsh_program *mrsh_script_cache_parse_line(
+	struct mrsh_script_cache *cache, struct mrsh_parser *parser);
+void mrsh_script_cache_destroy(struct mrsh_script_cache *cache);
+
 #endif
@@ -1,17 +1,25 @@
 #ifndef MRSH_HASHTABLE_H
 #define MRSH_HASHTABLE_H
 
-#define MRSH_HASHTABLE_BUCKETS 256
+#include <stddef.h>
+#include <stdint.h>
 
 struct mrsh_hashtable_entry {
-	struct mrsh_hashtable_entry *next;
-	unsigned int hash;
-	char *key;
+	char *key; // NULL if the slot is free
 	void *value;
+	uint32_t hash;
 };
 
+/**
+ * A string-keyed hash table. It uses open addressing with linear probing and
+ * grows with its load, so that lookups only touch a few adjacent entries. A
+ * zero-initialized table is empty and ready to use.
+ */
 struct mrsh_hashtable {
-	struct mrsh_hashtable_entry *buckets[MRSH_HASHTABLE_BUCKETS];
+	struct mrsh_hashtable_entry *entries;
+	size_t len; // number of keys
+	size_t used; // number of non-free slots, including deleted entries
+	size_t cap; // zero or a power of two
 };
 
 typedef void (*mrsh_hashtable_iterator_func)(const char *key, void *value,
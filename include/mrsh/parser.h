@@ -18,6 +18,15 @@ typedef const char *(*mrsh_parser_alias_func)(const char *name,
  * Create a parser from a file descriptor.
  */
 struct mrsh_parser *mrsh_parser_with_fd(int fd);
+/**
+ * Create a parser from a script file. Regular files are memory-mapped, other
+ * files are read like with mrsh_parser_with_fd. The file offset isn't updated,
+ * so this must not be used for input shared with other commands, such as
+ * standard input. Accessing the mapping after the file has been truncated
+ * raises SIGBUS, so the script must be parsed completely before any of its
+ * commands run.
+ */
+struct mrsh_parser *mrsh_parser_with_file(int fd);
 /**
  * Create a parser from a static buffer.
  */
@@ -55,6 +55,12 @@ enum mrsh_option {
 	// -x: The shell shall write to standard error a trace for each command
 	// after it expands the command and before it executes it.
 	MRSH_OPT_XTRACE = 1 << 13,
+	// -o profile: Record the time spent in each source line and function, and
+	// report it when the shell exits.
+	MRSH_OPT_PROFILE = 1 << 14,
+	// -o bytecode: Compile programs and functions to bytecode and run them on
+	// a virtual machine instead of walking their syntax tree.
+	MRSH_OPT_BYTECODE = 1 << 15,
 };
 
 enum mrsh_variable_attrib {
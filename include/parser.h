@@ -45,7 +45,11 @@ struct mrsh_parser {
 	struct mrsh_buffer *in_buf; // can be NULL
 	bool eof;
 
-	struct mrsh_buffer buf; // internal read buffer
+	// Internal read buffer. Consumed data is skipped by advancing buf.data,
+	// the buffer must be compacted before being grown or freed.
+	struct mrsh_buffer buf;
+	size_t buf_offset; // number of consumed bytes before buf.data
+	size_t map_size; // size of the mapping buf.data points into, if any
 	struct mrsh_position pos;
 
 	struct {
@@ -63,10 +67,20 @@ struct mrsh_parser {
 	void *alias_user_data;
 
 	int arith_nested_parens;
+
+	// Arena in which nodes are allocated. It's set by mrsh_parse_program and
+	// mrsh_parse_line for the duration of the parse, and shared with the
+	// parsers of nested programs. Nodes of a failed parse are never destroyed
+	// individually, they're released along with the arena.
+	struct mrsh_arena *arena;
 };
 
 typedef struct mrsh_word *(*word_func)(struct mrsh_parser *parser, char end);
 
+/**
+ * Move the unconsumed data back to the start of the read buffer's allocation.
+ */
+void parser_compact(struct mrsh_parser *parser);
 size_t parser_peek(struct mrsh_parser *parser, char *buf, size_t size);
 char parser_peek_char(struct mrsh_parser *parser);
 size_t parser_read(struct mrsh_parser *parser, char *buf, size_t size);
@@ -97,6 +111,11 @@ size_t peek_name(struct mrsh_parser *parser, bool in_braces);
 size_t peek_word(struct mrsh_parser *parser, char end);
 struct mrsh_word *expect_dollar(struct mrsh_parser *parser);
 struct mrsh_word *back_quotes(struct mrsh_parser *parser);
+/**
+ * Checks whether an unquoted string is left as-is by tilde and pathname
+ * expansion.
+ */
+bool is_literal_string(const char *str);
 struct mrsh_word *word(struct mrsh_parser *parser, char end);
 struct mrsh_word *arithmetic_word(struct mrsh_parser *parser, char end);
 struct mrsh_word *parameter_expansion_word(struct mrsh_parser *parser);
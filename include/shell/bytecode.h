@@ -0,0 +1,118 @@
+#ifndef SHELL_BYTECODE_H
+#define SHELL_BYTECODE_H
+
+#include <mrsh/arithm.h>
+#include <mrsh/ast.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct mrsh_context;
+struct pattern;
+
+enum bytecode_op {
+	// Stop running the code
+	BC_END,
+	// Run the pipeline with the AST walker
+	BC_PIPELINE,
+	// Run the command with the AST walker
+	BC_COMMAND,
+	// Run the simple command of the pipeline
+	BC_SIMPLE_COMMAND,
+	// Call a builtin with literal arguments
+	BC_BUILTIN,
+	// Assign a literal value to a variable
+	BC_ASSIGN,
+	// Assign the value of a constant arithmetic expression to a variable
+	BC_ASSIGN_ARITHM,
+	// Run the and-or list in the background
+	BC_ASYNC,
+	// Negate the status
+	BC_NOT,
+	// Set the status to zero
+	BC_CLEAR,
+	// Update the last status of the shell at the end of a command list
+	BC_LIST_END,
+	// Jump to the target, unconditionally or depending on the status
+	BC_JUMP,
+	BC_JUMP_IF_ZERO,
+	BC_JUMP_IF_NONZERO,
+	// Jump to the end of an and-or list once the status of its left operand
+	// decides it. A fatal error in the left operand is handled as a non-zero
+	// status, like run_and_or_list does.
+	BC_AND,
+	BC_OR,
+	// Create the job of the pipeline if there isn't one yet
+	BC_JOB_BEGIN,
+	BC_JOB_END,
+	// Enter a while or until loop ending at the target
+	BC_LOOP_BEGIN,
+	// Exit the loop if the shell is exiting
+	BC_LOOP_TEST,
+	// Save the status of the loop body and jump back to the target
+	BC_LOOP_NEXT,
+	BC_LOOP_END,
+	// Expand the words of a for loop ending at the target
+	BC_FOR_BEGIN,
+	// Assign the next field, or exit the loop when there are none left
+	BC_FOR_NEXT,
+	// Expand the word of a case clause
+	BC_CASE_BEGIN,
+	// Jump to the target if the pattern matches the word of the case clause
+	BC_CASE_MATCH,
+	// Forget the word of the case clause and set the status to zero
+	BC_CASE_END,
+};
+
+struct bytecode_instr {
+	enum bytecode_op op;
+	// Whether the instruction may run in tail position, in which case it
+	// inherits the tail flag of the context the code is run in
+	bool tail;
+	size_t target; // jump target, or end of the loop
+	// Pipeline of simple commands, used to fall back to the AST walker
+	struct mrsh_pipeline *pipeline;
+	union {
+		struct mrsh_command *command;
+		struct mrsh_command_list *list;
+		struct mrsh_for_clause *for_clause;
+		struct mrsh_case_clause *case_clause;
+		size_t left; // BC_AND and BC_OR: first instruction of the left operand
+		struct {
+			struct mrsh_word *word;
+			// Set if the pattern is constant
+			char *literal;
+			struct pattern *compiled;
+		} pattern;
+		struct {
+			int argc;
+			char **argv; // NULL-terminated
+		} builtin;
+		struct {
+			const char *name;
+			char *value;
+			struct mrsh_arithm_expr *expr;
+		} assign;
+	} arg;
+};
+
+/**
+ * A command list array compiled to a flat sequence of instructions, run by
+ * run_bytecode when the bytecode option is enabled. The code borrows the AST it
+ * was compiled from, which must outlive it.
+ */
+struct bytecode {
+	struct bytecode_instr *instrs;
+	size_t len, cap;
+	size_t max_depth; // maximum number of nested loops, case clauses and jobs
+};
+
+struct bytecode *bytecode_compile_program(struct mrsh_program *prog);
+struct bytecode *bytecode_compile_command(struct mrsh_command *cmd);
+void bytecode_destroy(struct bytecode *code);
+/**
+ * Run compiled code. Returns the status of the last command, or a negative
+ * TASK_STATUS_* value.
+ */
+int run_bytecode(struct mrsh_context *ctx, const struct bytecode *code);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef SHELL_CACHE_H
+#define SHELL_CACHE_H
+
+#include <mrsh/ast.h>
+#include <mrsh/parser.h>
+#include <mrsh/shell.h>
+
+/**
+ * Parses a whole file with mrsh_parse_program. If $MRSH_CACHE_DIR is set, the
+ * program is loaded from the cache directory if the file hasn't been modified
+ * since it was cached, and stored in the cache directory otherwise, unless the
+ * file has just been modified.
+ */
+struct mrsh_program *cache_parse_program(struct mrsh_state *state,
+	const char *path, int fd, struct mrsh_parser *parser);
+
+#endif
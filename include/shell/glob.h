@@ -0,0 +1,29 @@
+#ifndef SHELL_GLOB_H
+#define SHELL_GLOB_H
+
+#include <mrsh/array.h>
+#include <mrsh/hashtable.h>
+#include <stdbool.h>
+
+/**
+ * Directory listings read during pathname expansion. When the words of a
+ * command share a cache, each directory is only read once. A zero-initialized
+ * cache is empty and ready to use.
+ */
+struct glob_cache {
+	struct mrsh_hashtable dirs; // struct glob_dir *, by directory path
+};
+
+/**
+ * Forgets all listings. The cache can be used again afterwards.
+ */
+void glob_cache_finish(struct glob_cache *cache);
+/**
+ * Appends the pathnames matching `pattern` to `matches`, sorted in collation
+ * order. `pattern` is a shell pattern with backslashes escaping characters.
+ * Returns false if out of memory.
+ */
+bool glob_expand(struct glob_cache *cache, const char *pattern,
+	struct mrsh_array *matches);
+
+#endif
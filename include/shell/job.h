@@ -58,6 +58,13 @@ void job_add_process(struct mrsh_job *job, struct mrsh_process *proc);
  *   terminated)
  */
 int job_poll(struct mrsh_job *job);
+/**
+ * Reap the child processes which have changed state, whichever they are, and
+ * update the processes and jobs accordingly. If `block` is set, wait until at
+ * least one child has changed state. Returns 1 if a child has been reaped, 0 if
+ * none has, or if there are no children left to wait for, and -1 on error.
+ */
+int reap_children(struct mrsh_state *state, bool block);
 /**
  * Wait for the completion of the job.
  */
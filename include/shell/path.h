@@ -12,6 +12,19 @@
  */
 char *expand_path(struct mrsh_state *state, const char *file, bool exec,
 	bool default_path);
+/* Searches $PATH for the requested utility like expand_path, but remembers its
+ * location so that subsequent lookups don't need to search again. If hit is
+ * true, the utility's hit count is incremented. The caller must free the
+ * return value.
+ */
+char *find_utility(struct mrsh_state *state, const char *name, bool hit);
+/* Forgets the remembered location of a utility, once it's known to be stale.
+ */
+void forget_utility(struct mrsh_state *state, const char *name);
+/* Forgets all remembered utility locations. This must be called when $PATH
+ * changes.
+ */
+void forget_utilities(struct mrsh_state *state);
 /* Like getcwd, but returns allocated memory */
 char *current_working_dir(void);
 
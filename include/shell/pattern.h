@@ -0,0 +1,43 @@
+#ifndef SHELL_PATTERN_H
+#define SHELL_PATTERN_H
+
+#include <mrsh/shell.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/**
+ * A compiled shell pattern, as used by case clauses and parameter expansions.
+ * Patterns use the fnmatch(3) syntax, with backslashes escaping characters.
+ */
+struct pattern;
+
+/**
+ * Compiles a pattern. Returns NULL if out of memory.
+ */
+struct pattern *pattern_compile(const char *str);
+void pattern_destroy(struct pattern *pat);
+/**
+ * Checks whether the whole string matches the pattern.
+ */
+bool pattern_match(const struct pattern *pat, const char *str);
+/**
+ * Returns the length of the shortest (or longest) prefix of `str` matching the
+ * pattern, or -1 if there is none. Runs in linear time in the length of `str`.
+ */
+ssize_t pattern_match_prefix(const struct pattern *pat, const char *str,
+	bool longest);
+/**
+ * Same as pattern_match_prefix, for suffixes.
+ */
+ssize_t pattern_match_suffix(const struct pattern *pat, const char *str,
+	bool longest);
+/**
+ * Returns the compiled pattern from the cache of the shell, compiling it if it
+ * isn't there yet. The pattern is owned by the cache and is only valid until
+ * the next call. Returns NULL if out of memory.
+ */
+const struct pattern *pattern_cache_get(struct mrsh_state *state,
+	const char *str);
+void pattern_cache_finish(struct mrsh_state *state);
+
+#endif
@@ -5,16 +5,28 @@
 #include <stdbool.h>
 #include <sys/types.h>
 
+struct mrsh_job;
+
 /**
  * This struct is used to track child processes.
  *
+ * A process is owned either by the job it has been added to, or by the task
+ * which created it. Tasks which don't need the process anymore (typically
+ * after having waited for it) must call process_release. Released processes
+ * which don't belong to a job are destroyed as soon as they are reaped.
+ * Processes of asynchronous commands are released by the wait builtin.
+ *
  * This object is guaranteed to be valid until either:
- * - The process terminates
+ * - The process terminates after being released
+ * - The job owning the process is destroyed
  * - The shell is destroyed
  */
 struct mrsh_process {
 	pid_t pid;
 	struct mrsh_state *state;
+	struct mrsh_job *job; // can be NULL
+	bool released;
+	bool async; // started by an asynchronous command
 	bool stopped;
 	bool terminated;
 	int stat; // only valid if terminated
@@ -22,10 +34,29 @@ struct mrsh_process {
 };
 
 /**
- * Register a new process.
+ * A table of processes indexed by PID. It uses open addressing with linear
+ * probing.
+ */
+struct mrsh_process_table {
+	struct mrsh_process **slots;
+	size_t len, cap; // cap is zero or a power of two
+};
+
+typedef void (*mrsh_process_iterator_func)(struct mrsh_process *proc,
+	void *user_data);
+
+/**
+ * Register a new process. Aborts if out of memory, so the result is never
+ * NULL.
  */
 struct mrsh_process *process_create(struct mrsh_state *state, pid_t pid);
 void process_destroy(struct mrsh_process *process);
+/**
+ * Drop the creator's reference to the process. The process is destroyed
+ * immediately if it has terminated and doesn't belong to a job, otherwise it
+ * will be when it is reaped.
+ */
+void process_release(struct mrsh_process *process);
 /**
  * Polls the process' current status without blocking. Returns:
  * - An integer >= 0 if the process has terminated
@@ -33,10 +64,22 @@ void process_destroy(struct mrsh_process *process);
  * - TASK_STATUS_WAIT if the process is running
  */
 int process_poll(struct mrsh_process *process);
+/**
+ * Look up a process by its PID. Returns NULL if the process isn't known.
+ */
+struct mrsh_process *process_by_pid(struct mrsh_state *state, pid_t pid);
+/**
+ * Calls `iterator` for each known process. The iterator must not create nor
+ * destroy processes.
+ */
+void process_for_each(struct mrsh_state *state,
+	mrsh_process_iterator_func iterator, void *user_data);
 
 /**
  * Update the shell's state with a child process status.
  */
 void update_process(struct mrsh_state *state, pid_t pid, int stat);
 
+void process_table_finish(struct mrsh_process_table *table);
+
 #endif
@@ -0,0 +1,62 @@
+#ifndef SHELL_PROFILE_H
+#define SHELL_PROFILE_H
+
+#include <mrsh/array.h>
+#include <mrsh/hashtable.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct mrsh_state;
+struct mrsh_simple_command;
+
+/**
+ * Resources consumed by a source line or a function. Times include the time
+ * spent in nested commands and function calls.
+ */
+struct mrsh_profile_stats {
+	uint64_t calls, forks;
+	uint64_t wall_ns, cpu_ns;
+};
+
+/**
+ * The profiler is enabled with `set -o profile`. It keeps track of the
+ * commands and functions being executed in a stack of frames, and reports its
+ * findings when the shell exits.
+ */
+struct mrsh_profiler {
+	pid_t pid; // process which collected the data, 0 if nothing was recorded
+	uint64_t forks;
+	struct mrsh_array frames; // struct mrsh_profile_frame *
+	// Per-line stats of each file, "eval" and "trap", see
+	// mrsh_state_priv.source. struct mrsh_profile_source *
+	struct mrsh_hashtable sources;
+	struct mrsh_hashtable functions; // struct mrsh_profile_stats *
+	// Self wall time in microseconds of each collapsed stack, uint64_t *
+	struct mrsh_hashtable stacks;
+};
+
+/**
+ * Start profiling a simple command. Must be followed by a call to
+ * profile_end_command.
+ */
+void profile_begin_command(struct mrsh_state *state,
+	const struct mrsh_simple_command *sc);
+void profile_end_command(struct mrsh_state *state);
+/**
+ * Start profiling a function call. Must be followed by a call to
+ * profile_end_function.
+ */
+void profile_begin_function(struct mrsh_state *state, const char *name);
+void profile_end_function(struct mrsh_state *state);
+/**
+ * Records that the shell has forked a child process.
+ */
+void profile_record_fork(struct mrsh_state *state);
+/**
+ * Writes the report to stderr and the collapsed stacks to the file named by
+ * $MRSH_PROFILE_FILE, if anything has been recorded by this process. Then
+ * releases the profiler's resources.
+ */
+void profiler_finish(struct mrsh_state *state);
+
+#endif
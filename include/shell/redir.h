@@ -2,7 +2,20 @@
 #define SHELL_REDIR_H
 
 #include <mrsh/ast.h>
+#include <mrsh/buffer.h>
+#include <mrsh/shell.h>
 
-int process_redir(const struct mrsh_io_redirect *redir, int *redir_fd);
+/**
+ * A redirection whose words have been expanded, for a single execution of a
+ * command.
+ */
+struct expanded_redirect {
+	const struct mrsh_io_redirect *redir;
+	char *name;
+	struct mrsh_buffer here_document; // all lines, for << and <<- only
+};
+
+int process_redir(struct mrsh_state *state,
+	const struct expanded_redirect *exp, int *redir_fd);
 
 #endif
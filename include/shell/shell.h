@@ -2,18 +2,61 @@
 #define SHELL_SHELL_H
 
 #include <mrsh/shell.h>
+#include <sys/types.h>
 #include <termios.h>
 #include "job.h"
 #include "process.h"
+#include "shell/profile.h"
 #include "shell/trap.h"
+#include "shell/word.h"
 
+struct bytecode;
+
+enum variable_number {
+	VARIABLE_NUMBER_UNKNOWN, // the string value hasn't been converted yet
+	VARIABLE_NUMBER_VALID,
+	VARIABLE_NUMBER_INVALID, // the string value isn't a number
+};
+
+// Values shorter than this are stored in the variable itself
+#define VARIABLE_INLINE_SIZE 24
+
+/**
+ * A shell variable. Variables used in arithmetic expressions keep their integer
+ * value next to their string value, each being converted from the other when
+ * first needed.
+ *
+ * Assigning a variable updates its record in place, reusing the storage of the
+ * previous value when it's large enough.
+ */
 struct mrsh_variable {
+	// NULL if only the integer value is known, otherwise points to either
+	// inline_value or heap_value
 	char *value;
 	uint32_t attribs; // enum mrsh_variable_attrib
+	int env_index; // index in the envp array, -1 if not in there
+	enum variable_number number_state;
+	long number;
+	char *heap_value;
+	size_t heap_cap;
+	char inline_value[VARIABLE_INLINE_SIZE];
 };
 
+/**
+ * A function definition. References are held by the function table and by
+ * each running invocation, so that the body stays valid if the function is
+ * unset or redefined while it runs.
+ */
 struct mrsh_function {
 	struct mrsh_command *body;
+	struct bytecode *code; // compiled on first use, can be NULL
+	char *source; // see mrsh_state_priv.source, when it was defined
+	int ref;
+};
+
+struct mrsh_utility {
+	char *path;
+	int hits;
 };
 
 enum mrsh_branch_control {
@@ -36,23 +79,61 @@ struct mrsh_trap {
 	struct mrsh_program *program;
 };
 
+/**
+ * A snapshot of the parts of the shell state which can be modified by commands
+ * run in the shell process, used to run them with the isolation of a subshell
+ * without forking. Variables are saved lazily, right before they're first
+ * modified.
+ */
+struct mrsh_snapshot {
+	struct mrsh_snapshot *prev;
+	int exit, last_status;
+	uint32_t options;
+	int cwd_fd; // -1 if the working directory isn't saved
+	bool umask_saved;
+	mode_t umask;
+	// struct mrsh_variable *, with neither a string nor an integer value if
+	// the variable was unset
+	struct mrsh_hashtable variables;
+};
+
 struct mrsh_state_priv {
 	struct mrsh_state pub;
 
 	int term_fd;
-	struct mrsh_array processes;
+	struct mrsh_process_table processes;
 	struct mrsh_hashtable aliases; // char *
 	struct mrsh_hashtable variables; // struct mrsh_variable *
+	// Environment of executed utilities, NULL-terminated. Contains a
+	// "key=value" string for each exported variable, kept in sync when
+	// variables change.
+	struct mrsh_array envp; // char *
 	struct mrsh_hashtable functions; // struct mrsh_function *
+	struct mrsh_hashtable utilities; // struct mrsh_utility *
+	struct mrsh_hashtable patterns; // struct pattern *, see pattern_cache_get
+	struct ifs_table ifs_table; // see get_ifs_table
+	bool ifs_table_valid;
 
 	bool job_control;
 	pid_t pgid;
 	struct termios term_modes;
 	struct mrsh_array jobs; // struct mrsh_job *
 	struct mrsh_job *foreground_job;
+	pid_t last_async_pid; // for $!, 0 if no asynchronous command was run
 
 	struct mrsh_trap traps[MRSH_NSIG];
 
+	struct mrsh_profiler profiler;
+	// Where the commands being run come from: the file run by `.`, "eval" or
+	// "trap". NULL for the main script.
+	const char *source;
+
+	struct mrsh_snapshot *snapshot; // innermost active snapshot, if any
+	// Temporary files capturing the output of command substitutions run in
+	// the shell process, indexed by nesting level
+	int *capture_fds;
+	size_t capture_fds_len, capture_depth;
+
 	// TODO: move this to context
 	bool child; // true if we're not the main shell process
 };
@@ -68,9 +149,60 @@ struct mrsh_context {
 	struct mrsh_job *job;
 	// When executing an asynchronous list, this is set to true
 	bool background;
+	// When executing the last command of a forked child process, this is set
+	// to true: the child exits right after, so external utilities can be
+	// executed in-place instead of being forked again
+	bool tail;
+	// When expanding the words of a command, this is set to the directory
+	// listings shared by its pathname expansions
+	struct glob_cache *glob_cache;
 };
 
-void function_destroy(struct mrsh_function *fn);
+/**
+ * Create a function with a reference count of 1. Takes ownership of `body`.
+ */
+struct mrsh_function *function_create(struct mrsh_command *body);
+void function_ref(struct mrsh_function *fn);
+void function_unref(struct mrsh_function *fn);
+
+/**
+ * Start recording changes to the shell state. The working directory and the
+ * file mode creation mask are only saved if requested. Returns false on error.
+ */
+bool snapshot_save(struct mrsh_state *state, struct mrsh_snapshot *snapshot,
+	bool save_cwd, bool save_umask);
+/**
+ * Undo all changes made to the shell state since the matching snapshot_save
+ * call. Snapshots must be restored in reverse order.
+ */
+void snapshot_restore(struct mrsh_state *state,
+	struct mrsh_snapshot *snapshot);
+
+/**
+ * Returns the string value of a variable, formatting its integer value if
+ * needed. Returns NULL if out of memory.
+ */
+const char *variable_get_value(struct mrsh_variable *var);
+/**
+ * Gets the attributes of a variable. Returns false if the variable is unset.
+ */
+bool env_get_attribs(struct mrsh_state *state, const char *key,
+	uint32_t *attribs);
+/**
+ * Gets the integer value of a variable. Returns false if the variable is unset
+ * or if its value isn't a number.
+ */
+bool env_get_number(struct mrsh_state *state, const char *key, long *number,
+	uint32_t *attribs);
+void env_set_number(struct mrsh_state *state, const char *key, long number,
+	uint32_t attribs);
+
+/**
+ * Creates an unlinked temporary file in $TMPDIR, or /tmp if it's unset, opened
+ * for reading and writing with close-on-exec. Returns -1 on error, with errno
+ * set.
+ */
+int create_temp_file(struct mrsh_state *state);
 
 struct mrsh_call_frame_priv *call_frame_get_priv(struct mrsh_call_frame *frame);
 
@@ -1,6 +1,7 @@
 #ifndef SHELL_TASK_H
 #define SHELL_TASK_H
 
+#include <mrsh/buffer.h>
 #include "shell/shell.h"
 #include "shell/word.h"
 
@@ -21,18 +22,91 @@
  */
 #define TASK_STATUS_INTERRUPTED -4
 
+struct command_output;
 struct mrsh_context;
 
-/* Perform parameter expansion, command substitution and arithmetic expansion. */
-int run_word(struct mrsh_context *ctx, struct mrsh_word **word_ptr);
+enum tilde_expansion {
+	TILDE_EXPANSION_NONE,
+	// Only at the beginning of the word
+	TILDE_EXPANSION_NAME,
+	// At the beginning of the word and after each unquoted colon
+	TILDE_EXPANSION_ASSIGNMENT,
+};
+
+/* Perform tilde expansion, parameter expansion, command substitution and
+ * arithmetic expansion. `word` is left untouched, the expanded word is stored
+ * in `result` and must be destroyed by the caller. */
+int run_word(struct mrsh_context *ctx, const struct mrsh_word *word,
+	struct mrsh_word **result, enum tilde_expansion tilde);
 /* Perform all word expansions, as specified in section 2.6. Fills `fields`
  * with `char *` elements. Not suitable for assignments. */
 int expand_word(struct mrsh_context *ctx, const struct mrsh_word *word,
 	struct mrsh_array *fields);
+/* Run the program of a command substitution and append its output to `buf`.
+ * Builtins and functions are run in the shell process when the shell state can
+ * be restored afterwards, otherwise a subshell is forked. */
+int run_command_substitution(struct mrsh_context *ctx,
+	struct mrsh_program *prog, struct mrsh_buffer *buf);
+/* Start a command substitution, without waiting for its output. If it has
+ * been run in the shell process, its whole output is appended to `buf` and
+ * `out` is set to NULL. Otherwise, the output of the subshell needs to be read
+ * with command_output_read, then command_output_finish must be called. */
+int command_output_start(struct mrsh_context *ctx, struct mrsh_program *prog,
+	struct mrsh_buffer *buf, struct command_output **out);
+/* Append the next chunk of output to `buf`. Returns 1 if some output has been
+ * read, 0 at the end of the output, or TASK_STATUS_ERROR. */
+int command_output_read(struct command_output *out, struct mrsh_buffer *buf);
+/* Wait for the subshell and return its status. The output left unread is
+ * discarded. */
+int command_output_finish(struct command_output *out);
+
+/* The fields a for loop iterates over. If the last word of the list is a
+ * command substitution run in a subshell, its output is split into fields as
+ * it arrives, so the loop can start before the command has finished. Leaving
+ * the loop early closes the pipe, and the command gets SIGPIPE.
+ *
+ * The loop body runs while the command is still running. IFS and the noglob
+ * option are taken when the loop starts, so changing them in the body doesn't
+ * affect the remaining fields. Other side effects of the body aren't isolated:
+ * the command may see them, e.g. if the body writes to a file the command
+ * reads. Other shells run the command to completion first.
+ *
+ * A zero-initialized struct is an empty list. */
+struct for_fields {
+	struct mrsh_array fields; // char *
+	size_t next;
+	struct command_output *output; // NULL once the whole output has been read
+	struct mrsh_buffer buf; // output not split yet
+	struct ifs_table ifs; // IFS when the word list was expanded
+	bool noglob;
+};
+
+int for_fields_init(struct mrsh_context *ctx, struct for_fields *ff,
+	const struct mrsh_array *words);
+/* Get the next field. Returns 1 and sets `field`, 0 if there are no fields
+ * left, or a negative TASK_STATUS_* value. `field` is valid until the next
+ * call. */
+int for_fields_next(struct for_fields *ff, const char **field);
+void for_fields_finish(struct for_fields *ff);
 int run_simple_command(struct mrsh_context *ctx, struct mrsh_simple_command *sc);
+/* Assign a value to a variable, as done by a simple command without a command
+ * name. */
+int run_assignment(struct mrsh_context *ctx, const char *name,
+	const char *value);
+/* Same as run_assignment, keeping the value as an integer until it's needed
+ * as a string. */
+int run_number_assignment(struct mrsh_context *ctx, const char *name,
+	long value);
+/* Expand a pattern of a case clause and match it against `str`. Returns 1 if
+ * it matches, 0 if it doesn't, or a negative TASK_STATUS_* value. */
+int match_case_pattern(struct mrsh_context *ctx,
+	const struct mrsh_word *pattern, const char *str);
 int run_command(struct mrsh_context *ctx, struct mrsh_command *cmd);
 int run_and_or_list(struct mrsh_context *ctx, struct mrsh_and_or_list *and_or_list);
 int run_pipeline(struct mrsh_context *ctx, struct mrsh_pipeline *pipeline);
+/* Run an and-or list terminated by `&` in a background child process. */
+int run_async_command_list(struct mrsh_context *ctx,
+	struct mrsh_command_list *list);
 int run_command_list_array(struct mrsh_context *ctx, struct mrsh_array *array);
 
 #endif
@@ -19,6 +19,10 @@ bool set_trap(struct mrsh_state *state, int sig, enum mrsh_trap_action action,
 	struct mrsh_program *program);
 bool set_job_control_traps(struct mrsh_state *state, bool enabled);
 bool reset_caught_traps(struct mrsh_state *state);
+/**
+ * Returns true if at least one trap is set to a command.
+ */
+bool has_caught_traps(struct mrsh_state *state);
 bool run_pending_traps(struct mrsh_state *state);
 bool run_exit_trap(struct mrsh_state *state);
 
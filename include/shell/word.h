@@ -2,18 +2,51 @@
 #define SHELL_WORD_H
 
 #include <mrsh/shell.h>
+#include <stdint.h>
+#include "shell/glob.h"
+
+enum ifs_char_class {
+	IFS_NONE, // not in IFS
+	IFS_SPACE, // IFS white space: space, tab or newline
+	IFS_OTHER,
+	IFS_END, // the NUL character, terminating strings
+};
+
+/**
+ * The characters of a value of IFS, classified for field splitting.
+ */
+struct ifs_table {
+	char *value; // NULL if IFS is unset
+	uint8_t classes[256]; // enum ifs_char_class
+	bool only_space; // IFS contains only white space
+};
 
 /**
  * Performs tilde expansion. It leaves the word as-is in case of error.
  */
 void expand_tilde(struct mrsh_state *state, struct mrsh_word **word_ptr,
 	bool assignment);
+/**
+ * Performs tilde expansion on a string which is part of an unquoted word.
+ * `first` and `last` indicate whether the string begins or ends the word.
+ * Returns a new word, or NULL if there is nothing to expand.
+ */
+struct mrsh_word *expand_tilde_string(struct mrsh_state *state,
+	const struct mrsh_word_string *ws, bool assignment, bool first,
+	bool last);
+void ifs_table_init(struct ifs_table *table, const char *ifs);
+void ifs_table_finish(struct ifs_table *table);
+/**
+ * Returns the table for the current value of IFS. It's built again only when
+ * IFS changes, and is valid until then.
+ */
+const struct ifs_table *get_ifs_table(struct mrsh_state *state);
 /**
  * Performs field splitting on `word`, writing fields to `fields`. This should
  * be done after expansions/substitutions.
  */
 void split_fields(struct mrsh_array *fields, const struct mrsh_word *word,
-	const char *ifs);
+	const struct ifs_table *ifs);
 void get_fields_str(struct mrsh_array *strs, const struct mrsh_array *fields);
 /**
  * Convert a word to a pattern. Returns NULL if word doesn't contain any
@@ -21,10 +54,11 @@ void get_fields_str(struct mrsh_array *strs, const struct mrsh_array *fields);
  */
 char *word_to_pattern(const struct mrsh_word *word);
 /**
- * Performs pathname expansion on each item in `fields`.
+ * Performs pathname expansion on each item in `fields`. Directory listings are
+ * read from `cache` if it isn't NULL.
  */
 bool expand_pathnames(struct mrsh_array *expanded,
-	const struct mrsh_array *fields);
+	const struct mrsh_array *fields, struct glob_cache *cache);
 
 
 #endif
@@ -31,6 +31,7 @@ int main(int argc, char *argv[]) {
 
 	struct mrsh_buffer parser_buffer = {0};
 	struct mrsh_parser *parser;
+	struct mrsh_script_cache *cache = NULL;
 	int fd = -1;
 	if (state->interactive) {
 		interactive_init(state);
@@ -47,11 +48,16 @@ int main(int argc, char *argv[]) {
 						init_args.command_file, strerror(errno));
 					return 1;
 				}
+				// The script is parsed as it runs, and may be modified by
+				// its own commands: read it instead of mapping it
+				parser = mrsh_parser_with_fd(fd);
+				cache = mrsh_script_cache_load(state,
+					init_args.command_file, fd);
 			} else {
+				// Commands may read the rest of standard input
 				fd = STDIN_FILENO;
+				parser = mrsh_parser_with_fd(fd);
 			}
-
-			parser = mrsh_parser_with_fd(fd);
 		}
 	}
 	mrsh_state_set_parser_alias_func(state, parser);
@@ -99,7 +105,12 @@ int main(int argc, char *argv[]) {
 			mrsh_parser_reset(parser);
 		}
 
-		struct mrsh_program *prog = mrsh_parse_line(parser);
+		struct mrsh_program *prog;
+		if (cache != NULL) {
+			prog = mrsh_script_cache_parse_line(cache, parser);
+		} else {
+			prog = mrsh_parse_line(parser);
+		}
 		if (state->interactive && mrsh_parser_continuation_line(parser)) {
 			// Nothing to see here
 		} else if (prog == NULL) {
@@ -145,6 +156,7 @@ int main(int argc, char *argv[]) {
 	mrsh_run_exit_trap(state);
 
 	mrsh_buffer_finish(&read_buffer);
+	mrsh_script_cache_destroy(cache);
 	mrsh_parser_destroy(parser);
 	mrsh_buffer_finish(&parser_buffer);
 	mrsh_state_destroy(state);
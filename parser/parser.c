@@ -7,6 +7,8 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include "ast.h"
 #include "parser.h"
@@ -66,6 +68,38 @@ struct mrsh_parser *mrsh_parser_with_fd(int fd) {
 	return parser;
 }
 
+struct mrsh_parser *mrsh_parser_with_file(int fd) {
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+		return mrsh_parser_with_fd(fd);
+	}
+
+	// The parser needs a NUL byte after the data. It's written in the partial
+	// page at the end of the mapping, so the file size mustn't be a multiple
+	// of the page size. Pages are read lazily: truncating the file while it's
+	// being parsed raises SIGBUS.
+	size_t size = st.st_size;
+	long page_size = sysconf(_SC_PAGESIZE);
+	if (page_size <= 0 || size % page_size == 0) {
+		return mrsh_parser_with_fd(fd);
+	}
+
+	// Alias substitution may write to the buffer, the mapping is private
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		return mrsh_parser_with_fd(fd);
+	}
+	// The page may hold data written after fstat if the file has grown
+	((char *)data)[size] = '\0';
+
+	struct mrsh_parser *parser = parser_create();
+	parser->buf.data = data;
+	parser->buf.len = parser->buf.cap = size + 1;
+	parser->map_size = size;
+	parser->eof = true;
+	return parser;
+}
+
 struct mrsh_parser *mrsh_parser_with_data(const char *buf, size_t len) {
 	struct mrsh_parser *parser = parser_create();
 	mrsh_buffer_append(&parser->buf, buf, len);
@@ -83,7 +117,12 @@ void mrsh_parser_destroy(struct mrsh_parser *parser) {
 	if (parser == NULL) {
 		return;
 	}
-	mrsh_buffer_finish(&parser->buf);
+	if (parser->map_size > 0) {
+		munmap(parser->buf.data - parser->buf_offset, parser->map_size);
+	} else {
+		parser_compact(parser);
+		mrsh_buffer_finish(&parser->buf);
+	}
 	mrsh_array_finish(&parser->here_documents);
 	free(parser->error.msg);
 	free(parser);
@@ -134,9 +173,30 @@ static ssize_t parser_peek_buffer(struct mrsh_parser *parser, size_t size) {
 	return n_read;
 }
 
+void parser_compact(struct mrsh_parser *parser) {
+	if (parser->map_size > 0) {
+		// The mapping can't be grown, switch to a copy of the unconsumed data
+		struct mrsh_buffer buf = {0};
+		mrsh_buffer_append(&buf, parser->buf.data, parser->buf.len);
+		munmap(parser->buf.data - parser->buf_offset, parser->map_size);
+		parser->buf = buf;
+		parser->buf_offset = parser->map_size = 0;
+		return;
+	}
+	if (parser->buf_offset == 0) {
+		return;
+	}
+	char *start = parser->buf.data - parser->buf_offset;
+	memmove(start, parser->buf.data, parser->buf.len);
+	parser->buf.data = start;
+	parser->buf.cap += parser->buf_offset;
+	parser->buf_offset = 0;
+}
+
 size_t parser_peek(struct mrsh_parser *parser, char *buf, size_t size) {
 	if (size > parser->buf.len) {
 		size_t n_more = size - parser->buf.len;
+		parser_compact(parser);
 
 		ssize_t n_read;
 		if (parser->fd >= 0) {
@@ -176,18 +236,25 @@ char parser_peek_char(struct mrsh_parser *parser) {
 size_t parser_read(struct mrsh_parser *parser, char *buf, size_t size) {
 	size_t n = parser_peek(parser, buf, size);
 	if (n > 0) {
-		for (size_t i = 0; i < n; ++i) {
-			assert(parser->buf.data[i] != '\0');
-			++parser->pos.offset;
-			if (parser->buf.data[i] == '\n') {
-				++parser->pos.line;
-				parser->pos.column = 1;
-			} else {
-				++parser->pos.column;
-			}
+		const char *data = parser->buf.data;
+		assert(memchr(data, '\0', n) == NULL);
+		parser->pos.offset += n;
+		const char *line = data;
+		const char *newline;
+		while ((newline = memchr(line, '\n', n - (line - data))) != NULL) {
+			++parser->pos.line;
+			line = newline + 1;
 		}
-		memmove(parser->buf.data, parser->buf.data + n, parser->buf.len - n);
+		if (line != data) {
+			parser->pos.column = 1;
+		}
+		parser->pos.column += n - (line - data);
+
+		// Data is moved back only when the buffer needs to be refilled
+		parser->buf.data += n;
 		parser->buf.len -= n;
+		parser->buf.cap -= n;
+		parser->buf_offset += n;
 
 		parser->continuation_line = false;
 	}
@@ -364,6 +431,7 @@ bool mrsh_parser_continuation_line(struct mrsh_parser *parser) {
 }
 
 void mrsh_parser_reset(struct mrsh_parser *parser) {
+	parser_compact(parser);
 	parser->buf.len = 0;
 	parser->has_sym = false;
 	parser->pos = (struct mrsh_position){0};
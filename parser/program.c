@@ -102,6 +102,7 @@ static void apply_aliases(struct mrsh_parser *parser) {
 		size_t trailing_len = parser->buf.len - alias_len;
 		size_t repl_len = strlen(repl);
 		if (repl_len > alias_len) {
+			parser_compact(parser);
 			mrsh_buffer_reserve(&parser->buf, repl_len - alias_len);
 		}
 		memmove(&parser->buf.data[repl_len], &parser->buf.data[alias_len],
@@ -213,14 +214,14 @@ static struct mrsh_io_redirect *io_redirect(struct mrsh_parser *parser) {
 	redir.op_range.begin = parser->pos;
 	if (io_file(parser, &redir)) {
 		struct mrsh_io_redirect *redir_ptr =
-			calloc(1, sizeof(struct mrsh_io_redirect));
+			ast_calloc(parser->arena, sizeof(struct mrsh_io_redirect));
 		memcpy(redir_ptr, &redir, sizeof(struct mrsh_io_redirect));
 		redir.op_range.end = parser->pos;
 		return redir_ptr;
 	}
 	if (io_here(parser, &redir)) {
 		struct mrsh_io_redirect *redir_ptr =
-			calloc(1, sizeof(struct mrsh_io_redirect));
+			ast_calloc(parser->arena, sizeof(struct mrsh_io_redirect));
 		memcpy(redir_ptr, &redir, sizeof(struct mrsh_io_redirect));
 		redir.op_range.end = parser->pos;
 		mrsh_array_add(&parser->here_documents, redir_ptr);
@@ -256,10 +257,12 @@ static struct mrsh_assignment *assignment_word(struct mrsh_parser *parser) {
 
 	struct mrsh_word *value = word(parser, 0);
 	if (value == NULL) {
-		value = &mrsh_word_string_create(strdup(""), false)->word;
+		char *empty = ast_strdup(parser->arena, "");
+		value = &ast_word_string_create(parser->arena, empty, false)->word;
 	}
 
-	struct mrsh_assignment *assign = calloc(1, sizeof(struct mrsh_assignment));
+	struct mrsh_assignment *assign =
+		ast_calloc(parser->arena, sizeof(struct mrsh_assignment));
 	assign->name = name;
 	assign->value = value;
 	assign->name_range = name_range;
@@ -271,13 +274,13 @@ static bool cmd_prefix(struct mrsh_parser *parser,
 		struct mrsh_simple_command *cmd) {
 	struct mrsh_io_redirect *redir = io_redirect(parser);
 	if (redir != NULL) {
-		mrsh_array_add(&cmd->io_redirects, redir);
+		ast_array_add(parser->arena, &cmd->io_redirects, redir);
 		return true;
 	}
 
 	struct mrsh_assignment *assign = assignment_word(parser);
 	if (assign != NULL) {
-		mrsh_array_add(&cmd->assignments, assign);
+		ast_array_add(parser->arena, &cmd->assignments, assign);
 		return true;
 	}
 
@@ -303,8 +306,10 @@ static struct mrsh_word *cmd_name(struct mrsh_parser *parser) {
 	struct mrsh_range range;
 	char *str = read_token(parser, word_len, &range);
 
-	struct mrsh_word_string *ws = mrsh_word_string_create(str, false);
+	struct mrsh_word_string *ws =
+		ast_word_string_create(parser->arena, str, false);
 	ws->range = range;
+	ws->word.literal = is_literal_string(str);
 	return &ws->word;
 }
 
@@ -312,13 +317,13 @@ static bool cmd_suffix(struct mrsh_parser *parser,
 		struct mrsh_simple_command *cmd) {
 	struct mrsh_io_redirect *redir = io_redirect(parser);
 	if (redir != NULL) {
-		mrsh_array_add(&cmd->io_redirects, redir);
+		ast_array_add(parser->arena, &cmd->io_redirects, redir);
 		return true;
 	}
 
 	struct mrsh_word *arg = word(parser, 0);
 	if (arg != NULL) {
-		mrsh_array_add(&cmd->arguments, arg);
+		ast_array_add(parser->arena, &cmd->arguments, arg);
 		return true;
 	}
 
@@ -342,7 +347,7 @@ static struct mrsh_simple_command *simple_command(struct mrsh_parser *parser) {
 		}
 	}
 
-	return mrsh_simple_command_create(cmd.name, &cmd.arguments,
+	return ast_simple_command_create(parser->arena, cmd.name, &cmd.arguments,
 		&cmd.io_redirects, &cmd.assignments);
 }
 
@@ -371,7 +376,7 @@ static struct mrsh_command_list *term(struct mrsh_parser *parser) {
 		return NULL;
 	}
 
-	struct mrsh_command_list *cmd = mrsh_command_list_create();
+	struct mrsh_command_list *cmd = ast_command_list_create(parser->arena);
 	cmd->and_or_list = and_or_list;
 
 	struct mrsh_position separator_pos = parser->pos;
@@ -408,14 +413,14 @@ static bool compound_list(struct mrsh_parser *parser, struct mrsh_array *cmds) {
 	if (l == NULL) {
 		return false;
 	}
-	mrsh_array_add(cmds, l);
+	ast_array_add(parser->arena, cmds, l);
 
 	while (true) {
 		l = term(parser);
 		if (l == NULL) {
 			break;
 		}
-		mrsh_array_add(cmds, l);
+		ast_array_add(parser->arena, cmds, l);
 	}
 
 	return true;
@@ -444,11 +449,10 @@ static struct mrsh_brace_group *brace_group(struct mrsh_parser *parser) {
 
 	struct mrsh_position rbrace_pos = parser->pos;
 	if (!expect_token(parser, "}", NULL)) {
-		command_list_array_finish(&body);
 		return NULL;
 	}
 
-	struct mrsh_brace_group *bg = mrsh_brace_group_create(&body);
+	struct mrsh_brace_group *bg = ast_brace_group_create(parser->arena, &body);
 	bg->lbrace_pos = lbrace_pos;
 	bg->rbrace_pos = rbrace_pos;
 	return bg;
@@ -467,11 +471,10 @@ static struct mrsh_subshell *subshell(struct mrsh_parser *parser) {
 
 	struct mrsh_position rparen_pos = parser->pos;
 	if (!expect_token(parser, ")", NULL)) {
-		command_list_array_finish(&body);
 		return NULL;
 	}
 
-	struct mrsh_subshell *s = mrsh_subshell_create(&body);
+	struct mrsh_subshell *s = ast_subshell_create(parser->arena, &body);
 	s->lparen_pos = lparen_pos;
 	s->rparen_pos = rparen_pos;
 	return s;
@@ -487,19 +490,18 @@ static struct mrsh_command *else_part(struct mrsh_parser *parser) {
 
 		struct mrsh_range then_range;
 		if (!expect_token(parser, "then", &then_range)) {
-			command_list_array_finish(&cond);
 			return NULL;
 		}
 
 		struct mrsh_array body = {0};
 		if (!expect_compound_list(parser, &body)) {
-			command_list_array_finish(&cond);
 			return NULL;
 		}
 
 		struct mrsh_command *ep = else_part(parser);
 
-		struct mrsh_if_clause *ic = mrsh_if_clause_create(&cond, &body, ep);
+		struct mrsh_if_clause *ic =
+			ast_if_clause_create(parser->arena, &cond, &body, ep);
 		ic->if_range = if_range;
 		ic->then_range = then_range;
 		return &ic->command;
@@ -512,7 +514,8 @@ static struct mrsh_command *else_part(struct mrsh_parser *parser) {
 		}
 
 		// TODO: position information is missing
-		struct mrsh_brace_group *bg = mrsh_brace_group_create(&body);
+		struct mrsh_brace_group *bg =
+			ast_brace_group_create(parser->arena, &body);
 		return &bg->command;
 	}
 
@@ -527,39 +530,32 @@ static struct mrsh_if_clause *if_clause(struct mrsh_parser *parser) {
 
 	struct mrsh_array cond = {0};
 	if (!expect_compound_list(parser, &cond)) {
-		goto error_cond;
+		return NULL;
 	}
 
 	struct mrsh_range then_range;
 	if (!expect_token(parser, "then", &then_range)) {
-		goto error_cond;
+		return NULL;
 	}
 
 	struct mrsh_array body = {0};
 	if (!expect_compound_list(parser, &body)) {
-		goto error_body;
+		return NULL;
 	}
 
 	struct mrsh_command *ep = else_part(parser);
 
 	struct mrsh_range fi_range;
 	if (!expect_token(parser, "fi", &fi_range)) {
-		goto error_else_part;
+		return NULL;
 	}
 
-	struct mrsh_if_clause *ic = mrsh_if_clause_create(&cond, &body, ep);
+	struct mrsh_if_clause *ic =
+		ast_if_clause_create(parser->arena, &cond, &body, ep);
 	ic->if_range = if_range;
 	ic->then_range = then_range;
 	ic->fi_range = fi_range;
 	return ic;
-
-error_else_part:
-	mrsh_command_destroy(ep);
-error_body:
-	command_list_array_finish(&body);
-error_cond:
-	command_list_array_finish(&cond);
-	return NULL;
 }
 
 static bool sequential_sep(struct mrsh_parser *parser) {
@@ -577,7 +573,7 @@ static void wordlist(struct mrsh_parser *parser,
 		if (w == NULL) {
 			break;
 		}
-		mrsh_array_add(words, w);
+		ast_array_add(parser->arena, words, w);
 	}
 }
 
@@ -595,7 +591,6 @@ static bool expect_do_group(struct mrsh_parser *parser,
 
 	if (!token(parser, "done", done_range)) {
 		parser_set_error(parser, "expected 'done'");
-		command_list_array_finish(body);
 		return false;
 	}
 
@@ -629,7 +624,7 @@ static struct mrsh_for_clause *for_clause(struct mrsh_parser *parser) {
 
 		if (!sequential_sep(parser)) {
 			parser_set_error(parser, "expected sequential separator");
-			goto error_words;
+			return NULL;
 		}
 	} else {
 		sequential_sep(parser);
@@ -638,26 +633,17 @@ static struct mrsh_for_clause *for_clause(struct mrsh_parser *parser) {
 	struct mrsh_array body = {0};
 	struct mrsh_range do_range, done_range;
 	if (!expect_do_group(parser, &body, &do_range, &done_range)) {
-		goto error_words;
+		return NULL;
 	}
 
 	struct mrsh_for_clause *fc =
-		mrsh_for_clause_create(name, in, &words, &body);
+		ast_for_clause_create(parser->arena, name, in, &words, &body);
 	fc->for_range = for_range;
 	fc->name_range = name_range;
 	fc->in_range = in_range;
 	fc->do_range = do_range;
 	fc->done_range = done_range;
 	return fc;
-
-error_words:
-	for (size_t i = 0; i < words.len; ++i) {
-		struct mrsh_word *word = words.data[i];
-		mrsh_word_destroy(word);
-	}
-	mrsh_array_finish(&words);
-	free(name);
-	return NULL;
 }
 
 static struct mrsh_loop_clause *loop_clause(struct mrsh_parser *parser) {
@@ -679,12 +665,11 @@ static struct mrsh_loop_clause *loop_clause(struct mrsh_parser *parser) {
 	struct mrsh_array body = {0};
 	struct mrsh_range do_range, done_range;
 	if (!expect_do_group(parser, &body, &do_range, &done_range)) {
-		command_list_array_finish(&condition);
 		return NULL;
 	}
 
 	struct mrsh_loop_clause *fc =
-		mrsh_loop_clause_create(type, &condition, &body);
+		ast_loop_clause_create(parser->arena, type, &condition, &body);
 	fc->while_until_range = while_until_range;
 	fc->do_range = do_range;
 	fc->done_range = done_range;
@@ -705,7 +690,7 @@ static struct mrsh_case_item *expect_case_item(struct mrsh_parser *parser,
 	}
 
 	struct mrsh_array patterns = {0};
-	mrsh_array_add(&patterns, w);
+	ast_array_add(parser->arena, &patterns, w);
 
 	while (token(parser, "|", NULL)) {
 		struct mrsh_word *w = word(parser, 0);
@@ -713,19 +698,19 @@ static struct mrsh_case_item *expect_case_item(struct mrsh_parser *parser,
 			parser_set_error(parser, "expected a word");
 			return NULL;
 		}
-		mrsh_array_add(&patterns, w);
+		ast_array_add(parser->arena, &patterns, w);
 	}
 
 	struct mrsh_position rparen_pos = parser->pos;
 	if (!expect_token(parser, ")", NULL)) {
-		goto error_patterns;
+		return NULL;
 	}
 
 	// It's okay if there's no body
 	struct mrsh_array body = {0};
 	compound_list(parser, &body);
 	if (mrsh_parser_error(parser, NULL)) {
-		goto error_patterns;
+		return NULL;
 	}
 
 	struct mrsh_range dsemi_range = {0};
@@ -734,9 +719,10 @@ static struct mrsh_case_item *expect_case_item(struct mrsh_parser *parser,
 		linebreak(parser);
 	}
 
-	struct mrsh_case_item *item = calloc(1, sizeof(struct mrsh_case_item));
+	struct mrsh_case_item *item =
+		ast_calloc(parser->arena, sizeof(struct mrsh_case_item));
 	if (item == NULL) {
-		goto error_body;
+		return NULL;
 	}
 	item->patterns = patterns;
 	item->body = body;
@@ -744,16 +730,6 @@ static struct mrsh_case_item *expect_case_item(struct mrsh_parser *parser,
 	item->rparen_pos = rparen_pos;
 	item->dsemi_range = dsemi_range;
 	return item;
-
-error_body:
-	command_list_array_finish(&body);
-error_patterns:
-	for (size_t i = 0; i < patterns.len; ++i) {
-		struct mrsh_word *w = patterns.data[i];
-		mrsh_word_destroy(w);
-	}
-	mrsh_array_finish(&patterns);
-	return NULL;
 }
 
 static struct mrsh_case_clause *case_clause(struct mrsh_parser *parser) {
@@ -772,7 +748,7 @@ static struct mrsh_case_clause *case_clause(struct mrsh_parser *parser) {
 
 	struct mrsh_range in_range;
 	if (!expect_token(parser, "in", &in_range)) {
-		goto error_word;
+		return NULL;
 	}
 
 	linebreak(parser);
@@ -783,34 +759,25 @@ static struct mrsh_case_clause *case_clause(struct mrsh_parser *parser) {
 	while (!token(parser, "esac", &esac_range)) {
 		struct mrsh_case_item *item = expect_case_item(parser, &dsemi);
 		if (item == NULL) {
-			goto error_items;
+			return NULL;
 		}
-		mrsh_array_add(&items, item);
+		ast_array_add(parser->arena, &items, item);
 
 		if (!dsemi) {
 			// Only the last case can omit `;;`
 			if (!expect_token(parser, "esac", &esac_range)) {
-				goto error_items;
+				return NULL;
 			}
 			break;
 		}
 	}
 
-	struct mrsh_case_clause *cc = mrsh_case_clause_create(w, &items);
+	struct mrsh_case_clause *cc =
+		ast_case_clause_create(parser->arena, w, &items);
 	cc->case_range = case_range;
 	cc->in_range = in_range;
 	cc->esac_range = esac_range;
 	return cc;
-
-error_items:
-	for (size_t i = 0; i < items.len; ++i) {
-		struct mrsh_case_item *item = items.data[i];
-		case_item_destroy(item);
-	}
-	mrsh_array_finish(&items);
-error_word:
-	mrsh_word_destroy(w);
-	return NULL;
 }
 
 static struct mrsh_command *compound_command(struct mrsh_parser *parser);
@@ -863,11 +830,11 @@ static struct mrsh_function_definition *function_definition(
 		if (redir == NULL) {
 			break;
 		}
-		mrsh_array_add(&io_redirects, redir);
+		ast_array_add(parser->arena, &io_redirects, redir);
 	}
 
 	struct mrsh_function_definition *fd =
-		mrsh_function_definition_create(name, cmd, &io_redirects);
+		ast_function_definition_create(parser->arena, name, cmd, &io_redirects);
 	fd->name_range = name_range;
 	fd->lparen_pos = lparen_pos;
 	fd->rparen_pos = rparen_pos;
@@ -1000,28 +967,22 @@ static struct mrsh_pipeline *pipeline(struct mrsh_parser *parser) {
 	}
 
 	struct mrsh_array commands = {0};
-	mrsh_array_add(&commands, cmd);
+	ast_array_add(parser->arena, &commands, cmd);
 
 	while (token(parser, "|", NULL)) {
 		linebreak(parser);
 		struct mrsh_command *cmd = command(parser);
 		if (cmd == NULL) {
 			parser_set_error(parser, "expected a command");
-			goto error_commands;
+			return NULL;
 		}
-		mrsh_array_add(&commands, cmd);
+		ast_array_add(parser->arena, &commands, cmd);
 	}
 
-	struct mrsh_pipeline *p = mrsh_pipeline_create(&commands, bang);
+	struct mrsh_pipeline *p =
+		ast_pipeline_create(parser->arena, &commands, bang);
 	p->bang_pos = bang_pos;
 	return p;
-
-error_commands:
-	for (size_t i = 0; i < commands.len; ++i) {
-		mrsh_command_destroy((struct mrsh_command *)commands.data[i]);
-	}
-	mrsh_array_finish(&commands);
-	return NULL;
 }
 
 static struct mrsh_and_or_list *and_or(struct mrsh_parser *parser) {
@@ -1043,12 +1004,13 @@ static struct mrsh_and_or_list *and_or(struct mrsh_parser *parser) {
 	linebreak(parser);
 	struct mrsh_and_or_list *and_or_list = and_or(parser);
 	if (and_or_list == NULL) {
-		mrsh_and_or_list_destroy(&pl->and_or_list);
 		parser_set_error(parser, "expected an AND-OR list");
 		return NULL;
 	}
 
-	struct mrsh_binop *binop = mrsh_binop_create(binop_type, &pl->and_or_list, and_or_list);
+	struct mrsh_binop *binop =
+		ast_binop_create(parser->arena, binop_type, &pl->and_or_list,
+			and_or_list);
 	binop->op_range = op_range;
 	return &binop->and_or_list;
 }
@@ -1059,7 +1021,7 @@ static struct mrsh_command_list *list(struct mrsh_parser *parser) {
 		return NULL;
 	}
 
-	struct mrsh_command_list *cmd = mrsh_command_list_create();
+	struct mrsh_command_list *cmd = ast_command_list_create(parser->arena);
 	cmd->and_or_list = and_or_list;
 
 	struct mrsh_position separator_pos = parser->pos;
@@ -1078,17 +1040,18 @@ static struct mrsh_command_list *list(struct mrsh_parser *parser) {
  * Append a new string word to `children` with the contents of `buf`, and reset
  * `buf`.
  */
-static void push_buffer_word_string(struct mrsh_array *children,
-		struct mrsh_buffer *buf) {
+static void push_buffer_word_string(struct mrsh_parser *parser,
+		struct mrsh_array *children, struct mrsh_buffer *buf) {
 	if (buf->len == 0) {
 		return;
 	}
 
 	mrsh_buffer_append_char(buf, '\0');
 
-	char *data = mrsh_buffer_steal(buf);
-	struct mrsh_word_string *ws = mrsh_word_string_create(data, false);
-	mrsh_array_add(children, &ws->word);
+	char *data = ast_buffer_steal(parser->arena, buf);
+	struct mrsh_word_string *ws =
+		ast_word_string_create(parser->arena, data, false);
+	ast_array_add(parser->arena, children, &ws->word);
 }
 
 static struct mrsh_word *here_document_line(struct mrsh_parser *parser) {
@@ -1102,19 +1065,19 @@ static struct mrsh_word *here_document_line(struct mrsh_parser *parser) {
 		}
 
 		if (c == '$') {
-			push_buffer_word_string(&children, &buf);
+			push_buffer_word_string(parser, &children, &buf);
 			struct mrsh_word *t = expect_dollar(parser);
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 
 		if (c == '`') {
-			push_buffer_word_string(&children, &buf);
+			push_buffer_word_string(parser, &children, &buf);
 			struct mrsh_word *t = back_quotes(parser);
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 
@@ -1137,15 +1100,17 @@ static struct mrsh_word *here_document_line(struct mrsh_parser *parser) {
 		mrsh_buffer_append_char(&buf, c);
 	}
 
-	push_buffer_word_string(&children, &buf);
+	push_buffer_word_string(parser, &children, &buf);
 	mrsh_buffer_finish(&buf);
 
 	if (children.len == 1) {
 		struct mrsh_word *word = children.data[0];
-		mrsh_array_finish(&children); // TODO: don't allocate this array
+		// TODO: don't allocate this array
+		ast_array_finish(parser->arena, &children);
 		return word;
 	} else {
-		struct mrsh_word_list *wl = mrsh_word_list_create(&children, false);
+		struct mrsh_word_list *wl =
+			ast_word_list_create(parser->arena, &children, false);
 		return &wl->word;
 	}
 }
@@ -1215,15 +1180,16 @@ static bool expect_here_document(struct mrsh_parser *parser,
 		if (expand_lines) {
 			struct mrsh_parser *subparser =
 				mrsh_parser_with_data(line, strlen(line));
+			subparser->arena = parser->arena;
 			word = here_document_line(subparser);
 			mrsh_parser_destroy(subparser);
 		} else {
-			struct mrsh_word_string *ws =
-				mrsh_word_string_create(strdup(line), true);
+			struct mrsh_word_string *ws = ast_word_string_create(parser->arena,
+				ast_strdup(parser->arena, line), true);
 			word = &ws->word;
 		}
 
-		mrsh_array_add(&redir->here_document, word);
+		ast_array_add(parser->arena, &redir->here_document, word);
 	}
 	mrsh_buffer_finish(&buf);
 
@@ -1231,32 +1197,40 @@ static bool expect_here_document(struct mrsh_parser *parser,
 	return true;
 }
 
+/**
+ * Parses a complete command and the here-documents following it. Sets
+ * `newline_read` if the newline ending the command has been consumed.
+ */
 static bool complete_command(struct mrsh_parser *parser,
-		struct mrsh_array *cmds) {
+		struct mrsh_array *cmds, bool *newline_read) {
+	*newline_read = false;
+
 	struct mrsh_command_list *l = list(parser);
 	if (l == NULL) {
 		return false;
 	}
-	mrsh_array_add(cmds, l);
+	ast_array_add(parser->arena, cmds, l);
 
 	while (true) {
 		l = list(parser);
 		if (l == NULL) {
 			break;
 		}
-		mrsh_array_add(cmds, l);
+		ast_array_add(parser->arena, cmds, l);
 	}
 
 	if (parser->here_documents.len > 0) {
+		// Here-documents start on the line following the command
+		if (!newline(parser)) {
+			parser_set_error(parser,
+				"expected a newline followed by a here-document");
+			return false;
+		}
+		*newline_read = true;
+
 		for (size_t i = 0; i < parser->here_documents.len; ++i) {
 			struct mrsh_io_redirect *redir = parser->here_documents.data[i];
 
-			if (!newline(parser)) {
-				parser_set_error(parser,
-					"expected a newline followed by a here-document");
-				return false;
-			}
-
 			char *delim = mrsh_word_str(redir->name);
 			bool ok = expect_here_document(parser, redir, delim);
 			free(delim);
@@ -1272,8 +1246,8 @@ static bool complete_command(struct mrsh_parser *parser,
 }
 
 static bool expect_complete_command(struct mrsh_parser *parser,
-		struct mrsh_array *cmds) {
-	if (!complete_command(parser, cmds)) {
+		struct mrsh_array *cmds, bool *newline_read) {
+	if (!complete_command(parser, cmds, newline_read)) {
 		parser_set_error(parser, "expected a complete command");
 		return false;
 	}
@@ -1282,7 +1256,7 @@ static bool expect_complete_command(struct mrsh_parser *parser,
 }
 
 static struct mrsh_program *program(struct mrsh_parser *parser) {
-	struct mrsh_program *prog = mrsh_program_create();
+	struct mrsh_program *prog = ast_program_create(parser->arena);
 	if (prog == NULL) {
 		return NULL;
 	}
@@ -1292,17 +1266,17 @@ static struct mrsh_program *program(struct mrsh_parser *parser) {
 		return prog;
 	}
 
-	if (!expect_complete_command(parser, &prog->body)) {
-		mrsh_program_destroy(prog);
+	bool newline_read;
+	if (!expect_complete_command(parser, &prog->body, &newline_read)) {
 		return NULL;
 	}
 
-	while (newline_list(parser)) {
+	while (newline_list(parser) || newline_read) {
 		if (eof(parser)) {
 			return prog;
 		}
 
-		if (!complete_command(parser, &prog->body)) {
+		if (!complete_command(parser, &prog->body, &newline_read)) {
 			break;
 		}
 	}
@@ -1311,14 +1285,14 @@ static struct mrsh_program *program(struct mrsh_parser *parser) {
 	return prog;
 }
 
-struct mrsh_program *mrsh_parse_line(struct mrsh_parser *parser) {
+static struct mrsh_program *line(struct mrsh_parser *parser) {
 	parser_begin(parser);
 
 	if (eof(parser)) {
 		return NULL;
 	}
 
-	struct mrsh_program *prog = mrsh_program_create();
+	struct mrsh_program *prog = ast_program_create(parser->arena);
 	if (prog == NULL) {
 		return NULL;
 	}
@@ -1327,10 +1301,11 @@ struct mrsh_program *mrsh_parse_line(struct mrsh_parser *parser) {
 		return prog;
 	}
 
-	if (!expect_complete_command(parser, &prog->body)) {
+	bool newline_read;
+	if (!expect_complete_command(parser, &prog->body, &newline_read)) {
 		goto error;
 	}
-	if (!eof(parser) && !newline(parser)) {
+	if (!newline_read && !eof(parser) && !newline(parser)) {
 		parser_set_error(parser, "expected a newline");
 		goto error;
 	}
@@ -1338,8 +1313,6 @@ struct mrsh_program *mrsh_parse_line(struct mrsh_parser *parser) {
 	return prog;
 
 error:
-	mrsh_program_destroy(prog);
-
 	// Consume the whole line
 	while (true) {
 		char c = parser_peek_char(parser);
@@ -1358,7 +1331,40 @@ error:
 	return NULL;
 }
 
-struct mrsh_program *mrsh_parse_program(struct mrsh_parser *parser) {
+static struct mrsh_program *whole_program(struct mrsh_parser *parser) {
 	parser_begin(parser);
 	return program(parser);
 }
+
+/**
+ * Parses a program whose nodes are allocated in its own arena. Programs nested
+ * in the program being parsed, e.g. in command substitutions, share its arena.
+ */
+static struct mrsh_program *parse_in_arena(struct mrsh_parser *parser,
+		struct mrsh_program *(*parse)(struct mrsh_parser *parser)) {
+	if (parser->arena != NULL) {
+		return parse(parser);
+	}
+
+	struct mrsh_arena *arena = arena_create();
+	if (arena == NULL) {
+		return NULL;
+	}
+	parser->arena = arena;
+	struct mrsh_program *prog = parse(parser);
+	parser->arena = NULL;
+	if (prog != NULL) {
+		prog->arena = arena;
+	} else {
+		arena_destroy(arena);
+	}
+	return prog;
+}
+
+struct mrsh_program *mrsh_parse_line(struct mrsh_parser *parser) {
+	return parse_in_arena(parser, line);
+}
+
+struct mrsh_program *mrsh_parse_program(struct mrsh_parser *parser) {
+	return parse_in_arena(parser, whole_program);
+}
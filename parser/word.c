@@ -40,8 +40,9 @@ static struct mrsh_word *single_quotes(struct mrsh_parser *parser) {
 	}
 
 	mrsh_buffer_append_char(&buf, '\0');
-	char *data = mrsh_buffer_steal(&buf);
-	struct mrsh_word_string *ws = mrsh_word_string_create(data, true);
+	char *data = ast_buffer_steal(parser->arena, &buf);
+	struct mrsh_word_string *ws =
+		ast_word_string_create(parser->arena, data, true);
 	ws->range.begin = begin;
 	ws->range.end = parser->pos;
 	return &ws->word;
@@ -159,7 +160,7 @@ char *read_token(struct mrsh_parser *parser, size_t len,
 
 	struct mrsh_position begin = parser->pos;
 
-	char *tok = malloc(len + 1);
+	char *tok = ast_alloc(parser->arena, len + 1);
 	parser_read(parser, tok, len);
 	tok[len] = '\0';
 
@@ -185,7 +186,7 @@ static struct mrsh_word *word_list(struct mrsh_parser *parser, char end,
 		if (child == NULL) {
 			break;
 		}
-		mrsh_array_add(&children, child);
+		ast_array_add(parser->arena, &children, child);
 
 		struct mrsh_position begin = parser->pos;
 		struct mrsh_buffer buf = {0};
@@ -200,11 +201,11 @@ static struct mrsh_word *word_list(struct mrsh_parser *parser, char end,
 			break; // word() ended on a non-blank char, stop here
 		}
 		mrsh_buffer_append_char(&buf, '\0');
-		struct mrsh_word_string *ws =
-			mrsh_word_string_create(mrsh_buffer_steal(&buf), false);
+		struct mrsh_word_string *ws = ast_word_string_create(parser->arena,
+			ast_buffer_steal(parser->arena, &buf), false);
 		ws->range.begin = begin;
 		ws->range.end = parser->pos;
-		mrsh_array_add(&children, &ws->word);
+		ast_array_add(parser->arena, &children, &ws->word);
 		mrsh_buffer_finish(&buf);
 	}
 
@@ -212,10 +213,11 @@ static struct mrsh_word *word_list(struct mrsh_parser *parser, char end,
 		return NULL;
 	} else if (children.len == 1) {
 		struct mrsh_word *child = children.data[0];
-		mrsh_array_finish(&children);
+		ast_array_finish(parser->arena, &children);
 		return child;
 	} else {
-		struct mrsh_word_list *wl = mrsh_word_list_create(&children, false);
+		struct mrsh_word_list *wl =
+			ast_word_list_create(parser->arena, &children, false);
 		return &wl->word;
 	}
 }
@@ -322,7 +324,7 @@ static struct mrsh_word_parameter *expect_parameter_expression(
 	}
 
 	struct mrsh_word_parameter *wp =
-		mrsh_word_parameter_create(name, op, colon, arg);
+		ast_word_parameter_create(parser->arena, name, op, colon, arg);
 	wp->name_range = name_range;
 	wp->op_range = op_range;
 	wp->lbrace_pos = lbrace_pos;
@@ -345,7 +347,6 @@ static struct mrsh_word_command *expect_word_command(
 	struct mrsh_program *prog = mrsh_parse_program(parser);
 	parser->alias = alias;
 	if (mrsh_parser_error(parser, NULL) != NULL) {
-		mrsh_program_destroy(prog);
 		return NULL;
 	} else if (prog == NULL) {
 		parser_set_error(parser, "expected a program");
@@ -353,11 +354,10 @@ static struct mrsh_word_command *expect_word_command(
 	}
 
 	if (!expect_token(parser, ")", NULL)) {
-		mrsh_program_destroy(prog);
 		return NULL;
 	}
 
-	return mrsh_word_command_create(prog, false);
+	return ast_word_command_create(parser->arena, prog, false);
 }
 
 static struct mrsh_word_arithmetic *expect_word_arithmetic(
@@ -377,15 +377,13 @@ static struct mrsh_word_arithmetic *expect_word_arithmetic(
 	}
 
 	if (!expect_token(parser, ")", NULL)) {
-		mrsh_word_destroy(body);
 		return NULL;
 	}
 	if (!expect_token(parser, ")", NULL)) {
-		mrsh_word_destroy(body);
 		return NULL;
 	}
 
-	return mrsh_word_arithmetic_create(body);
+	return ast_word_arithmetic_create(parser->arena, body);
 }
 
 // Expect parameter expansion or command substitution
@@ -457,7 +455,8 @@ struct mrsh_word *expect_dollar(struct mrsh_parser *parser) {
 			return NULL;
 		}
 
-		wp = mrsh_word_parameter_create(name, MRSH_PARAM_NONE, false, NULL);
+		wp = ast_word_parameter_create(parser->arena, name, MRSH_PARAM_NONE,
+			false, NULL);
 		wp->dollar_pos = dollar_pos;
 		wp->name_range = name_range;
 		return &wp->word;
@@ -509,19 +508,21 @@ struct mrsh_word *back_quotes(struct mrsh_parser *parser) {
 	if (subparser == NULL) {
 		goto error;
 	}
+	// The nested program shares the arena of the enclosing one
+	subparser->arena = parser->arena;
 	struct mrsh_program *prog = mrsh_parse_program(subparser);
 	const char *err_msg = mrsh_parser_error(subparser, NULL);
 	if (err_msg != NULL) {
 		// TODO: how should we handle subparser error position?
 		parser_set_error(parser, err_msg);
-		mrsh_program_destroy(prog);
 		goto error;
 	}
 	mrsh_parser_destroy(subparser);
 
 	mrsh_buffer_finish(&buf);
 
-	struct mrsh_word_command *wc = mrsh_word_command_create(prog, true);
+	struct mrsh_word_command *wc =
+		ast_word_command_create(parser->arena, prog, true);
 	wc->range.begin = begin;
 	wc->range.end = parser->pos;
 	return &wc->word;
@@ -546,11 +547,12 @@ static void push_buffer_word_string(struct mrsh_parser *parser,
 
 	mrsh_buffer_append_char(buf, '\0');
 
-	char *data = mrsh_buffer_steal(buf);
-	struct mrsh_word_string *ws = mrsh_word_string_create(data, false);
+	char *data = ast_buffer_steal(parser->arena, buf);
+	struct mrsh_word_string *ws =
+		ast_word_string_create(parser->arena, data, false);
 	ws->range.begin = *child_begin;
 	ws->range.end = parser->pos;
-	mrsh_array_add(children, &ws->word);
+	ast_array_add(parser->arena, children, &ws->word);
 
 	*child_begin = (struct mrsh_position){0};
 }
@@ -588,7 +590,7 @@ static struct mrsh_word *double_quotes(struct mrsh_parser *parser) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 
@@ -598,7 +600,7 @@ static struct mrsh_word *double_quotes(struct mrsh_parser *parser) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 
@@ -629,12 +631,50 @@ static struct mrsh_word *double_quotes(struct mrsh_parser *parser) {
 
 	mrsh_buffer_finish(&buf);
 
-	struct mrsh_word_list *wl = mrsh_word_list_create(&children, true);
+	struct mrsh_word_list *wl =
+		ast_word_list_create(parser->arena, &children, true);
 	wl->lquote_pos = lquote_pos;
 	wl->rquote_pos = rquote_pos;
 	return &wl->word;
 }
 
+static bool is_string_list(const struct mrsh_word *word) {
+	const struct mrsh_word_list *wl = mrsh_word_get_list(word);
+	for (size_t i = 0; i < wl->children.len; ++i) {
+		const struct mrsh_word *child = wl->children.data[i];
+		if (child->type != MRSH_WORD_STRING) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool word_has_char(const struct mrsh_word *word, char c) {
+	switch (word->type) {
+	case MRSH_WORD_STRING:;
+		const struct mrsh_word_string *ws = mrsh_word_get_string(word);
+		return strchr(ws->str, c) != NULL;
+	case MRSH_WORD_LIST:;
+		const struct mrsh_word_list *wl = mrsh_word_get_list(word);
+		for (size_t i = 0; i < wl->children.len; ++i) {
+			if (word_has_char(wl->children.data[i], c)) {
+				return true;
+			}
+		}
+		return false;
+	default:
+		return false;
+	}
+}
+
+bool is_literal_string(const char *str) {
+	if (str[0] == '~' || strpbrk(str, "*?") != NULL) {
+		return false;
+	}
+	const char *bracket = strchr(str, '[');
+	return bracket == NULL || strchr(bracket, ']') == NULL;
+}
+
 struct mrsh_word *word(struct mrsh_parser *parser, char end) {
 	if (!symbol(parser, TOKEN)) {
 		return NULL;
@@ -649,6 +689,8 @@ struct mrsh_word *word(struct mrsh_parser *parser, char end) {
 	struct mrsh_array children = {0};
 	struct mrsh_buffer buf = {0};
 	struct mrsh_position child_begin = {0};
+	// The word is literal until an expansion or a pattern character is found
+	bool literal = true, bracket = false;
 
 	while (true) {
 		if (!mrsh_position_valid(&child_begin)) {
@@ -666,7 +708,8 @@ struct mrsh_word *word(struct mrsh_parser *parser, char end) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
+			literal = false;
 			continue;
 		}
 
@@ -676,7 +719,8 @@ struct mrsh_word *word(struct mrsh_parser *parser, char end) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
+			literal = false;
 			continue;
 		}
 
@@ -687,7 +731,7 @@ struct mrsh_word *word(struct mrsh_parser *parser, char end) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 		if (c == '"') {
@@ -696,7 +740,8 @@ struct mrsh_word *word(struct mrsh_parser *parser, char end) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
+			literal = literal && is_string_list(t);
 			continue;
 		}
 
@@ -711,6 +756,13 @@ struct mrsh_word *word(struct mrsh_parser *parser, char end) {
 			}
 		} else if (is_operator_start(c) || isblank(c)) {
 			break;
+		} else if (c == '*' || c == '?') {
+			literal = false;
+		} else if (c == '[') {
+			bracket = true;
+		} else if (c == '~' && children.len == 0 && buf.len == 0) {
+			// Subject to tilde expansion
+			literal = false;
 		}
 
 		parser_read_char(parser);
@@ -722,14 +774,22 @@ struct mrsh_word *word(struct mrsh_parser *parser, char end) {
 
 	consume_symbol(parser);
 
+	// An empty unquoted word, e.g. a lone continuation line, expands to nothing
+	literal = literal && children.len > 0;
+
+	struct mrsh_word *word;
 	if (children.len == 1) {
-		struct mrsh_word *word = children.data[0];
-		mrsh_array_finish(&children); // TODO: don't allocate this array
-		return word;
+		word = children.data[0];
+		// TODO: don't allocate this array
+		ast_array_finish(parser->arena, &children);
 	} else {
-		struct mrsh_word_list *wl = mrsh_word_list_create(&children, false);
-		return &wl->word;
+		struct mrsh_word_list *wl =
+			ast_word_list_create(parser->arena, &children, false);
+		word = &wl->word;
 	}
+	// A bracket only starts a pattern if it's closed, e.g. `[` alone isn't
+	word->literal = literal && (!bracket || !word_has_char(word, ']'));
+	return word;
 }
 
 /* TODO remove end parameter when no *_word function takes it */
@@ -769,7 +829,7 @@ struct mrsh_word *arithmetic_word(struct mrsh_parser *parser, char end) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 
@@ -779,7 +839,7 @@ struct mrsh_word *arithmetic_word(struct mrsh_parser *parser, char end) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 
@@ -790,7 +850,7 @@ struct mrsh_word *arithmetic_word(struct mrsh_parser *parser, char end) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 		if (c == '"') {
@@ -799,7 +859,7 @@ struct mrsh_word *arithmetic_word(struct mrsh_parser *parser, char end) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 
@@ -840,10 +900,12 @@ struct mrsh_word *arithmetic_word(struct mrsh_parser *parser, char end) {
 
 	if (children.len == 1) {
 		struct mrsh_word *word = children.data[0];
-		mrsh_array_finish(&children); // TODO: don't allocate this array
+		// TODO: don't allocate this array
+		ast_array_finish(parser->arena, &children);
 		return word;
 	} else {
-		struct mrsh_word_list *wl = mrsh_word_list_create(&children, false);
+		struct mrsh_word_list *wl =
+			ast_word_list_create(parser->arena, &children, false);
 		return &wl->word;
 	}
 }
@@ -872,7 +934,7 @@ struct mrsh_word *parameter_expansion_word(struct mrsh_parser *parser) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 
@@ -882,7 +944,7 @@ struct mrsh_word *parameter_expansion_word(struct mrsh_parser *parser) {
 			if (t == NULL) {
 				return NULL;
 			}
-			mrsh_array_add(&children, t);
+			ast_array_add(parser->arena, &children, t);
 			continue;
 		}
 
@@ -908,10 +970,12 @@ struct mrsh_word *parameter_expansion_word(struct mrsh_parser *parser) {
 
 	if (children.len == 1) {
 		struct mrsh_word *word = children.data[0];
-		mrsh_array_finish(&children); // TODO: don't allocate this array
+		// TODO: don't allocate this array
+		ast_array_finish(parser->arena, &children);
 		return word;
 	} else {
-		struct mrsh_word_list *wl = mrsh_word_list_create(&children, false);
+		struct mrsh_word_list *wl =
+			ast_word_list_create(parser->arena, &children, false);
 		return &wl->word;
 	}
 }
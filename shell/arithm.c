@@ -1,9 +1,14 @@
 #include <assert.h>
 #include <mrsh/shell.h>
 #include <stdlib.h>
+#include "shell/shell.h"
 
 static bool run_variable(struct mrsh_state *state, const char *name, long *val,
 		uint32_t *attribs) {
+	if (env_get_number(state, name, val, attribs)) {
+		return true;
+	}
+
 	const char *str = mrsh_env_get(state, name, attribs);
 	if (str == NULL) {
 		if ((state->options & MRSH_OPT_NOUNSET)) {
@@ -13,13 +18,9 @@ static bool run_variable(struct mrsh_state *state, const char *name, long *val,
 		}
 		*val = 0; // POSIX is not clear what to do in this case
 	} else {
-		char *end;
-		*val = strtod(str, &end);
-		if (end == str || end[0] != '\0') {
-			fprintf(stderr, "%s: %s: not a number: %s\n",
-					state->frame->argv[0], name, str);
-			return false;
-		}
+		fprintf(stderr, "%s: %s: not a number: %s\n",
+				state->frame->argv[0], name, str);
+		return false;
 	}
 	return true;
 }
@@ -208,9 +209,7 @@ static bool run_arithm_assign(struct mrsh_state *state,
 		return false;
 	}
 
-	char buf[32];
-	snprintf(buf, sizeof(buf), "%ld", *result);
-	mrsh_env_set(state, assign->name, buf, attribs);
+	env_set_number(state, assign->name, *result, attribs);
 
 	return true;
 }
@@ -0,0 +1,420 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <mrsh/ast.h>
+#include <mrsh/buffer.h>
+#include <mrsh/entry.h>
+#include <mrsh/parser.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "parser.h"
+#include "shell/cache.h"
+#include "shell/shell.h"
+
+#define CACHE_MAGIC "mrsh-ast"
+// Must be bumped each time the AST or its encoding changes
+#define CACHE_VERSION 2
+// Minimum age in seconds of a source file's mtime for the file to be cached
+#define CACHE_MIN_AGE 2
+
+enum cache_kind {
+	CACHE_PROGRAM, // parsed with mrsh_parse_program
+	CACHE_LINES, // parsed with mrsh_parse_line
+};
+
+/**
+ * Cache files start with this header, followed by the path of the source file
+ * and by each cached program preceded by its end offset in the source file.
+ * Cache files are only meant to be read on the machine which wrote them, so
+ * the header uses the native byte order.
+ */
+struct cache_header {
+	char magic[8];
+	uint32_t version, kind;
+	uint64_t dev, ino, size;
+	int64_t mtime_sec, mtime_nsec;
+	uint64_t path_len, programs_len;
+	uint64_t checksum; // of the data following the header
+};
+
+struct cached_program {
+	struct mrsh_program *prog; // NULL once returned to the caller
+	size_t end; // offset of the end of the program in the source file
+};
+
+struct mrsh_script_cache {
+	struct mrsh_state *state;
+	struct mrsh_array lines; // struct cached_program *
+	size_t next; // index of the next line to be returned
+	bool parsing; // true once the parser has taken over
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len) {
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+#define FNV1A_INIT 0xcbf29ce484222325
+
+static void cached_programs_finish(struct mrsh_array *programs) {
+	for (size_t i = 0; i < programs->len; ++i) {
+		struct cached_program *cp = programs->data[i];
+		mrsh_program_destroy(cp->prog);
+		free(cp);
+	}
+	mrsh_array_finish(programs);
+	*programs = (struct mrsh_array){0};
+}
+
+static bool cached_programs_add(struct mrsh_array *programs,
+		struct mrsh_program *prog, size_t end) {
+	struct cached_program *cp = calloc(1, sizeof(struct cached_program));
+	if (cp == NULL) {
+		mrsh_program_destroy(prog);
+		return false;
+	}
+	cp->prog = prog;
+	cp->end = end;
+	if (mrsh_array_add(programs, cp) < 0) {
+		mrsh_program_destroy(prog);
+		free(cp);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Returns the path of the cache file for a source file, or NULL if the cache
+ * is disabled. The caller must free the returned value.
+ */
+static char *cache_file_path(struct mrsh_state *state, const char *path,
+		const struct stat *st, enum cache_kind kind) {
+	const char *dir = mrsh_env_get(state, "MRSH_CACHE_DIR", NULL);
+	if (dir == NULL || dir[0] == '\0') {
+		return NULL;
+	}
+
+	uint64_t ids[] = { st->st_dev, st->st_ino, kind };
+	uint64_t hash = fnv1a(FNV1A_INIT, path, strlen(path));
+	hash = fnv1a(hash, ids, sizeof(ids));
+
+	size_t len = strlen(dir) + 1 + 16 + strlen(".ast") + 1;
+	char *file_path = malloc(len);
+	if (file_path == NULL) {
+		return NULL;
+	}
+	snprintf(file_path, len, "%s/%016" PRIx64 ".ast", dir, hash);
+	return file_path;
+}
+
+static void init_header(struct cache_header *header, const char *path,
+		const struct stat *st, enum cache_kind kind) {
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, CACHE_MAGIC, sizeof(header->magic));
+	header->version = CACHE_VERSION;
+	header->kind = kind;
+	header->dev = st->st_dev;
+	header->ino = st->st_ino;
+	header->size = st->st_size;
+	header->mtime_sec = st->st_mtim.tv_sec;
+	header->mtime_nsec = st->st_mtim.tv_nsec;
+	header->path_len = strlen(path);
+}
+
+/**
+ * Loads the programs cached for a source file. Returns false if there is no
+ * valid cache file, e.g. because the source file has been modified since the
+ * cache file was written.
+ */
+static bool cache_load(const char *cache_path, const char *path,
+		const struct stat *st, enum cache_kind kind,
+		struct mrsh_array *programs) {
+	int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat cache_st;
+	if (fstat(fd, &cache_st) != 0 || !S_ISREG(cache_st.st_mode) ||
+			cache_st.st_uid != geteuid() ||
+			(size_t)cache_st.st_size < sizeof(struct cache_header)) {
+		close(fd);
+		return false;
+	}
+
+	size_t size = cache_st.st_size;
+	char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+
+	struct cache_header expected, header;
+	init_header(&expected, path, st, kind);
+	memcpy(&header, data, sizeof(header));
+	const char *pos = data + sizeof(header);
+	const char *end = data + size;
+	uint64_t checksum = header.checksum;
+	header.programs_len = header.checksum = 0;
+	// The checksum catches truncated or otherwise corrupted files, which
+	// could decode to trees the parser never produces
+	bool ok = memcmp(&header, &expected, sizeof(header)) == 0 &&
+		header.path_len <= (size_t)(end - pos) &&
+		memcmp(pos, path, header.path_len) == 0 &&
+		fnv1a(FNV1A_INIT, pos, end - pos) == checksum;
+	if (ok) {
+		memcpy(&header, data, sizeof(header));
+		pos += header.path_len;
+	}
+
+	for (uint64_t i = 0; ok && i < header.programs_len; ++i) {
+		uint64_t prog_end;
+		if ((size_t)(end - pos) < sizeof(prog_end)) {
+			ok = false;
+			break;
+		}
+		memcpy(&prog_end, pos, sizeof(prog_end));
+		pos += sizeof(prog_end);
+
+		struct mrsh_program *prog = mrsh_program_deserialize(&pos, end);
+		ok = prog != NULL && cached_programs_add(programs, prog, prog_end);
+	}
+	ok = ok && pos == end;
+
+	munmap(data, size);
+	if (!ok) {
+		cached_programs_finish(programs);
+	}
+	return ok;
+}
+
+/**
+ * Writes programs to a cache file. The file is replaced atomically, so that
+ * concurrent shells never read partially written cache files. Recently
+ * modified source files aren't cached.
+ */
+static void cache_store(const char *cache_path, const char *path,
+		const struct stat *st, enum cache_kind kind,
+		const struct mrsh_array *programs) {
+	// Timestamps have a limited granularity, so a file rewritten right after
+	// being cached could keep its mtime. Once a file has been left untouched
+	// for a while, any change updates its mtime.
+	struct timespec now;
+	if (clock_gettime(CLOCK_REALTIME, &now) != 0 ||
+			now.tv_sec - st->st_mtim.tv_sec < CACHE_MIN_AGE) {
+		return;
+	}
+
+	struct cache_header header;
+	init_header(&header, path, st, kind);
+	header.programs_len = programs->len;
+
+	struct mrsh_buffer buf = {0};
+	mrsh_buffer_append(&buf, (const char *)&header, sizeof(header));
+	mrsh_buffer_append(&buf, path, header.path_len);
+	for (size_t i = 0; i < programs->len; ++i) {
+		const struct cached_program *cp = programs->data[i];
+		uint64_t prog_end = cp->end;
+		mrsh_buffer_append(&buf, (const char *)&prog_end, sizeof(prog_end));
+		mrsh_program_serialize(&buf, cp->prog);
+	}
+	header.checksum = fnv1a(FNV1A_INIT, &buf.data[sizeof(header)],
+		buf.len - sizeof(header));
+	memcpy(buf.data, &header, sizeof(header));
+
+	const char *dir_end = strrchr(cache_path, '/');
+	char *dir = strndup(cache_path, dir_end - cache_path);
+	if (dir != NULL && mkdir(dir, 0700) != 0 && errno != EEXIST) {
+		goto out;
+	}
+
+	size_t tmp_path_len = strlen(cache_path) + strlen(".XXXXXX") + 1;
+	char *tmp_path = malloc(tmp_path_len);
+	if (tmp_path == NULL) {
+		goto out;
+	}
+	snprintf(tmp_path, tmp_path_len, "%s.XXXXXX", cache_path);
+	int fd = mkstemp(tmp_path);
+	if (fd < 0) {
+		free(tmp_path);
+		goto out;
+	}
+
+	bool ok = true;
+	size_t written = 0;
+	while (ok && written < buf.len) {
+		ssize_t n = write(fd, &buf.data[written], buf.len - written);
+		if (n < 0 && errno != EINTR) {
+			ok = false;
+		} else if (n > 0) {
+			written += n;
+		}
+	}
+	if (close(fd) != 0 || !ok || rename(tmp_path, cache_path) != 0) {
+		unlink(tmp_path);
+	}
+	free(tmp_path);
+
+out:
+	free(dir);
+	mrsh_buffer_finish(&buf);
+}
+
+struct mrsh_program *cache_parse_program(struct mrsh_state *state,
+		const char *path, int fd, struct mrsh_parser *parser) {
+	struct stat st;
+	char *cache_path = NULL;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		cache_path = cache_file_path(state, path, &st, CACHE_PROGRAM);
+	}
+	if (cache_path == NULL) {
+		return mrsh_parse_program(parser);
+	}
+
+	struct mrsh_array programs = {0};
+	struct mrsh_program *prog = NULL;
+	if (cache_load(cache_path, path, &st, CACHE_PROGRAM, &programs)) {
+		if (programs.len == 1) {
+			struct cached_program *cp = programs.data[0];
+			prog = cp->prog;
+			cp->prog = NULL;
+		}
+		cached_programs_finish(&programs);
+		if (prog != NULL) {
+			free(cache_path);
+			return prog;
+		}
+	}
+
+	prog = mrsh_parse_program(parser);
+	if (prog != NULL && mrsh_parser_error(parser, NULL) == NULL) {
+		struct cached_program cp = { .prog = prog, .end = parser->pos.offset };
+		void *programs_data[] = { &cp };
+		programs.data = programs_data;
+		programs.len = programs.cap = 1;
+		cache_store(cache_path, path, &st, CACHE_PROGRAM, &programs);
+	}
+	free(cache_path);
+	return prog;
+}
+
+/**
+ * Parses all lines of a script file upfront, without aliases. Returns false if
+ * the script contains a syntax error.
+ */
+static bool parse_lines(int fd, const struct stat *st,
+		struct mrsh_array *lines) {
+	// The file offset must be left untouched for the main parser
+	struct mrsh_buffer buf = {0};
+	char *data = mrsh_buffer_add(&buf, st->st_size);
+	if (data == NULL) {
+		return false;
+	}
+	size_t len = 0;
+	while (len < buf.len) {
+		ssize_t n = pread(fd, &data[len], buf.len - len, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			break;
+		}
+		len += n;
+	}
+	if (len != buf.len) {
+		mrsh_buffer_finish(&buf);
+		return false;
+	}
+
+	struct mrsh_parser *parser = mrsh_parser_with_data(buf.data, buf.len);
+	mrsh_buffer_finish(&buf);
+	bool ok = true;
+	while (ok) {
+		struct mrsh_program *prog = mrsh_parse_line(parser);
+		if (prog == NULL) {
+			ok = mrsh_parser_error(parser, NULL) == NULL &&
+				mrsh_parser_eof(parser);
+			break;
+		}
+		ok = cached_programs_add(lines, prog, parser->pos.offset);
+	}
+	mrsh_parser_destroy(parser);
+	if (!ok) {
+		cached_programs_finish(lines);
+	}
+	return ok;
+}
+
+struct mrsh_script_cache *mrsh_script_cache_load(struct mrsh_state *state,
+		const char *path, int fd) {
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		return NULL;
+	}
+	char *cache_path = cache_file_path(state, path, &st, CACHE_LINES);
+	if (cache_path == NULL) {
+		return NULL;
+	}
+
+	struct mrsh_script_cache *cache =
+		calloc(1, sizeof(struct mrsh_script_cache));
+	if (cache == NULL) {
+		free(cache_path);
+		return NULL;
+	}
+	cache->state = state;
+
+	if (!cache_load(cache_path, path, &st, CACHE_LINES, &cache->lines)) {
+		if (!parse_lines(fd, &st, &cache->lines)) {
+			free(cache_path);
+			free(cache);
+			return NULL;
+		}
+		cache_store(cache_path, path, &st, CACHE_LINES, &cache->lines);
+	}
+
+	free(cache_path);
+	return cache;
+}
+
+struct mrsh_program *mrsh_script_cache_parse_line(
+		struct mrsh_script_cache *cache, struct mrsh_parser *parser) {
+	struct mrsh_state_priv *priv = state_get_priv(cache->state);
+
+	// Lines have been parsed without aliases
+	if (!cache->parsing && priv->aliases.len == 0 &&
+			cache->next < cache->lines.len) {
+		struct cached_program *cp = cache->lines.data[cache->next++];
+		struct mrsh_program *prog = cp->prog;
+		cp->prog = NULL;
+		return prog;
+	}
+
+	if (!cache->parsing) {
+		// Skip the lines which have already been returned
+		cache->parsing = true;
+		if (cache->next > 0) {
+			struct cached_program *cp = cache->lines.data[cache->next - 1];
+			parser_read(parser, NULL, cp->end - parser->pos.offset);
+		}
+	}
+	return mrsh_parse_line(parser);
+}
+
+void mrsh_script_cache_destroy(struct mrsh_script_cache *cache) {
+	if (cache == NULL) {
+		return;
+	}
+	cached_programs_finish(&cache->lines);
+	free(cache);
+}
@@ -7,6 +7,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include "arena.h"
 #include "builtin.h"
 #include "parser.h"
 #include "shell/path.h"
@@ -17,7 +18,18 @@ static char *expand_str(struct mrsh_state *state, const char *src) {
 	if (parser == NULL) {
 		return NULL;
 	}
+	struct mrsh_arena *arena = arena_create();
+	if (arena == NULL) {
+		mrsh_parser_destroy(parser);
+		return NULL;
+	}
+	parser->arena = arena;
 	struct mrsh_word *word = parameter_expansion_word(parser);
+	if (word != NULL) {
+		// mrsh_run_word replaces the word, so it can't live in the arena
+		word = mrsh_word_copy(word);
+	}
+	arena_destroy(arena);
 	if (word == NULL) {
 		struct mrsh_position err_pos;
 		const char *err_msg = mrsh_parser_error(parser, &err_pos);
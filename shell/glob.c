@@ -0,0 +1,247 @@
+#define _POSIX_C_SOURCE 200809L
+#include <dirent.h>
+#include <mrsh/buffer.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "shell/glob.h"
+#include "shell/pattern.h"
+
+struct glob_dir {
+	struct mrsh_array names; // unsorted, as read from the directory
+};
+
+/**
+ * A part of the pattern between slashes. Literal components are unescaped and
+ * appended to the path as-is, without reading the directory.
+ */
+struct glob_component {
+	char *str;
+	struct pattern *pat; // NULL for literal components
+	bool explicit_dot; // the pattern begins with a period
+};
+
+struct glob_data {
+	struct glob_cache *cache;
+	struct glob_component *components;
+	size_t len;
+	struct mrsh_buffer path; // always NUL-terminated
+	struct mrsh_array *matches;
+};
+
+static void glob_dir_destroy(struct glob_dir *dir) {
+	for (size_t i = 0; i < dir->names.len; ++i) {
+		free(dir->names.data[i]);
+	}
+	mrsh_array_finish(&dir->names);
+	free(dir);
+}
+
+static void glob_cache_iterator(const char *key, void *value,
+		void *user_data) {
+	glob_dir_destroy(value);
+}
+
+void glob_cache_finish(struct glob_cache *cache) {
+	mrsh_hashtable_for_each(&cache->dirs, glob_cache_iterator, NULL);
+	mrsh_hashtable_finish(&cache->dirs);
+}
+
+static const struct glob_dir *read_dir(struct glob_cache *cache,
+		const char *path) {
+	struct glob_dir *dir = mrsh_hashtable_get(&cache->dirs, path);
+	if (dir != NULL) {
+		return dir;
+	}
+
+	dir = calloc(1, sizeof(struct glob_dir));
+	if (dir == NULL) {
+		return NULL;
+	}
+
+	// Directories which can't be read, or files which aren't directories,
+	// don't have any entry
+	DIR *d = opendir(path[0] == '\0' ? "." : path);
+	if (d != NULL) {
+		struct dirent *entry;
+		while ((entry = readdir(d)) != NULL) {
+			char *name = strdup(entry->d_name);
+			if (name == NULL || mrsh_array_add(&dir->names, name) < 0) {
+				free(name);
+				closedir(d);
+				glob_dir_destroy(dir);
+				return NULL;
+			}
+		}
+		closedir(d);
+	}
+
+	mrsh_hashtable_set(&cache->dirs, path, dir);
+	return dir;
+}
+
+static bool is_glob_metachar(char c) {
+	return c == '*' || c == '?' || c == '[';
+}
+
+static bool component_init(struct glob_component *comp, const char *str,
+		size_t len) {
+	comp->explicit_dot = str[0] == '.' ||
+		(len >= 2 && str[0] == '\\' && str[1] == '.');
+
+	bool literal = true;
+	for (size_t i = 0; i < len; ++i) {
+		if (str[i] == '\\') {
+			// A trailing backslash never matches: leave it to the pattern
+			if (++i == len) {
+				literal = false;
+			}
+		} else if (is_glob_metachar(str[i])) {
+			literal = false;
+		}
+	}
+
+	comp->str = strndup(str, len);
+	if (comp->str == NULL) {
+		return false;
+	}
+	if (!literal) {
+		comp->pat = pattern_compile(comp->str);
+		return comp->pat != NULL;
+	}
+
+	size_t j = 0;
+	for (size_t i = 0; i < len; ++i) {
+		if (str[i] == '\\') {
+			++i;
+		}
+		comp->str[j++] = str[i];
+	}
+	comp->str[j] = '\0';
+	return true;
+}
+
+static bool path_append(struct mrsh_buffer *path, const char *str,
+		bool slash) {
+	size_t len = strlen(str);
+	char *dst = mrsh_buffer_reserve(path, len + 2);
+	if (dst == NULL) {
+		return false;
+	}
+	memcpy(dst, str, len);
+	if (slash) {
+		dst[len++] = '/';
+	}
+	dst[len] = '\0';
+	path->len += len;
+	return true;
+}
+
+/**
+ * Matches the components starting at `i` against the directory the path
+ * points to. `exists` is set if the path is known to exist, because it was
+ * read from a directory.
+ */
+static bool glob_at(struct glob_data *data, size_t i, bool exists) {
+	struct mrsh_buffer *path = &data->path;
+	size_t path_len = path->len;
+
+	bool ok = true;
+	for (; i < data->len && data->components[i].pat == NULL; ++i) {
+		ok = path_append(path, data->components[i].str, i + 1 < data->len);
+		if (!ok) {
+			goto out;
+		}
+		exists = false;
+	}
+
+	struct stat st;
+	if (i == data->len) {
+		if (exists || lstat(path->data, &st) == 0) {
+			char *match = strdup(path->data);
+			ok = match != NULL && mrsh_array_add(data->matches, match) >= 0;
+			if (!ok) {
+				free(match);
+			}
+		}
+		goto out;
+	}
+
+	const struct glob_component *comp = &data->components[i];
+	const struct glob_dir *dir = read_dir(data->cache, path->data);
+	if (dir == NULL) {
+		ok = false;
+		goto out;
+	}
+
+	size_t dir_len = path->len;
+	for (size_t j = 0; ok && j < dir->names.len; ++j) {
+		const char *name = dir->names.data[j];
+		if ((name[0] == '.' && !comp->explicit_dot) ||
+				!pattern_match(comp->pat, name)) {
+			continue;
+		}
+		ok = path_append(path, name, i + 1 < data->len) &&
+			glob_at(data, i + 1, true);
+		path->len = dir_len;
+		path->data[dir_len] = '\0';
+	}
+
+out:
+	path->len = path_len;
+	path->data[path_len] = '\0';
+	return ok;
+}
+
+static int compare_paths(const void *a, const void *b) {
+	return strcoll(*(const char **)a, *(const char **)b);
+}
+
+bool glob_expand(struct glob_cache *cache, const char *pattern,
+		struct mrsh_array *matches) {
+	struct glob_data data = {
+		.cache = cache,
+		.matches = matches,
+	};
+
+	size_t ncomponents = 1;
+	for (const char *p = pattern; *p != '\0'; ++p) {
+		ncomponents += *p == '/';
+	}
+	data.components = calloc(ncomponents, sizeof(struct glob_component));
+	bool ok = data.components != NULL && path_append(&data.path, "", false);
+
+	const char *begin = pattern;
+	while (ok) {
+		const char *end = begin;
+		while (*end != '\0' && *end != '/') {
+			if (end[0] == '\\' && end[1] != '\0' && end[1] != '/') {
+				++end;
+			}
+			++end;
+		}
+		ok = component_init(&data.components[data.len++], begin,
+			end - begin);
+		if (*end == '\0') {
+			break;
+		}
+		begin = end + 1;
+	}
+
+	size_t first = matches->len;
+	if (ok) {
+		ok = glob_at(&data, 0, false);
+	}
+	if (matches->len > first) {
+		qsort(&matches->data[first], matches->len - first, sizeof(void *),
+			compare_paths);
+	}
+
+	for (size_t i = 0; i < data.len; ++i) {
+		free(data.components[i].str);
+		pattern_destroy(data.components[i].pat);
+	}
+	free(data.components);
+	mrsh_buffer_finish(&data.path);
+	return ok;
+}
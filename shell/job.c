@@ -126,6 +126,7 @@ void job_add_process(struct mrsh_job *job, struct mrsh_process *proc) {
 		perror("setpgid");
 		return;
 	}
+	proc->job = job;
 	mrsh_array_add(&job->processes, proc);
 }
 
@@ -217,50 +218,39 @@ int job_poll(struct mrsh_job *job) {
 
 static void update_job(struct mrsh_state *state, pid_t pid, int stat);
 
-static bool _job_wait(struct mrsh_state *state, pid_t pid, int options) {
+int reap_children(struct mrsh_state *state, bool block) {
 	struct mrsh_state_priv *priv = state_get_priv(state);
 
-	assert(pid > 0 && pid != getpid());
-
 	// We only want to be notified about stopped processes in the main
 	// shell. Child processes want to block until their own children have
 	// terminated.
-	if (!priv->child) {
-		options |= WUNTRACED;
-	}
+	int options = priv->child ? 0 : WUNTRACED;
 
+	int reaped = 0;
 	while (true) {
-		// Here it's important to wait for a specific process: we don't want to
-		// steal one of our grandchildren's status for one of our children.
+		// Collect whichever child is done first, then everything else which
+		// is already available
 		int stat;
-		pid_t ret = waitpid(pid, &stat, options);
+		pid_t ret = waitpid(-1, &stat, block && reaped == 0 ?
+			options : options | WNOHANG);
 		if (ret == 0) { // no status available
-			assert(options & WNOHANG);
-			return true;
+			return reaped;
 		} else if (ret < 0) {
 			if (errno == EINTR) {
 				continue;
 			}
-			fprintf(stderr, "waitpid(%d): %s\n", pid, strerror(errno));
-			return false;
+			if (errno == ECHILD) {
+				return reaped;
+			}
+			perror("waitpid");
+			return -1;
 		}
-		assert(ret == pid);
 
 		update_job(state, ret, stat);
-		return true;
+		reaped = 1;
 	}
 }
 
-static struct mrsh_process *job_get_running_process(struct mrsh_job *job) {
-	for (size_t j = 0; j < job->processes.len; ++j) {
-		struct mrsh_process *proc = job->processes.data[j];
-		if (process_poll(proc) == TASK_STATUS_WAIT) {
-			return proc;
-		}
-	}
-	return NULL;
-}
-
 int job_wait(struct mrsh_job *job) {
 	while (true) {
 		int status = job_poll(job);
@@ -268,9 +258,8 @@ int job_wait(struct mrsh_job *job) {
 			return status;
 		}
 
-		struct mrsh_process *wait_proc = job_get_running_process(job);
-		assert(wait_proc != NULL);
-		if (!_job_wait(job->state, wait_proc->pid, 0)) {
+		if (reap_children(job->state, true) <= 0) {
+			fprintf(stderr, "job_wait: no child processes left\n");
 			return TASK_STATUS_ERROR;
 		}
 	}
@@ -283,27 +272,15 @@ int job_wait_process(struct mrsh_process *proc) {
 			return status;
 		}
 
-		if (!_job_wait(proc->state, proc->pid, 0)) {
+		if (reap_children(proc->state, true) <= 0) {
+			fprintf(stderr, "job_wait_process: no child processes left\n");
 			return TASK_STATUS_ERROR;
 		}
 	}
 }
 
 bool refresh_jobs_status(struct mrsh_state *state) {
-	struct mrsh_state_priv *priv = state_get_priv(state);
-
-	for (size_t i = 0; i < priv->jobs.len; ++i) {
-		struct mrsh_job *job = priv->jobs.data[i];
-		struct mrsh_process *proc = job_get_running_process(job);
-		if (proc == NULL) {
-			continue;
-		}
-		if (!_job_wait(job->state, proc->pid, WNOHANG)) {
-			return false;
-		}
-	}
-
-	return true;
+	return reap_children(state, false) >= 0;
 }
 
 bool init_job_child_process(struct mrsh_state *state) {
@@ -313,25 +290,25 @@ bool init_job_child_process(struct mrsh_state *state) {
 static void update_job(struct mrsh_state *state, pid_t pid, int stat) {
 	struct mrsh_state_priv *priv = state_get_priv(state);
 
+	// The process may be destroyed by update_process
+	struct mrsh_process *proc = process_by_pid(state, pid);
+	struct mrsh_job *job = proc != NULL ? proc->job : NULL;
+
 	update_process(state, pid, stat);
 
-	if (!priv->job_control) {
+	if (!priv->job_control || job == NULL) {
 		return;
 	}
 
 	// Put stopped and terminated jobs in the background. We don't want to do so
 	// if we're not the main shell, because we only have a partial view of the
 	// jobs (we only know about our own child processes).
-	for (size_t i = 0; i < priv->jobs.len; ++i) {
-		struct mrsh_job *job = priv->jobs.data[i];
-
-		int status = job_poll(job);
-		if (status >= 0) {
-			job_queue_notification(job);
-		}
-		if (status != TASK_STATUS_WAIT && job->pgid > 0) {
-			job_set_foreground(job, false, false);
-		}
+	int status = job_poll(job);
+	if (status >= 0) {
+		job_queue_notification(job);
+	}
+	if (status != TASK_STATUS_WAIT && job->pgid > 0) {
+		job_set_foreground(job, false, false);
 	}
 }
 
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include "shell/path.h"
+#include "shell/shell.h"
 
 char *expand_path(struct mrsh_state *state, const char *file, bool exec,
 		bool default_path) {
@@ -66,6 +67,61 @@ next:
 	return NULL;
 }
 
+char *find_utility(struct mrsh_state *state, const char *name, bool hit) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	if (strchr(name, '/')) {
+		return strdup(name);
+	}
+
+	struct mrsh_utility *utility = mrsh_hashtable_get(&priv->utilities, name);
+	if (utility == NULL) {
+		char *path = expand_path(state, name, true, false);
+		if (path == NULL) {
+			return NULL;
+		}
+
+		utility = calloc(1, sizeof(struct mrsh_utility));
+		if (utility == NULL) {
+			return path;
+		}
+		utility->path = path;
+		mrsh_hashtable_set(&priv->utilities, name, utility);
+	}
+
+	if (hit) {
+		++utility->hits;
+	}
+	return strdup(utility->path);
+}
+
+static void utility_destroy(struct mrsh_utility *utility) {
+	if (utility == NULL) {
+		return;
+	}
+	free(utility->path);
+	free(utility);
+}
+
+void forget_utility(struct mrsh_state *state, const char *name) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	utility_destroy(mrsh_hashtable_del(&priv->utilities, name));
+}
+
+static void forget_utility_iterator(const char *key, void *value,
+		void *user_data) {
+	struct mrsh_hashtable *utilities = user_data;
+	utility_destroy(mrsh_hashtable_del(utilities, key));
+}
+
+void forget_utilities(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	mrsh_hashtable_for_each(&priv->utilities, forget_utility_iterator,
+		&priv->utilities);
+}
+
 char *current_working_dir(void) {
 	// POSIX doesn't provide a way to query the CWD size
 	struct mrsh_buffer buf = {0};
@@ -0,0 +1,404 @@
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shell/pattern.h"
+#include "shell/shell.h"
+
+// Maximum number of patterns kept compiled by the shell
+#define PATTERN_CACHE_SIZE 64
+
+enum pattern_elem_type {
+	PATTERN_CHAR, // a single character
+	PATTERN_ANY, // `?`
+	PATTERN_SET, // a bracket expression
+	PATTERN_STAR, // `*`
+};
+
+struct pattern_elem {
+	enum pattern_elem_type type;
+	unsigned char ch; // PATTERN_CHAR
+	uint8_t set[32]; // PATTERN_SET, bitmap of the matching characters
+};
+
+/**
+ * Patterns are compiled to a list of elements, which is matched by simulating
+ * the corresponding NFA. The state `i` means that the first `i` elements have
+ * been matched. Patterns with zero or one `*` are matched directly.
+ */
+struct pattern {
+	struct pattern_elem *elems;
+	size_t len;
+	size_t nstars;
+	size_t star; // position of the first `*`
+	bool invalid; // never matches
+};
+
+static const struct {
+	const char *name;
+	int (*is)(int c);
+} char_classes[] = {
+	{ "alnum", isalnum },
+	{ "alpha", isalpha },
+	{ "blank", isblank },
+	{ "cntrl", iscntrl },
+	{ "digit", isdigit },
+	{ "graph", isgraph },
+	{ "lower", islower },
+	{ "print", isprint },
+	{ "punct", ispunct },
+	{ "space", isspace },
+	{ "upper", isupper },
+	{ "xdigit", isxdigit },
+};
+
+static void set_add(uint8_t set[static 32], unsigned char c) {
+	set[c / 8] |= 1 << (c % 8);
+}
+
+static bool set_has(const uint8_t set[static 32], unsigned char c) {
+	return set[c / 8] & (1 << (c % 8));
+}
+
+static bool set_add_class(uint8_t set[static 32], const char *name,
+		size_t name_len) {
+	for (size_t i = 0; i < sizeof(char_classes) / sizeof(char_classes[0]); ++i) {
+		if (strlen(char_classes[i].name) != name_len ||
+				strncmp(char_classes[i].name, name, name_len) != 0) {
+			continue;
+		}
+		for (int c = 1; c < 256; ++c) {
+			if (char_classes[i].is(c)) {
+				set_add(set, c);
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Reads a single character of a bracket expression, which may be escaped or a
+ * collating symbol. Equivalence classes are only allowed if `equiv` is set.
+ */
+static unsigned char bracket_char(const char **str_ptr, bool equiv) {
+	const char *str = *str_ptr;
+	if (str[0] == '\\' && str[1] != '\0') {
+		*str_ptr += 2;
+		return str[1];
+	}
+	// Only single-character collating elements exist in the C locale
+	if (str[0] == '[' && (str[1] == '.' || (equiv && str[1] == '=')) &&
+			str[2] != '\0' && str[3] == str[1] && str[4] == ']') {
+		*str_ptr += 5;
+		return str[2];
+	}
+	*str_ptr += 1;
+	return str[0];
+}
+
+/**
+ * Returns the length of the character class name following `[:` at `str`, or 0
+ * if `str` isn't a character class.
+ */
+static size_t char_class_len(const char *str) {
+	size_t len = 0;
+	while (str[len] >= 'a' && str[len] <= 'z') {
+		++len;
+	}
+	return str[len] == ':' && str[len + 1] == ']' ? len : 0;
+}
+
+/**
+ * Parses the bracket expression starting at `str`. Returns a pointer to the
+ * character following it, or NULL if the bracket isn't closed. Sets `invalid`
+ * if the expression refers to an unknown character class, in which case the
+ * pattern never matches.
+ */
+static const char *parse_bracket(const char *str, uint8_t set[static 32],
+		bool *invalid) {
+	const char *p = str + 1;
+	bool negate = *p == '!' || *p == '^';
+	if (negate) {
+		++p;
+	}
+
+	memset(set, 0, 32);
+	bool first = true;
+	while (true) {
+		if (*p == '\0') {
+			return NULL;
+		}
+		if (*p == ']' && !first) {
+			++p;
+			break;
+		}
+		first = false;
+
+		size_t class_len = p[0] == '[' && p[1] == ':' ?
+			char_class_len(p + 2) : 0;
+		if (class_len > 0) {
+			// Unknown classes make the whole pattern invalid
+			if (!set_add_class(set, p + 2, class_len)) {
+				*invalid = true;
+				return NULL;
+			}
+			p += class_len + 4;
+			continue;
+		}
+
+		unsigned char lo = bracket_char(&p, true), hi = lo;
+		if (p[0] == '-' && p[1] != ']' && p[1] != '\0') {
+			++p;
+			hi = bracket_char(&p, false);
+		}
+		for (unsigned int c = lo; c <= hi; ++c) {
+			set_add(set, c);
+		}
+	}
+
+	if (negate) {
+		for (size_t i = 0; i < 32; ++i) {
+			set[i] = ~set[i];
+		}
+	}
+	return p;
+}
+
+struct pattern *pattern_compile(const char *str) {
+	struct pattern *pat = calloc(1, sizeof(struct pattern));
+	if (pat == NULL) {
+		return NULL;
+	}
+	// Each element is at least one character long
+	pat->elems = calloc(strlen(str) + 1, sizeof(struct pattern_elem));
+	if (pat->elems == NULL) {
+		free(pat);
+		return NULL;
+	}
+
+	const char *p = str;
+	while (*p != '\0') {
+		struct pattern_elem *elem = &pat->elems[pat->len];
+		switch (*p) {
+		case '*':
+			++p;
+			if (pat->len > 0 && elem[-1].type == PATTERN_STAR) {
+				continue; // `**` is the same as `*`
+			}
+			if (pat->nstars == 0) {
+				pat->star = pat->len;
+			}
+			++pat->nstars;
+			elem->type = PATTERN_STAR;
+			break;
+		case '?':
+			++p;
+			elem->type = PATTERN_ANY;
+			break;
+		case '[':;
+			const char *end = parse_bracket(p, elem->set, &pat->invalid);
+			if (pat->invalid) {
+				return pat;
+			}
+			if (end != NULL) {
+				p = end;
+				elem->type = PATTERN_SET;
+				break;
+			}
+			elem->type = PATTERN_CHAR;
+			elem->ch = *p++;
+			break;
+		case '\\':
+			if (p[1] == '\0') {
+				// A trailing backslash never matches, like fnmatch
+				++p;
+				elem->type = PATTERN_SET;
+				memset(elem->set, 0, sizeof(elem->set));
+				break;
+			}
+			elem->type = PATTERN_CHAR;
+			elem->ch = p[1];
+			p += 2;
+			break;
+		default:
+			elem->type = PATTERN_CHAR;
+			elem->ch = *p++;
+			break;
+		}
+		++pat->len;
+	}
+
+	return pat;
+}
+
+void pattern_destroy(struct pattern *pat) {
+	if (pat == NULL) {
+		return;
+	}
+	free(pat->elems);
+	free(pat);
+}
+
+static bool elem_match(const struct pattern_elem *elem, unsigned char c) {
+	switch (elem->type) {
+	case PATTERN_CHAR:
+		return elem->ch == c;
+	case PATTERN_SET:
+		return set_has(elem->set, c);
+	case PATTERN_ANY:
+	case PATTERN_STAR:
+		return true;
+	}
+	return false;
+}
+
+/**
+ * Checks whether the `n` elements starting at `elems` match the `n` characters
+ * starting at `str`. There must not be any `*` in the elements.
+ */
+static bool match_fixed(const struct pattern_elem *elems, const char *str,
+		size_t n) {
+	for (size_t i = 0; i < n; ++i) {
+		if (!elem_match(&elems[i], str[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void add_state(const struct pattern *pat, bool reverse, bool *states,
+		size_t i) {
+	// Follow the empty transitions of `*`
+	while (true) {
+		states[i] = true;
+		if (i == pat->len) {
+			break;
+		}
+		size_t j = reverse ? pat->len - 1 - i : i;
+		if (pat->elems[j].type != PATTERN_STAR) {
+			break;
+		}
+		++i;
+	}
+}
+
+/**
+ * Returns the length of the shortest or longest prefix of `str` matching the
+ * pattern, or -1. If `reverse` is set, the pattern and `str` are read
+ * backwards and the length is the one of a suffix.
+ */
+static ssize_t match_len(const struct pattern *pat, const char *str,
+		size_t len, bool reverse, bool longest) {
+	if (pat->invalid) {
+		return -1;
+	}
+
+	bool states[pat->len + 1], next[pat->len + 1];
+	memset(states, 0, sizeof(states));
+	add_state(pat, reverse, states, 0);
+
+	ssize_t result = states[pat->len] ? 0 : -1;
+	if (result == 0 && !longest) {
+		return 0;
+	}
+
+	for (size_t k = 0; k < len; ++k) {
+		unsigned char c = reverse ? str[len - 1 - k] : str[k];
+
+		memset(next, 0, sizeof(next));
+		bool alive = false;
+		for (size_t i = 0; i < pat->len; ++i) {
+			if (!states[i]) {
+				continue;
+			}
+			const struct pattern_elem *elem =
+				&pat->elems[reverse ? pat->len - 1 - i : i];
+			if (elem->type == PATTERN_STAR) {
+				add_state(pat, reverse, next, i);
+				alive = true;
+			} else if (elem_match(elem, c)) {
+				add_state(pat, reverse, next, i + 1);
+				alive = true;
+			}
+		}
+		if (!alive) {
+			break;
+		}
+		memcpy(states, next, sizeof(states));
+
+		if (states[pat->len]) {
+			result = k + 1;
+			if (!longest) {
+				break;
+			}
+		}
+	}
+
+	return result;
+}
+
+bool pattern_match(const struct pattern *pat, const char *str) {
+	if (pat->invalid) {
+		return false;
+	}
+
+	size_t len = strlen(str);
+	switch (pat->nstars) {
+	case 0:
+		return len == pat->len && match_fixed(pat->elems, str, len);
+	case 1:;
+		size_t head = pat->star, tail = pat->len - pat->star - 1;
+		return len >= head + tail && match_fixed(pat->elems, str, head) &&
+			match_fixed(&pat->elems[pat->star + 1], str + len - tail, tail);
+	default:
+		return match_len(pat, str, len, false, true) == (ssize_t)len;
+	}
+}
+
+ssize_t pattern_match_prefix(const struct pattern *pat, const char *str,
+		bool longest) {
+	return match_len(pat, str, strlen(str), false, longest);
+}
+
+ssize_t pattern_match_suffix(const struct pattern *pat, const char *str,
+		bool longest) {
+	return match_len(pat, str, strlen(str), true, longest);
+}
+
+static void pattern_cache_iterator(const char *key, void *value,
+		void *user_data) {
+	struct mrsh_hashtable *patterns = user_data;
+	pattern_destroy(mrsh_hashtable_del(patterns, key));
+}
+
+void pattern_cache_finish(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	mrsh_hashtable_for_each(&priv->patterns, pattern_cache_iterator,
+		&priv->patterns);
+	mrsh_hashtable_finish(&priv->patterns);
+}
+
+const struct pattern *pattern_cache_get(struct mrsh_state *state,
+		const char *str) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	struct pattern *pat = mrsh_hashtable_get(&priv->patterns, str);
+	if (pat != NULL) {
+		return pat;
+	}
+
+	pat = pattern_compile(str);
+	if (pat == NULL) {
+		return NULL;
+	}
+	// Patterns built from variables may be different each time: start over
+	// instead of growing without bound
+	if (priv->patterns.len >= PATTERN_CACHE_SIZE) {
+		mrsh_hashtable_for_each(&priv->patterns, pattern_cache_iterator,
+			&priv->patterns);
+	}
+	mrsh_hashtable_set(&priv->patterns, str, pat);
+	return pat;
+}
@@ -1,43 +1,142 @@
 #define _POSIX_C_SOURCE 1
 #include <assert.h>
-#include <mrsh/array.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/wait.h>
 #include "shell/process.h"
 #include "shell/task.h"
 
+#define PROCESS_TABLE_INITIAL_CAP 16
+
+static size_t pid_hash(pid_t pid) {
+	// Knuth's multiplicative hash: consecutive PIDs end up in distinct slots
+	return (uint32_t)pid * UINT32_C(2654435761);
+}
+
+static size_t table_find_slot(const struct mrsh_process_table *table,
+		pid_t pid) {
+	size_t mask = table->cap - 1;
+	size_t i = pid_hash(pid) & mask;
+	while (table->slots[i] != NULL && table->slots[i]->pid != pid) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+static bool table_resize(struct mrsh_process_table *table, size_t new_cap) {
+	struct mrsh_process **new_slots = calloc(new_cap, sizeof(*new_slots));
+	if (new_slots == NULL) {
+		return false;
+	}
+
+	struct mrsh_process_table new_table = {
+		.slots = new_slots,
+		.len = table->len,
+		.cap = new_cap,
+	};
+	for (size_t i = 0; i < table->cap; ++i) {
+		struct mrsh_process *proc = table->slots[i];
+		if (proc != NULL) {
+			new_slots[table_find_slot(&new_table, proc->pid)] = proc;
+		}
+	}
+
+	free(table->slots);
+	*table = new_table;
+	return true;
+}
+
+static void table_insert(struct mrsh_process_table *table,
+		struct mrsh_process *proc) {
+	// Keep the load factor under 3/4
+	if ((table->len + 1) * 4 > table->cap * 3) {
+		size_t new_cap = 2 * table->cap;
+		if (new_cap < PROCESS_TABLE_INITIAL_CAP) {
+			new_cap = PROCESS_TABLE_INITIAL_CAP;
+		}
+		if (!table_resize(table, new_cap)) {
+			abort();
+		}
+	}
+
+	// If the PID has been recycled by the kernel, the old process has
+	// necessarily been reaped already. It's still owned by its job, but isn't
+	// indexed anymore.
+	size_t i = table_find_slot(table, proc->pid);
+	if (table->slots[i] == NULL) {
+		++table->len;
+	}
+	table->slots[i] = proc;
+}
+
+static void table_remove(struct mrsh_process_table *table,
+		struct mrsh_process *proc) {
+	if (table->cap == 0) {
+		return;
+	}
+
+	size_t mask = table->cap - 1;
+	size_t i = table_find_slot(table, proc->pid);
+	if (table->slots[i] != proc) {
+		return;
+	}
+	table->slots[i] = NULL;
+	--table->len;
+
+	// Shift back the following entries of the cluster, so that lookups don't
+	// stop early at the hole we've just made
+	size_t j = i;
+	while (true) {
+		j = (j + 1) & mask;
+		struct mrsh_process *next = table->slots[j];
+		if (next == NULL) {
+			break;
+		}
+		size_t home = pid_hash(next->pid) & mask;
+		bool movable = (i <= j) ? (home <= i || home > j) :
+			(home <= i && home > j);
+		if (movable) {
+			table->slots[i] = next;
+			table->slots[j] = NULL;
+			i = j;
+		}
+	}
+}
+
 struct mrsh_process *process_create(struct mrsh_state *state, pid_t pid) {
 	struct mrsh_state_priv *priv = state_get_priv(state);
 
+	// The child is already running: without a record of it, it could never
+	// be waited for
 	struct mrsh_process *proc = calloc(1, sizeof(struct mrsh_process));
+	if (proc == NULL) {
+		abort();
+	}
 	proc->pid = pid;
 	proc->state = state;
-	mrsh_array_add(&priv->processes, proc);
+	table_insert(&priv->processes, proc);
+	profile_record_fork(state);
 	return proc;
 }
 
-static void array_remove(struct mrsh_array *array, size_t i) {
-	memmove(&array->data[i], &array->data[i + 1],
-		(array->len - i - 1) * sizeof(void *));
-	--array->len;
-}
-
 void process_destroy(struct mrsh_process *proc) {
 	struct mrsh_state_priv *priv = state_get_priv(proc->state);
 
-	for (size_t i = 0; i < priv->processes.len; ++i) {
-		if (priv->processes.data[i] == proc) {
-			array_remove(&priv->processes, i);
-			break;
-		}
-	}
-
+	table_remove(&priv->processes, proc);
 	free(proc);
 }
 
+void process_release(struct mrsh_process *proc) {
+	if (proc->job == NULL && proc->terminated) {
+		process_destroy(proc);
+		return;
+	}
+	proc->released = true;
+}
+
 int process_poll(struct mrsh_process *proc) {
 	if (proc->stopped) {
 		return TASK_STATUS_STOPPED;
@@ -54,19 +153,30 @@ int process_poll(struct mrsh_process *proc) {
 	}
 }
 
-void update_process(struct mrsh_state *state, pid_t pid, int stat) {
+struct mrsh_process *process_by_pid(struct mrsh_state *state, pid_t pid) {
 	struct mrsh_state_priv *priv = state_get_priv(state);
 
-	struct mrsh_process *proc = NULL;
-	bool found = false;
-	for (size_t i = 0; i < priv->processes.len; ++i) {
-		proc = priv->processes.data[i];
-		if (proc->pid == pid) {
-			found = true;
-			break;
+	if (priv->processes.cap == 0) {
+		return NULL;
+	}
+	return priv->processes.slots[table_find_slot(&priv->processes, pid)];
+}
+
+void process_for_each(struct mrsh_state *state,
+		mrsh_process_iterator_func iterator, void *user_data) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	for (size_t i = 0; i < priv->processes.cap; ++i) {
+		struct mrsh_process *proc = priv->processes.slots[i];
+		if (proc != NULL) {
+			iterator(proc, user_data);
 		}
 	}
-	if (!found) {
+}
+
+void update_process(struct mrsh_state *state, pid_t pid, int stat) {
+	struct mrsh_process *proc = process_by_pid(state, pid);
+	if (proc == NULL) {
 		return;
 	}
 
@@ -79,4 +189,17 @@ void update_process(struct mrsh_state *state, pid_t pid, int stat) {
 	} else {
 		abort();
 	}
+
+	if (proc->terminated && proc->released && proc->job == NULL) {
+		process_destroy(proc);
+	}
+}
+
+void process_table_finish(struct mrsh_process_table *table) {
+	for (size_t i = 0; i < table->cap; ++i) {
+		free(table->slots[i]);
+	}
+	free(table->slots);
+	table->slots = NULL;
+	table->len = table->cap = 0;
 }
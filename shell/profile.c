@@ -0,0 +1,469 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <mrsh/buffer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+#include "shell/profile.h"
+#include "shell/shell.h"
+
+/**
+ * A source of commands, whose lines are profiled separately from the ones of
+ * the other sources.
+ */
+struct mrsh_profile_source {
+	char *name;
+	struct mrsh_profile_stats *lines; // indexed by line number
+	size_t lines_len;
+};
+
+struct mrsh_profile_frame {
+	char *function; // NULL for commands
+	struct mrsh_profile_source *source; // only for commands
+	int line; // only for commands
+	uint64_t start_wall_ns, start_cpu_ns, start_forks;
+	uint64_t children_wall_ns;
+};
+
+struct report_entry {
+	const char *function;
+	const char *source;
+	int line;
+	const struct mrsh_profile_stats *stats;
+};
+
+static uint64_t timespec_ns(const struct timespec *ts) {
+	return (uint64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static uint64_t timeval_ns(const struct timeval *tv) {
+	return (uint64_t)tv->tv_sec * 1000000000 + (uint64_t)tv->tv_usec * 1000;
+}
+
+static uint64_t wall_time_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return timespec_ns(&ts);
+}
+
+/**
+ * Returns the CPU time used by the shell and the child processes it has
+ * waited for.
+ */
+static uint64_t cpu_time_ns(void) {
+	uint64_t total = 0;
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+		total += timeval_ns(&usage.ru_utime) + timeval_ns(&usage.ru_stime);
+	}
+	if (getrusage(RUSAGE_CHILDREN, &usage) == 0) {
+		total += timeval_ns(&usage.ru_utime) + timeval_ns(&usage.ru_stime);
+	}
+	return total;
+}
+
+static int word_line(const struct mrsh_word *word) {
+	switch (word->type) {
+	case MRSH_WORD_STRING:;
+		const struct mrsh_word_string *ws = mrsh_word_get_string(word);
+		return ws->range.begin.line;
+	case MRSH_WORD_PARAMETER:;
+		const struct mrsh_word_parameter *wp = mrsh_word_get_parameter(word);
+		return wp->dollar_pos.line;
+	case MRSH_WORD_COMMAND:;
+		const struct mrsh_word_command *wc = mrsh_word_get_command(word);
+		return wc->range.begin.line;
+	case MRSH_WORD_ARITHMETIC:;
+		const struct mrsh_word_arithmetic *wa =
+			mrsh_word_get_arithmetic(word);
+		return word_line(wa->body);
+	case MRSH_WORD_LIST:;
+		const struct mrsh_word_list *wl = mrsh_word_get_list(word);
+		for (size_t i = 0; i < wl->children.len; ++i) {
+			int line = word_line(wl->children.data[i]);
+			if (line > 0) {
+				return line;
+			}
+		}
+		return 0;
+	}
+	abort();
+}
+
+static int simple_command_line(const struct mrsh_simple_command *sc) {
+	if (sc->name != NULL) {
+		return word_line(sc->name);
+	}
+	if (sc->assignments.len > 0) {
+		const struct mrsh_assignment *assign = sc->assignments.data[0];
+		return assign->name_range.begin.line;
+	}
+	return 0;
+}
+
+/**
+ * Returns the source the commands being run come from. Sources are kept until
+ * the profiler is finished.
+ */
+static struct mrsh_profile_source *current_source(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	const char *name = priv->source;
+	if (name == NULL) {
+		// The main script is named by $0 of the shell
+		struct mrsh_call_frame *frame = state->frame;
+		while (frame->prev != NULL) {
+			frame = frame->prev;
+		}
+		name = frame->argv[0];
+	}
+
+	struct mrsh_profile_source *source =
+		mrsh_hashtable_get(&priv->profiler.sources, name);
+	if (source != NULL) {
+		return source;
+	}
+	source = calloc(1, sizeof(struct mrsh_profile_source));
+	if (source == NULL) {
+		return NULL;
+	}
+	source->name = strdup(name);
+	if (source->name == NULL) {
+		free(source);
+		return NULL;
+	}
+	mrsh_hashtable_set(&priv->profiler.sources, name, source);
+	return source;
+}
+
+static void begin_frame(struct mrsh_state *state, const char *function,
+		int line) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	struct mrsh_profiler *profiler = &priv->profiler;
+
+	if (profiler->pid == 0) {
+		profiler->pid = getpid();
+	}
+
+	struct mrsh_profile_frame *frame =
+		calloc(1, sizeof(struct mrsh_profile_frame));
+	if (function != NULL) {
+		frame->function = strdup(function);
+	} else {
+		frame->source = current_source(state);
+	}
+	frame->line = line;
+	frame->start_forks = profiler->forks;
+	frame->start_cpu_ns = cpu_time_ns();
+	frame->start_wall_ns = wall_time_ns();
+	mrsh_array_add(&profiler->frames, frame);
+}
+
+static void stats_add(struct mrsh_profile_stats *stats,
+		const struct mrsh_profile_frame *frame, uint64_t wall_ns,
+		uint64_t forks) {
+	++stats->calls;
+	stats->forks += forks;
+	stats->wall_ns += wall_ns;
+	stats->cpu_ns += cpu_time_ns() - frame->start_cpu_ns;
+}
+
+static struct mrsh_profile_stats *line_stats(
+		struct mrsh_profile_source *source, int line) {
+	if (source == NULL) {
+		return NULL;
+	}
+	if (line < 0) {
+		line = 0;
+	}
+	if ((size_t)line >= source->lines_len) {
+		size_t len = 2 * (size_t)line + 1;
+		struct mrsh_profile_stats *lines =
+			realloc(source->lines, len * sizeof(*lines));
+		if (lines == NULL) {
+			return NULL;
+		}
+		memset(&lines[source->lines_len], 0,
+			(len - source->lines_len) * sizeof(*lines));
+		source->lines = lines;
+		source->lines_len = len;
+	}
+	return &source->lines[line];
+}
+
+static struct mrsh_profile_stats *function_stats(
+		struct mrsh_profiler *profiler, const char *name) {
+	struct mrsh_profile_stats *stats =
+		mrsh_hashtable_get(&profiler->functions, name);
+	if (stats == NULL) {
+		stats = calloc(1, sizeof(struct mrsh_profile_stats));
+		mrsh_hashtable_set(&profiler->functions, name, stats);
+	}
+	return stats;
+}
+
+/**
+ * Adds `self_ns` to the collapsed stack made of the functions in the frame
+ * stack, followed by `frame`.
+ */
+static void add_stack_sample(struct mrsh_profiler *profiler,
+		const struct mrsh_profile_frame *frame, uint64_t self_ns) {
+	struct mrsh_buffer buf = {0};
+	// Not a valid function name, so that it can't be mistaken for one
+	const char root[] = "[shell]";
+	mrsh_buffer_append(&buf, root, strlen(root));
+	for (size_t i = 0; i < profiler->frames.len; ++i) {
+		const struct mrsh_profile_frame *parent = profiler->frames.data[i];
+		if (parent->function != NULL) {
+			mrsh_buffer_append_char(&buf, ';');
+			mrsh_buffer_append(&buf, parent->function,
+				strlen(parent->function));
+		}
+	}
+	char leaf[32];
+	mrsh_buffer_append_char(&buf, ';');
+	if (frame->function != NULL) {
+		mrsh_buffer_append(&buf, frame->function, strlen(frame->function));
+	} else {
+		if (frame->source != NULL) {
+			mrsh_buffer_append(&buf, frame->source->name,
+				strlen(frame->source->name));
+		}
+		snprintf(leaf, sizeof(leaf), ":%d", frame->line);
+		mrsh_buffer_append(&buf, leaf, strlen(leaf));
+	}
+	mrsh_buffer_append_char(&buf, '\0');
+
+	uint64_t *weight = mrsh_hashtable_get(&profiler->stacks, buf.data);
+	if (weight == NULL) {
+		weight = calloc(1, sizeof(uint64_t));
+		mrsh_hashtable_set(&profiler->stacks, buf.data, weight);
+	}
+	*weight += self_ns / 1000;
+	mrsh_buffer_finish(&buf);
+}
+
+static void end_frame(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	struct mrsh_profiler *profiler = &priv->profiler;
+
+	if (profiler->frames.len == 0) {
+		return;
+	}
+	struct mrsh_profile_frame *frame =
+		profiler->frames.data[--profiler->frames.len];
+
+	uint64_t wall_ns = wall_time_ns() - frame->start_wall_ns;
+	uint64_t forks = profiler->forks - frame->start_forks;
+
+	struct mrsh_profile_stats *stats;
+	if (frame->function != NULL) {
+		stats = function_stats(profiler, frame->function);
+	} else {
+		stats = line_stats(frame->source, frame->line);
+	}
+	if (stats != NULL) {
+		stats_add(stats, frame, wall_ns, forks);
+	}
+
+	uint64_t self_ns = 0;
+	if (wall_ns > frame->children_wall_ns) {
+		self_ns = wall_ns - frame->children_wall_ns;
+	}
+	add_stack_sample(profiler, frame, self_ns);
+
+	if (profiler->frames.len > 0) {
+		struct mrsh_profile_frame *parent =
+			profiler->frames.data[profiler->frames.len - 1];
+		parent->children_wall_ns += wall_ns;
+	}
+
+	free(frame->function);
+	free(frame);
+}
+
+void profile_begin_command(struct mrsh_state *state,
+		const struct mrsh_simple_command *sc) {
+	begin_frame(state, NULL, simple_command_line(sc));
+}
+
+void profile_end_command(struct mrsh_state *state) {
+	end_frame(state);
+}
+
+void profile_begin_function(struct mrsh_state *state, const char *name) {
+	begin_frame(state, name, 0);
+}
+
+void profile_end_function(struct mrsh_state *state) {
+	end_frame(state);
+}
+
+void profile_record_fork(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	++priv->profiler.forks;
+}
+
+static int report_entry_cmp(const void *p1, const void *p2) {
+	const struct report_entry *e1 = p1;
+	const struct report_entry *e2 = p2;
+	if (e1->stats->wall_ns != e2->stats->wall_ns) {
+		return e1->stats->wall_ns < e2->stats->wall_ns ? 1 : -1;
+	}
+	if (e1->source != NULL && e2->source != NULL) {
+		int cmp = strcmp(e1->source, e2->source);
+		if (cmp != 0) {
+			return cmp;
+		}
+	}
+	return e1->line - e2->line;
+}
+
+static void collect_functions_iterator(const char *key, void *value,
+		void *user_data) {
+	struct mrsh_array *entries = user_data;
+	struct report_entry *entry = calloc(1, sizeof(struct report_entry));
+	entry->function = key;
+	entry->stats = value;
+	mrsh_array_add(entries, entry);
+}
+
+static void collect_lines_iterator(const char *key, void *value,
+		void *user_data) {
+	struct mrsh_array *entries = user_data;
+	const struct mrsh_profile_source *source = value;
+	for (size_t i = 0; i < source->lines_len; ++i) {
+		if (source->lines[i].calls == 0) {
+			continue;
+		}
+		struct report_entry *entry = calloc(1, sizeof(struct report_entry));
+		entry->source = source->name;
+		entry->line = i;
+		entry->stats = &source->lines[i];
+		mrsh_array_add(entries, entry);
+	}
+}
+
+static void print_report_entries(struct mrsh_array *entries,
+		const char *title) {
+	if (entries->len == 0) {
+		return;
+	}
+
+	struct report_entry *sorted =
+		calloc(entries->len, sizeof(struct report_entry));
+	for (size_t i = 0; i < entries->len; ++i) {
+		sorted[i] = *(struct report_entry *)entries->data[i];
+	}
+	qsort(sorted, entries->len, sizeof(struct report_entry),
+		report_entry_cmp);
+
+	fprintf(stderr, "%12s %12s %10s %8s  %s\n",
+		"wall (ms)", "cpu (ms)", "calls", "forks", title);
+	for (size_t i = 0; i < entries->len; ++i) {
+		const struct report_entry *entry = &sorted[i];
+		fprintf(stderr, "%12.3f %12.3f %10" PRIu64 " %8" PRIu64 "  ",
+			entry->stats->wall_ns / 1e6, entry->stats->cpu_ns / 1e6,
+			entry->stats->calls, entry->stats->forks);
+		if (entry->function != NULL) {
+			fprintf(stderr, "%s\n", entry->function);
+		} else {
+			fprintf(stderr, "%s:%d\n", entry->source, entry->line);
+		}
+	}
+	free(sorted);
+}
+
+static void write_stack_iterator(const char *key, void *value,
+		void *user_data) {
+	FILE *f = user_data;
+	const uint64_t *weight = value;
+	if (*weight > 0) {
+		fprintf(f, "%s %" PRIu64 "\n", key, *weight);
+	}
+}
+
+static void print_report(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	struct mrsh_profiler *profiler = &priv->profiler;
+
+	fprintf(stderr, "mrsh profile (pid %d)\n", (int)profiler->pid);
+
+	struct mrsh_array entries = {0};
+	mrsh_hashtable_for_each(&profiler->sources, collect_lines_iterator,
+		&entries);
+	print_report_entries(&entries, "file:line");
+	for (size_t i = 0; i < entries.len; ++i) {
+		free(entries.data[i]);
+	}
+	entries.len = 0;
+
+	mrsh_hashtable_for_each(&profiler->functions, collect_functions_iterator,
+		&entries);
+	if (entries.len > 0) {
+		fprintf(stderr, "\n");
+	}
+	print_report_entries(&entries, "function");
+	for (size_t i = 0; i < entries.len; ++i) {
+		free(entries.data[i]);
+	}
+	mrsh_array_finish(&entries);
+
+	char default_path[64];
+	const char *path = mrsh_env_get(state, "MRSH_PROFILE_FILE", NULL);
+	if (path == NULL) {
+		snprintf(default_path, sizeof(default_path),
+			"mrsh-profile.%d.folded", (int)profiler->pid);
+		path = default_path;
+	}
+	FILE *f = fopen(path, "w");
+	if (f == NULL) {
+		fprintf(stderr, "profile: failed to open %s: %s\n", path,
+			strerror(errno));
+		return;
+	}
+	mrsh_hashtable_for_each(&profiler->stacks, write_stack_iterator, f);
+	fclose(f);
+	fprintf(stderr, "\nCollapsed stacks written to %s\n", path);
+}
+
+static void free_value_iterator(const char *key, void *value,
+		void *user_data) {
+	free(value);
+}
+
+static void free_source_iterator(const char *key, void *value,
+		void *user_data) {
+	struct mrsh_profile_source *source = value;
+	free(source->name);
+	free(source->lines);
+	free(source);
+}
+
+void profiler_finish(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	struct mrsh_profiler *profiler = &priv->profiler;
+
+	// Child processes inherit the parent's data, only the process which
+	// collected it reports it
+	if (profiler->pid != 0 && profiler->pid == getpid()) {
+		print_report(state);
+	}
+
+	for (size_t i = 0; i < profiler->frames.len; ++i) {
+		struct mrsh_profile_frame *frame = profiler->frames.data[i];
+		free(frame->function);
+		free(frame);
+	}
+	mrsh_array_finish(&profiler->frames);
+	mrsh_hashtable_for_each(&profiler->sources, free_source_iterator, NULL);
+	mrsh_hashtable_finish(&profiler->sources);
+	mrsh_hashtable_for_each(&profiler->functions, free_value_iterator, NULL);
+	mrsh_hashtable_finish(&profiler->functions);
+	mrsh_hashtable_for_each(&profiler->stacks, free_value_iterator, NULL);
+	mrsh_hashtable_finish(&profiler->stacks);
+	memset(profiler, 0, sizeof(*profiler));
+}
@@ -1,73 +1,70 @@
 #define _POSIX_C_SOURCE 200809L
 #include <errno.h>
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/param.h>
 #include "shell/redir.h"
+#include "shell/shell.h"
 
-static ssize_t write_here_document_line(int fd, struct mrsh_word *line,
-		ssize_t max_size) {
-	char *line_str = mrsh_word_str(line);
-	size_t line_len = strlen(line_str);
-	size_t write_len = line_len + 1; // line + terminating \n
-	if (max_size >= 0 && write_len > (size_t)max_size) {
-		free(line_str);
-		return 0;
-	}
-
-	errno = 0;
-	ssize_t n = write(fd, line_str, line_len);
-	free(line_str);
-	if (n < 0 || (size_t)n != line_len) {
-		goto err_write;
+static bool write_all(int fd, const char *data, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("write");
+			return false;
+		}
+		data += n;
+		len -= n;
 	}
+	return true;
+}
 
-	if (write(fd, "\n", sizeof(char)) != 1) {
-		goto err_write;
+static int create_here_document_fd(struct mrsh_state *state,
+		const struct mrsh_buffer *buf) {
+	// We can write at most PIPE_BUF bytes into a pipe without blocking. Larger
+	// here-documents are stored in an unlinked temporary file instead.
+	if (buf->len > PIPE_BUF) {
+		int fd = create_temp_file(state);
+		if (fd >= 0) {
+			if (!write_all(fd, buf->data, buf->len)) {
+				close(fd);
+				return -1;
+			}
+			if (lseek(fd, 0, SEEK_SET) < 0) {
+				perror("lseek");
+				close(fd);
+				return -1;
+			}
+			return fd;
+		}
+		// Fall back to a pipe if the temporary directory isn't writable
 	}
 
-	return write_len;
-
-err_write:
-	fprintf(stderr, "write() failed: %s\n",
-		errno ? strerror(errno) : "short write");
-	return -1;
-}
-
-static int create_here_document_fd(const struct mrsh_array *lines) {
 	int fds[2];
 	if (pipe(fds) != 0) {
 		perror("pipe");
 		return -1;
 	}
 
-	// We can write at most PIPE_BUF bytes without blocking. If we want to write
-	// more, we need to fork and continue writing in another process.
-	size_t remaining = PIPE_BUF;
-	bool more = false;
-	size_t i;
-	for (i = 0; i < lines->len; ++i) {
-		struct mrsh_word *line = lines->data[i];
-		ssize_t n = write_here_document_line(fds[1], line, remaining);
-		if (n < 0) {
-			close(fds[0]);
-			close(fds[1]);
-			return -1;
-		} else if (n == 0) {
-			more = true;
-			break;
-		}
+	size_t len = buf->len <= PIPE_BUF ? buf->len : PIPE_BUF;
+	if (!write_all(fds[1], buf->data, len)) {
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
 	}
-
-	if (!more) {
-		// We could write everything into the pipe buffer
+	if (len == buf->len) {
 		close(fds[1]);
 		return fds[0];
 	}
 
+	// Continue writing in another process, as the reader empties the pipe
 	pid_t pid = fork();
 	if (pid < 0) {
 		perror("fork");
@@ -76,17 +73,8 @@ static int create_here_document_fd(const struct mrsh_array *lines) {
 		return -1;
 	} else if (pid == 0) {
 		close(fds[0]);
-
-		for (; i < lines->len; ++i) {
-			struct mrsh_word *line = lines->data[i];
-			ssize_t n = write_here_document_line(fds[1], line, -1);
-			if (n < 0) {
-				close(fds[1]);
-				exit(1);
-			}
-		}
-		close(fds[1]);
-		exit(0);
+		bool ok = write_all(fds[1], buf->data + len, buf->len - len);
+		_exit(ok ? 0 : 1);
 	}
 
 	close(fds[1]);
@@ -108,9 +96,10 @@ static int parse_fd(const char *str) {
 	return fd;
 }
 
-int process_redir(const struct mrsh_io_redirect *redir, int *redir_fd) {
-	// TODO: filename expansions
-	char *filename = mrsh_word_str(redir->name);
+int process_redir(struct mrsh_state *state,
+		const struct expanded_redirect *exp, int *redir_fd) {
+	const struct mrsh_io_redirect *redir = exp->redir;
+	const char *filename = exp->name;
 
 	int fd = -1, default_redir_fd = -1;
 	errno = 0;
@@ -146,7 +135,7 @@ int process_redir(const struct mrsh_io_redirect *redir, int *redir_fd) {
 		break;
 	case MRSH_IO_DLESS: // <<
 	case MRSH_IO_DLESSDASH: // <<-
-		fd = create_here_document_fd(&redir->here_document);
+		fd = create_here_document_fd(state, &exp->here_document);
 		default_redir_fd = STDIN_FILENO;
 		break;
 	}
@@ -156,8 +145,6 @@ int process_redir(const struct mrsh_io_redirect *redir, int *redir_fd) {
 		return -1;
 	}
 
-	free(filename);
-
 	*redir_fd = redir->io_number;
 	if (*redir_fd < 0) {
 		*redir_fd = default_redir_fd;
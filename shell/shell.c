@@ -1,20 +1,45 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <mrsh/hashtable.h>
 #include <mrsh/parser.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include "shell/bytecode.h"
 #include "shell/job.h"
+#include "shell/path.h"
+#include "shell/pattern.h"
 #include "shell/shell.h"
 #include "shell/process.h"
 
-void function_destroy(struct mrsh_function *fn) {
+struct mrsh_function *function_create(struct mrsh_command *body) {
+	struct mrsh_function *fn = calloc(1, sizeof(struct mrsh_function));
+	if (fn == NULL) {
+		return NULL;
+	}
+	fn->body = body;
+	fn->ref = 1;
+	return fn;
+}
+
+void function_ref(struct mrsh_function *fn) {
+	++fn->ref;
+}
+
+void function_unref(struct mrsh_function *fn) {
 	if (!fn) {
 		return;
 	}
+	if (--fn->ref > 0) {
+		return;
+	}
+	bytecode_destroy(fn->code);
 	mrsh_command_destroy(fn->body);
+	free(fn->source);
 	free(fn);
 }
 
@@ -29,9 +54,15 @@ struct mrsh_state *mrsh_state_create(void) {
 	struct mrsh_state *state = &priv->pub;
 	state->exit = -1;
 
+	if (mrsh_array_add(&priv->envp, NULL) < 0) {
+		free(priv);
+		return NULL;
+	}
+
 	struct mrsh_call_frame_priv *frame_priv =
 		calloc(1, sizeof(struct mrsh_call_frame_priv));
 	if (frame_priv == NULL) {
+		mrsh_array_finish(&priv->envp);
 		free(priv);
 		return NULL;
 	}
@@ -60,17 +91,43 @@ static void variable_destroy(struct mrsh_variable *var) {
 	if (!var) {
 		return;
 	}
-	free(var->value);
+	free(var->heap_value);
 	free(var);
 }
 
+/**
+ * Sets the string value of a variable, which may point to its current value.
+ * Returns false if out of memory.
+ */
+static bool variable_set_value(struct mrsh_variable *var, const char *value) {
+	size_t len = strlen(value);
+	char *dst;
+	if (len < sizeof(var->inline_value)) {
+		dst = var->inline_value;
+	} else if (len < var->heap_cap) {
+		dst = var->heap_value;
+	} else {
+		// The value can't be the current one, since it doesn't fit
+		dst = realloc(var->heap_value, len + 1);
+		if (dst == NULL) {
+			return false;
+		}
+		var->heap_value = dst;
+		var->heap_cap = len + 1;
+	}
+	memmove(dst, value, len + 1);
+	var->value = dst;
+	var->number_state = VARIABLE_NUMBER_UNKNOWN;
+	return true;
+}
+
 static void state_var_finish_iterator(const char *key, void *value,
 		void *user_data) {
 	variable_destroy((struct mrsh_variable *)value);
 }
 
 static void state_fn_finish_iterator(const char *key, void *value, void *_) {
-	function_destroy((struct mrsh_function *)value);
+	function_unref((struct mrsh_function *)value);
 }
 
 static void call_frame_destroy(struct mrsh_call_frame *frame) {
@@ -86,21 +143,27 @@ void mrsh_state_destroy(struct mrsh_state *state) {
 	if (priv->job_control) {
 		broadcast_sighup_to_jobs(state);
 	}
+	profiler_finish(state);
 	mrsh_hashtable_for_each(&priv->variables, state_var_finish_iterator, NULL);
 	mrsh_hashtable_finish(&priv->variables);
+	for (size_t i = 0; i < priv->envp.len; ++i) {
+		free(priv->envp.data[i]);
+	}
+	mrsh_array_finish(&priv->envp);
 	mrsh_hashtable_for_each(&priv->functions, state_fn_finish_iterator, NULL);
 	mrsh_hashtable_finish(&priv->functions);
 	mrsh_hashtable_for_each(&priv->aliases,
 		state_string_finish_iterator, NULL);
 	mrsh_hashtable_finish(&priv->aliases);
+	forget_utilities(state);
+	mrsh_hashtable_finish(&priv->utilities);
+	pattern_cache_finish(state);
+	ifs_table_finish(&priv->ifs_table);
 	while (priv->jobs.len > 0) {
 		job_destroy(priv->jobs.data[priv->jobs.len - 1]);
 	}
 	mrsh_array_finish(&priv->jobs);
-	while (priv->processes.len > 0) {
-		process_destroy(priv->processes.data[priv->processes.len - 1]);
-	}
-	mrsh_array_finish(&priv->processes);
+	process_table_finish(&priv->processes);
 	struct mrsh_call_frame *frame = state->frame;
 	while (frame) {
 		struct mrsh_call_frame *prev = frame->prev;
@@ -110,6 +173,10 @@ void mrsh_state_destroy(struct mrsh_state *state) {
 	for (size_t i = 0; i < MRSH_NSIG; i++) {
 		mrsh_program_destroy(priv->traps[i].program);
 	}
+	for (size_t i = 0; i < priv->capture_fds_len; i++) {
+		close(priv->capture_fds[i]);
+	}
+	free(priv->capture_fds);
 	free(state);
 }
 
@@ -117,24 +184,225 @@ struct mrsh_state_priv *state_get_priv(struct mrsh_state *state) {
 	return (struct mrsh_state_priv *)state;
 }
 
+const char *variable_get_value(struct mrsh_variable *var) {
+	if (var->value == NULL && var->number_state == VARIABLE_NUMBER_VALID) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%ld", var->number);
+		if (variable_set_value(var, buf)) {
+			var->number_state = VARIABLE_NUMBER_VALID;
+		}
+	}
+	return var->value;
+}
+
+static char *env_entry(const char *key, const char *value) {
+	if (value == NULL) {
+		return NULL;
+	}
+	size_t key_len = strlen(key), value_len = strlen(value);
+	char *entry = malloc(key_len + value_len + 2);
+	if (entry == NULL) {
+		return NULL;
+	}
+	memcpy(entry, key, key_len);
+	entry[key_len] = '=';
+	memcpy(&entry[key_len + 1], value, value_len + 1);
+	return entry;
+}
+
+static void env_add(struct mrsh_state_priv *priv, const char *key,
+		struct mrsh_variable *var) {
+	char *entry = env_entry(key, variable_get_value(var));
+	if (entry == NULL || mrsh_array_add(&priv->envp, NULL) < 0) {
+		free(entry);
+		var->env_index = -1;
+		return;
+	}
+	// Take the place of the NULL terminator
+	var->env_index = priv->envp.len - 2;
+	priv->envp.data[var->env_index] = entry;
+}
+
+static void env_remove(struct mrsh_state_priv *priv,
+		struct mrsh_variable *var) {
+	size_t last = priv->envp.len - 2;
+	free(priv->envp.data[var->env_index]);
+
+	// Move the last entry to the free slot
+	if ((size_t)var->env_index != last) {
+		char *moved = priv->envp.data[last];
+		char *key = strndup(moved, strchr(moved, '=') - moved);
+		struct mrsh_variable *moved_var =
+			mrsh_hashtable_get(&priv->variables, key);
+		free(key);
+		assert(moved_var != NULL && (size_t)moved_var->env_index == last);
+		moved_var->env_index = var->env_index;
+		priv->envp.data[var->env_index] = moved;
+	}
+
+	priv->envp.data[last] = NULL;
+	--priv->envp.len;
+	var->env_index = -1;
+}
+
+/**
+ * Replaces the variable named `key` with `var`, or deletes it if `var` is NULL,
+ * and updates the environment accordingly. Returns the previous variable.
+ */
+static struct mrsh_variable *replace_variable(struct mrsh_state_priv *priv,
+		const char *key, struct mrsh_variable *var) {
+	struct mrsh_variable *old;
+	if (var != NULL) {
+		old = mrsh_hashtable_set(&priv->variables, key, var);
+	} else {
+		old = mrsh_hashtable_del(&priv->variables, key);
+	}
+
+	bool exported = var != NULL && (var->attribs & MRSH_VAR_ATTRIB_EXPORT);
+	if (old != NULL && old->env_index >= 0) {
+		if (exported) {
+			char *entry = env_entry(key, variable_get_value(var));
+			if (entry != NULL) {
+				var->env_index = old->env_index;
+				old->env_index = -1;
+				free(priv->envp.data[var->env_index]);
+				priv->envp.data[var->env_index] = entry;
+				return old;
+			}
+		}
+		env_remove(priv, old);
+	}
+	if (exported) {
+		env_add(priv, key, var);
+	} else if (var != NULL) {
+		var->env_index = -1;
+	}
+	return old;
+}
+
+/**
+ * Saves the previous value of a variable in the innermost snapshot, if this is
+ * the first time it's modified. Returns true if the snapshot took ownership of
+ * `old`.
+ */
+static bool snapshot_variable(struct mrsh_state_priv *priv, const char *key,
+		struct mrsh_variable *old) {
+	struct mrsh_snapshot *snapshot = priv->snapshot;
+	if (snapshot == NULL ||
+			mrsh_hashtable_get(&snapshot->variables, key) != NULL) {
+		return false;
+	}
+	if (old == NULL) {
+		old = calloc(1, sizeof(struct mrsh_variable));
+		if (old == NULL) {
+			return false;
+		}
+		old->env_index = -1;
+	}
+	mrsh_hashtable_set(&snapshot->variables, key, old);
+	return true;
+}
+
+static void update_env(struct mrsh_state_priv *priv, const char *key,
+		struct mrsh_variable *var) {
+	if (!(var->attribs & MRSH_VAR_ATTRIB_EXPORT)) {
+		if (var->env_index >= 0) {
+			env_remove(priv, var);
+		}
+		return;
+	}
+	if (var->env_index < 0) {
+		env_add(priv, key, var);
+		return;
+	}
+
+	char *entry = env_entry(key, variable_get_value(var));
+	if (entry == NULL) {
+		env_remove(priv, var);
+		return;
+	}
+	free(priv->envp.data[var->env_index]);
+	priv->envp.data[var->env_index] = entry;
+}
+
+/**
+ * Returns the record of the variable named `key` to be assigned. Records are
+ * updated in place, unless the previous value needs to be kept by a snapshot.
+ * Returns NULL if out of memory.
+ */
+static struct mrsh_variable *assigned_variable(struct mrsh_state *state,
+		const char *key) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	struct mrsh_variable *var = mrsh_hashtable_get(&priv->variables, key);
+	struct mrsh_snapshot *snapshot = priv->snapshot;
+	if (var != NULL && (snapshot == NULL ||
+			mrsh_hashtable_get(&snapshot->variables, key) != NULL)) {
+		return var;
+	}
+
+	var = calloc(1, sizeof(struct mrsh_variable));
+	if (var == NULL) {
+		return NULL;
+	}
+	struct mrsh_variable *old = replace_variable(priv, key, var);
+	if (!snapshot_variable(priv, key, old)) {
+		variable_destroy(old);
+	}
+	return var;
+}
+
+/**
+ * Updates the attributes of a variable after its value has changed.
+ */
+static void variable_assigned(struct mrsh_state *state, const char *key,
+		struct mrsh_variable *var, uint32_t attribs) {
+	var->attribs = attribs;
+	update_env(state_get_priv(state), key, var);
+
+	if (strcmp(key, "PATH") == 0) {
+		forget_utilities(state);
+	}
+}
+
 void mrsh_env_set(struct mrsh_state *state,
 		const char *key, const char *value, uint32_t attribs) {
-	struct mrsh_state_priv *priv = state_get_priv(state);
+	struct mrsh_variable *var = assigned_variable(state, key);
+	if (var == NULL) {
+		return;
+	}
+	if (!variable_set_value(var, value)) {
+		// Keep the variable in a consistent state
+		var->value = NULL;
+		var->number_state = VARIABLE_NUMBER_VALID;
+		var->number = 0;
+	}
+	variable_assigned(state, key, var, attribs);
+}
 
-	struct mrsh_variable *var = calloc(1, sizeof(struct mrsh_variable));
-	if (!var) {
+void env_set_number(struct mrsh_state *state, const char *key, long number,
+		uint32_t attribs) {
+	struct mrsh_variable *var = assigned_variable(state, key);
+	if (var == NULL) {
 		return;
 	}
-	var->value = strdup(value);
-	var->attribs = attribs;
-	struct mrsh_variable *old = mrsh_hashtable_set(&priv->variables, key, var);
-	variable_destroy(old);
+	var->value = NULL;
+	var->number_state = VARIABLE_NUMBER_VALID;
+	var->number = number;
+	variable_assigned(state, key, var, attribs);
 }
 
 void mrsh_env_unset(struct mrsh_state *state, const char *key) {
 	struct mrsh_state_priv *priv = state_get_priv(state);
 
-	variable_destroy(mrsh_hashtable_del(&priv->variables, key));
+	struct mrsh_variable *old = replace_variable(priv, key, NULL);
+	if (!snapshot_variable(priv, key, old)) {
+		variable_destroy(old);
+	}
+
+	if (strcmp(key, "PATH") == 0) {
+		forget_utilities(state);
+	}
 }
 
 const char *mrsh_env_get(struct mrsh_state *state,
@@ -145,7 +413,114 @@ const char *mrsh_env_get(struct mrsh_state *state,
 	if (var && attribs) {
 		*attribs = var->attribs;
 	}
-	return var ? var->value : NULL;
+	return var ? variable_get_value(var) : NULL;
+}
+
+bool env_get_attribs(struct mrsh_state *state, const char *key,
+		uint32_t *attribs) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	struct mrsh_variable *var = mrsh_hashtable_get(&priv->variables, key);
+	if (var == NULL) {
+		return false;
+	}
+	*attribs = var->attribs;
+	return true;
+}
+
+bool env_get_number(struct mrsh_state *state, const char *key, long *number,
+		uint32_t *attribs) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	struct mrsh_variable *var = mrsh_hashtable_get(&priv->variables, key);
+	if (var == NULL) {
+		return false;
+	}
+	if (attribs) {
+		*attribs = var->attribs;
+	}
+
+	if (var->number_state == VARIABLE_NUMBER_UNKNOWN) {
+		char *end;
+		var->number = strtod(var->value, &end);
+		var->number_state = end == var->value || end[0] != '\0' ?
+			VARIABLE_NUMBER_INVALID : VARIABLE_NUMBER_VALID;
+	}
+	*number = var->number;
+	return var->number_state == VARIABLE_NUMBER_VALID;
+}
+
+bool snapshot_save(struct mrsh_state *state, struct mrsh_snapshot *snapshot,
+		bool save_cwd, bool save_umask) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	*snapshot = (struct mrsh_snapshot){
+		.prev = priv->snapshot,
+		.exit = state->exit,
+		.last_status = state->last_status,
+		.options = state->options,
+		.cwd_fd = -1,
+	};
+	if (save_cwd) {
+		snapshot->cwd_fd = open(".", O_RDONLY | O_CLOEXEC);
+		if (snapshot->cwd_fd < 0) {
+			perror("open");
+			return false;
+		}
+	}
+	if (save_umask) {
+		snapshot->umask = umask(0);
+		umask(snapshot->umask);
+		snapshot->umask_saved = true;
+	}
+
+	priv->snapshot = snapshot;
+	return true;
+}
+
+static void restore_variable_iterator(const char *key, void *_var,
+		void *data) {
+	struct mrsh_state *state = data;
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	struct mrsh_variable *var = _var;
+
+	struct mrsh_variable *current;
+	if (var->value == NULL && var->number_state != VARIABLE_NUMBER_VALID) {
+		current = replace_variable(priv, key, NULL);
+		free(var);
+	} else {
+		current = replace_variable(priv, key, var);
+	}
+	variable_destroy(current);
+
+	if (strcmp(key, "PATH") == 0) {
+		forget_utilities(state);
+	}
+}
+
+void snapshot_restore(struct mrsh_state *state,
+		struct mrsh_snapshot *snapshot) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	assert(priv->snapshot == snapshot);
+	priv->snapshot = snapshot->prev;
+
+	mrsh_hashtable_for_each(&snapshot->variables, restore_variable_iterator,
+		state);
+	mrsh_hashtable_finish(&snapshot->variables);
+
+	if (snapshot->cwd_fd >= 0) {
+		if (fchdir(snapshot->cwd_fd) != 0) {
+			perror("fchdir");
+		}
+		close(snapshot->cwd_fd);
+	}
+	if (snapshot->umask_saved) {
+		umask(snapshot->umask);
+	}
+
+	state->exit = snapshot->exit;
+	state->last_status = snapshot->last_status;
+	state->options = snapshot->options;
 }
 
 struct mrsh_call_frame_priv *call_frame_get_priv(struct mrsh_call_frame *frame) {
@@ -169,3 +544,30 @@ void pop_frame(struct mrsh_state *state) {
 	state->frame = frame->prev;
 	call_frame_destroy(frame);
 }
+
+int create_temp_file(struct mrsh_state *state) {
+	const char *dir = mrsh_env_get(state, "TMPDIR", NULL);
+	if (dir == NULL || dir[0] == '\0') {
+		dir = "/tmp";
+	}
+
+	const char template[] = "/mrsh-XXXXXX";
+	size_t dir_len = strlen(dir);
+	char *path = malloc(dir_len + sizeof(template));
+	if (path == NULL) {
+		return -1;
+	}
+	memcpy(path, dir, dir_len);
+	memcpy(path + dir_len, template, sizeof(template));
+
+	int fd = mkstemp(path);
+	if (fd >= 0) {
+		unlink(path);
+		if (fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	free(path);
+	return fd;
+}
@@ -0,0 +1,542 @@
+#define _POSIX_C_SOURCE 200809L
+#include <mrsh/buffer.h>
+#include <mrsh/builtin.h>
+#include <mrsh/parser.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shell/bytecode.h"
+#include "shell/pattern.h"
+#include "shell/word.h"
+
+// Characters which make an unquoted string subject to an expansion
+#define ASSIGNMENT_SPECIAL_CHARS "~"
+#define PATTERN_SPECIAL_CHARS "~"
+
+struct compiler {
+	struct bytecode *code;
+	size_t depth; // number of blocks entered at the current instruction
+	bool failed;
+};
+
+static struct bytecode_instr *emit(struct compiler *c, enum bytecode_op op,
+		bool tail) {
+	struct bytecode *code = c->code;
+	if (code->len == code->cap) {
+		size_t cap = code->cap == 0 ? 16 : 2 * code->cap;
+		struct bytecode_instr *instrs =
+			realloc(code->instrs, cap * sizeof(struct bytecode_instr));
+		if (instrs == NULL) {
+			c->failed = true;
+			return NULL;
+		}
+		code->instrs = instrs;
+		code->cap = cap;
+	}
+
+	struct bytecode_instr *instr = &code->instrs[code->len++];
+	memset(instr, 0, sizeof(*instr));
+	instr->op = op;
+	instr->tail = tail;
+	return instr;
+}
+
+/**
+ * Make the jump instruction at `index` jump to the next instruction.
+ */
+static void patch_jump(struct compiler *c, size_t index) {
+	if (index < c->code->len) {
+		c->code->instrs[index].target = c->code->len;
+	}
+}
+
+static void enter_block(struct compiler *c) {
+	c->depth++;
+	if (c->depth > c->code->max_depth) {
+		c->code->max_depth = c->depth;
+	}
+}
+
+static bool append_literal(struct mrsh_buffer *buf,
+		const struct mrsh_word *word, bool quoted, const char *special) {
+	switch (word->type) {
+	case MRSH_WORD_STRING:;
+		const struct mrsh_word_string *ws = mrsh_word_get_string(word);
+		if (!quoted && !ws->single_quoted &&
+				strpbrk(ws->str, special) != NULL) {
+			return false;
+		}
+		return mrsh_buffer_append(buf, ws->str, strlen(ws->str));
+	case MRSH_WORD_LIST:;
+		const struct mrsh_word_list *wl = mrsh_word_get_list(word);
+		for (size_t i = 0; i < wl->children.len; ++i) {
+			const struct mrsh_word *child = wl->children.data[i];
+			if (!append_literal(buf, child, quoted || wl->double_quoted,
+					special)) {
+				return false;
+			}
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Returns the string a word always expands to, or NULL if its expansion depends
+ * on the shell state. Unquoted strings containing one of the `special`
+ * characters aren't considered literal.
+ */
+static char *literal_word(const struct mrsh_word *word, bool quoted,
+		const char *special) {
+	struct mrsh_buffer buf = {0};
+	if (!append_literal(&buf, word, quoted, special) ||
+			!mrsh_buffer_append_char(&buf, '\0')) {
+		mrsh_buffer_finish(&buf);
+		return NULL;
+	}
+	return mrsh_buffer_steal(&buf);
+}
+
+/**
+ * Parses the arithmetic expansion `word` if its expression is a constant
+ * string. Returns NULL otherwise.
+ */
+static struct mrsh_arithm_expr *constant_arithm(const struct mrsh_word *word) {
+	if (word->type != MRSH_WORD_ARITHMETIC) {
+		return NULL;
+	}
+	const struct mrsh_word_arithmetic *wa = mrsh_word_get_arithmetic(word);
+
+	// The body isn't subject to tilde and pathname expansion
+	char *body = literal_word(wa->body, true, "");
+	if (body == NULL) {
+		return NULL;
+	}
+	struct mrsh_parser *parser = mrsh_parser_with_data(body, strlen(body));
+	struct mrsh_arithm_expr *expr = mrsh_parse_arithm_expr(parser);
+	mrsh_parser_destroy(parser);
+	free(body);
+	return expr;
+}
+
+static void free_argv(char **argv) {
+	for (size_t i = 0; argv[i] != NULL; ++i) {
+		free(argv[i]);
+	}
+	free(argv);
+}
+
+/**
+ * Returns the arguments of a simple command invoking a builtin, if they're all
+ * literal words.
+ */
+static char **literal_builtin_argv(const struct mrsh_simple_command *sc) {
+	char **argv = calloc(sc->arguments.len + 2, sizeof(char *));
+	if (argv == NULL) {
+		return NULL;
+	}
+
+	if (!sc->name->literal) {
+		free(argv);
+		return NULL;
+	}
+	argv[0] = mrsh_word_str(sc->name);
+	if (!mrsh_has_builtin(argv[0])) {
+		free_argv(argv);
+		return NULL;
+	}
+	for (size_t i = 0; i < sc->arguments.len; ++i) {
+		const struct mrsh_word *arg = sc->arguments.data[i];
+		argv[i + 1] = arg->literal ? mrsh_word_str(arg) : NULL;
+		if (argv[i + 1] == NULL) {
+			free_argv(argv);
+			return NULL;
+		}
+	}
+	return argv;
+}
+
+static void compile_simple_command(struct compiler *c,
+		struct mrsh_pipeline *pl, bool tail) {
+	struct mrsh_simple_command *sc =
+		mrsh_command_get_simple_command(pl->commands.data[0]);
+
+	if (sc->io_redirects.len > 0) {
+		goto generic;
+	}
+
+	if (sc->name == NULL && sc->assignments.len == 1) {
+		struct mrsh_assignment *assign = sc->assignments.data[0];
+		char *value = literal_word(assign->value, false,
+			ASSIGNMENT_SPECIAL_CHARS);
+		struct mrsh_arithm_expr *expr = NULL;
+		if (value == NULL) {
+			expr = constant_arithm(assign->value);
+		}
+		if (value == NULL && expr == NULL) {
+			goto generic;
+		}
+
+		struct bytecode_instr *instr =
+			emit(c, value != NULL ? BC_ASSIGN : BC_ASSIGN_ARITHM, tail);
+		if (instr == NULL) {
+			free(value);
+			mrsh_arithm_expr_destroy(expr);
+			return;
+		}
+		instr->pipeline = pl;
+		instr->arg.assign.name = assign->name;
+		instr->arg.assign.value = value;
+		instr->arg.assign.expr = expr;
+		return;
+	}
+
+	if (sc->name != NULL && sc->assignments.len == 0) {
+		char **argv = literal_builtin_argv(sc);
+		if (argv == NULL) {
+			goto generic;
+		}
+
+		struct bytecode_instr *instr = emit(c, BC_BUILTIN, tail);
+		if (instr == NULL) {
+			free_argv(argv);
+			return;
+		}
+		instr->pipeline = pl;
+		instr->arg.builtin.argc = sc->arguments.len + 1;
+		instr->arg.builtin.argv = argv;
+		return;
+	}
+
+generic:;
+	struct bytecode_instr *instr = emit(c, BC_SIMPLE_COMMAND, tail);
+	if (instr != NULL) {
+		instr->pipeline = pl;
+	}
+}
+
+static void compile_command_list_array(struct compiler *c,
+	struct mrsh_array *array, bool tail);
+static void compile_command(struct compiler *c, struct mrsh_command *cmd,
+	bool tail);
+
+static void compile_if_clause(struct compiler *c, struct mrsh_if_clause *ic,
+		bool tail) {
+	compile_command_list_array(c, &ic->condition, false);
+	size_t jump_else = c->code->len;
+	emit(c, BC_JUMP_IF_NONZERO, false);
+
+	compile_command_list_array(c, &ic->body, tail);
+	size_t jump_end = c->code->len;
+	emit(c, BC_JUMP, false);
+
+	patch_jump(c, jump_else);
+	if (ic->else_part != NULL) {
+		compile_command(c, ic->else_part, tail);
+	} else {
+		emit(c, BC_CLEAR, false);
+	}
+	patch_jump(c, jump_end);
+}
+
+static void compile_loop_clause(struct compiler *c,
+		struct mrsh_loop_clause *lc) {
+	enter_block(c);
+	size_t begin = c->code->len;
+	emit(c, BC_LOOP_BEGIN, false);
+	size_t test = c->code->len;
+	emit(c, BC_LOOP_TEST, false);
+
+	compile_command_list_array(c, &lc->condition, false);
+	size_t jump_end = c->code->len;
+	switch (lc->type) {
+	case MRSH_LOOP_WHILE:
+		emit(c, BC_JUMP_IF_NONZERO, false);
+		break;
+	case MRSH_LOOP_UNTIL:
+		emit(c, BC_JUMP_IF_ZERO, false);
+		break;
+	}
+
+	compile_command_list_array(c, &lc->body, false);
+	struct bytecode_instr *next = emit(c, BC_LOOP_NEXT, false);
+	if (next != NULL) {
+		next->target = test;
+	}
+
+	patch_jump(c, begin);
+	patch_jump(c, test);
+	patch_jump(c, jump_end);
+	emit(c, BC_LOOP_END, false);
+	c->depth--;
+}
+
+static void compile_for_clause(struct compiler *c,
+		struct mrsh_for_clause *fc) {
+	enter_block(c);
+	size_t begin = c->code->len;
+	struct bytecode_instr *instr = emit(c, BC_FOR_BEGIN, false);
+	if (instr != NULL) {
+		instr->arg.for_clause = fc;
+	}
+	size_t next_field = c->code->len;
+	instr = emit(c, BC_FOR_NEXT, false);
+	if (instr != NULL) {
+		instr->arg.for_clause = fc;
+	}
+
+	compile_command_list_array(c, &fc->body, false);
+	struct bytecode_instr *next = emit(c, BC_LOOP_NEXT, false);
+	if (next != NULL) {
+		next->target = next_field;
+	}
+
+	patch_jump(c, begin);
+	patch_jump(c, next_field);
+	emit(c, BC_LOOP_END, false);
+	c->depth--;
+}
+
+/**
+ * Prepares the matcher of a case pattern if it doesn't need to be expanded.
+ */
+static void compile_case_pattern(struct bytecode_instr *instr,
+		struct mrsh_word *word) {
+	instr->arg.pattern.word = word;
+
+	char *literal = literal_word(word, false, PATTERN_SPECIAL_CHARS);
+	if (literal == NULL) {
+		return;
+	}
+	char *pattern_str = word_to_pattern(word);
+	if (pattern_str == NULL) {
+		instr->arg.pattern.literal = literal;
+		return;
+	}
+	free(literal);
+	// Falls back to match_case_pattern if out of memory
+	instr->arg.pattern.compiled = pattern_compile(pattern_str);
+	free(pattern_str);
+}
+
+static void compile_case_clause(struct compiler *c,
+		struct mrsh_case_clause *cc, bool tail) {
+	enter_block(c);
+	struct bytecode_instr *instr = emit(c, BC_CASE_BEGIN, false);
+	if (instr != NULL) {
+		instr->arg.case_clause = cc;
+	}
+
+	// Jumps to the end of the clause are chained through their targets until
+	// the end is known
+	size_t jumps_end = SIZE_MAX;
+	for (size_t i = 0; i < cc->items.len; ++i) {
+		struct mrsh_case_item *ci = cc->items.data[i];
+
+		size_t first_match = c->code->len;
+		for (size_t j = 0; j < ci->patterns.len; ++j) {
+			instr = emit(c, BC_CASE_MATCH, false);
+			if (instr != NULL) {
+				compile_case_pattern(instr, ci->patterns.data[j]);
+			}
+		}
+		size_t jump_next = c->code->len;
+		emit(c, BC_JUMP, false);
+
+		for (size_t j = first_match; j < jump_next; ++j) {
+			patch_jump(c, j);
+		}
+		emit(c, BC_CASE_END, false);
+		compile_command_list_array(c, &ci->body, tail);
+		instr = emit(c, BC_JUMP, false);
+		if (instr != NULL) {
+			instr->target = jumps_end;
+			jumps_end = c->code->len - 1;
+		}
+
+		patch_jump(c, jump_next);
+	}
+
+	// None of the patterns match
+	emit(c, BC_CASE_END, false);
+	c->depth--;
+
+	while (jumps_end != SIZE_MAX) {
+		size_t prev = c->code->instrs[jumps_end].target;
+		patch_jump(c, jumps_end);
+		jumps_end = prev;
+	}
+}
+
+static void compile_command(struct compiler *c, struct mrsh_command *cmd,
+		bool tail) {
+	switch (cmd->type) {
+	case MRSH_BRACE_GROUP:;
+		struct mrsh_brace_group *bg = mrsh_command_get_brace_group(cmd);
+		compile_command_list_array(c, &bg->body, tail);
+		return;
+	case MRSH_IF_CLAUSE:;
+		struct mrsh_if_clause *ic = mrsh_command_get_if_clause(cmd);
+		compile_if_clause(c, ic, tail);
+		return;
+	case MRSH_LOOP_CLAUSE:;
+		struct mrsh_loop_clause *lc = mrsh_command_get_loop_clause(cmd);
+		compile_loop_clause(c, lc);
+		return;
+	case MRSH_FOR_CLAUSE:;
+		struct mrsh_for_clause *fc = mrsh_command_get_for_clause(cmd);
+		compile_for_clause(c, fc);
+		return;
+	case MRSH_CASE_CLAUSE:;
+		struct mrsh_case_clause *cc = mrsh_command_get_case_clause(cmd);
+		compile_case_clause(c, cc, tail);
+		return;
+	case MRSH_SIMPLE_COMMAND:
+	case MRSH_SUBSHELL:
+	case MRSH_FUNCTION_DEFINITION:;
+		struct bytecode_instr *instr = emit(c, BC_COMMAND, tail);
+		if (instr != NULL) {
+			instr->arg.command = cmd;
+		}
+		return;
+	}
+	abort();
+}
+
+static void compile_pipeline(struct compiler *c, struct mrsh_pipeline *pl,
+		bool tail) {
+	struct mrsh_command *cmd = pl->commands.data[0];
+	if (pl->commands.len > 1 || cmd->type == MRSH_SUBSHELL ||
+			cmd->type == MRSH_FUNCTION_DEFINITION) {
+		struct bytecode_instr *instr = emit(c, BC_PIPELINE, tail);
+		if (instr != NULL) {
+			instr->pipeline = pl;
+		}
+		return;
+	}
+
+	// The exit status needs to be negated after the command has run
+	bool cmd_tail = tail && !pl->bang;
+	if (cmd->type == MRSH_SIMPLE_COMMAND) {
+		compile_simple_command(c, pl, cmd_tail);
+	} else {
+		enter_block(c);
+		struct bytecode_instr *instr = emit(c, BC_JOB_BEGIN, false);
+		if (instr != NULL) {
+			instr->pipeline = pl;
+		}
+		compile_command(c, cmd, cmd_tail);
+		emit(c, BC_JOB_END, false);
+		c->depth--;
+	}
+
+	if (pl->bang) {
+		emit(c, BC_NOT, false);
+	}
+}
+
+static void compile_and_or_list(struct compiler *c,
+		struct mrsh_and_or_list *and_or_list, bool tail) {
+	switch (and_or_list->type) {
+	case MRSH_AND_OR_LIST_PIPELINE:;
+		struct mrsh_pipeline *pl = mrsh_and_or_list_get_pipeline(and_or_list);
+		compile_pipeline(c, pl, tail);
+		return;
+	case MRSH_AND_OR_LIST_BINOP:;
+		struct mrsh_binop *binop = mrsh_and_or_list_get_binop(and_or_list);
+		size_t left = c->code->len;
+		compile_and_or_list(c, binop->left, false);
+		size_t jump_end = c->code->len;
+		struct bytecode_instr *instr = emit(c,
+			binop->type == MRSH_BINOP_AND ? BC_AND : BC_OR, false);
+		if (instr != NULL) {
+			instr->arg.left = left;
+		}
+		compile_and_or_list(c, binop->right, tail);
+		patch_jump(c, jump_end);
+		return;
+	}
+	abort();
+}
+
+/**
+ * Emits nothing for an empty array: the status is left unchanged.
+ */
+static void compile_command_list_array(struct compiler *c,
+		struct mrsh_array *array, bool tail) {
+	for (size_t i = 0; i < array->len; ++i) {
+		struct mrsh_command_list *list = array->data[i];
+		if (list->ampersand) {
+			struct bytecode_instr *instr = emit(c, BC_ASYNC, false);
+			if (instr != NULL) {
+				instr->arg.list = list;
+			}
+		} else {
+			compile_and_or_list(c, list->and_or_list,
+				tail && i == array->len - 1);
+		}
+		emit(c, BC_LIST_END, false);
+	}
+}
+
+static struct bytecode *compiler_begin(struct compiler *c) {
+	*c = (struct compiler){0};
+	c->code = calloc(1, sizeof(struct bytecode));
+	return c->code;
+}
+
+static struct bytecode *compiler_finish(struct compiler *c) {
+	emit(c, BC_END, false);
+	if (c->failed) {
+		bytecode_destroy(c->code);
+		return NULL;
+	}
+	return c->code;
+}
+
+struct bytecode *bytecode_compile_program(struct mrsh_program *prog) {
+	struct compiler c;
+	if (compiler_begin(&c) == NULL) {
+		return NULL;
+	}
+	compile_command_list_array(&c, &prog->body, true);
+	return compiler_finish(&c);
+}
+
+struct bytecode *bytecode_compile_command(struct mrsh_command *cmd) {
+	struct compiler c;
+	if (compiler_begin(&c) == NULL) {
+		return NULL;
+	}
+	compile_command(&c, cmd, true);
+	return compiler_finish(&c);
+}
+
+void bytecode_destroy(struct bytecode *code) {
+	if (code == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < code->len; ++i) {
+		struct bytecode_instr *instr = &code->instrs[i];
+		switch (instr->op) {
+		case BC_BUILTIN:
+			free_argv(instr->arg.builtin.argv);
+			break;
+		case BC_ASSIGN:
+		case BC_ASSIGN_ARITHM:
+			free(instr->arg.assign.value);
+			mrsh_arithm_expr_destroy(instr->arg.assign.expr);
+			break;
+		case BC_CASE_MATCH:
+			free(instr->arg.pattern.literal);
+			pattern_destroy(instr->arg.pattern.compiled);
+			break;
+		default:
+			break;
+		}
+	}
+	free(code->instrs);
+	free(code);
+}
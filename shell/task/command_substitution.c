@@ -0,0 +1,518 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <mrsh/builtin.h>
+#include <mrsh/buffer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "shell/process.h"
+#include "shell/task.h"
+#include "shell/trap.h"
+
+#define READ_SIZE 4096
+
+static bool buffer_read_from(struct mrsh_buffer *buf, int fd) {
+	while (true) {
+		char *dst = mrsh_buffer_reserve(buf, READ_SIZE);
+
+		ssize_t n = read(fd, dst, READ_SIZE);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n < 0) {
+			perror("read");
+			return false;
+		} else if (n == 0) {
+			break;
+		}
+
+		buf->len += n;
+	}
+
+	return true;
+}
+
+/**
+ * Returns the string of a word which doesn't need any expansion, or NULL.
+ */
+static const char *word_literal(const struct mrsh_word *word) {
+	bool quoted = false;
+	while (word->type == MRSH_WORD_LIST) {
+		struct mrsh_word_list *wl = mrsh_word_get_list(word);
+		if (wl->children.len != 1) {
+			return NULL;
+		}
+		quoted = quoted || wl->double_quoted;
+		word = wl->children.data[0];
+	}
+	if (word->type != MRSH_WORD_STRING) {
+		return NULL;
+	}
+	struct mrsh_word_string *ws = mrsh_word_get_string(word);
+	if (!quoted && !ws->single_quoted && strpbrk(ws->str, "*?[~") != NULL) {
+		return NULL;
+	}
+	return ws->str;
+}
+
+static bool naive_word_streq(struct mrsh_word *word, const char *str) {
+	const char *literal = word_literal(word);
+	return literal != NULL && strcmp(literal, str) == 0;
+}
+
+static bool is_print_traps(struct mrsh_program *program) {
+	if (program->body.len != 1) {
+		return false;
+	}
+	struct mrsh_command_list *cl = program->body.data[0];
+	if (cl->ampersand || cl->and_or_list->type != MRSH_AND_OR_LIST_PIPELINE) {
+		return false;
+	}
+	struct mrsh_pipeline *pipeline =
+		mrsh_and_or_list_get_pipeline(cl->and_or_list);
+	if (pipeline->bang || pipeline->commands.len != 1) {
+		return false;
+	}
+	struct mrsh_command *cmd = pipeline->commands.data[0];
+	if (cmd->type != MRSH_SIMPLE_COMMAND) {
+		return false;
+	}
+	struct mrsh_simple_command *sc = mrsh_command_get_simple_command(cmd);
+	if (sc->name == NULL || !naive_word_streq(sc->name, "trap")) {
+		return false;
+	}
+	if (sc->arguments.len == 1) {
+		struct mrsh_word *arg = sc->arguments.data[0];
+		return naive_word_streq(arg, "--");
+	} else {
+		return sc->arguments.len == 0;
+	}
+}
+
+/**
+ * Builtins which only modify variables or positional parameters, or have no
+ * side effect at all.
+ */
+static const char *restorable_builtins[] = {
+	":", "[", "echo", "exit", "export", "false", "getopts", "hash", "printf",
+	"pwd", "read", "readonly", "shift", "test", "true", "type",
+};
+
+/**
+ * State of the check performed before running a command substitution in the
+ * shell process.
+ */
+struct in_process_check {
+	struct mrsh_state *state;
+	int loops, functions; // nesting levels
+	struct mrsh_array visiting; // struct mrsh_function *
+	bool cwd, umask; // whether these need to be saved
+};
+
+static bool check_command_list_array(struct in_process_check *check,
+	const struct mrsh_array *array);
+static bool check_command(struct in_process_check *check,
+	const struct mrsh_command *cmd);
+
+static bool check_function(struct in_process_check *check,
+		struct mrsh_function *fn) {
+	for (size_t i = 0; i < check->visiting.len; ++i) {
+		if (check->visiting.data[i] == fn) {
+			return true; // recursive call, already being checked
+		}
+	}
+
+	mrsh_array_add(&check->visiting, fn);
+	int loops = check->loops;
+	check->loops = 0;
+	++check->functions;
+	bool ok = check_command(check, fn->body);
+	--check->functions;
+	check->loops = loops;
+	--check->visiting.len;
+	return ok;
+}
+
+static bool check_set_arguments(const struct mrsh_array *arguments) {
+	for (size_t i = 0; i < arguments->len; ++i) {
+		const char *arg = word_literal(arguments->data[i]);
+		if (arg == NULL) {
+			return false;
+		}
+		if ((arg[0] != '-' && arg[0] != '+') || strcmp(arg, "--") == 0) {
+			return true; // the remaining arguments are positional parameters
+		}
+		// Enabling or disabling job control can't be undone for free
+		if (strcmp(&arg[1], "o") == 0 || strchr(arg, 'm') != NULL) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool check_simple_command(struct in_process_check *check,
+		const struct mrsh_simple_command *sc) {
+	if (sc->name == NULL) {
+		return true;
+	}
+	const char *name = word_literal(sc->name);
+	if (name == NULL) {
+		return false;
+	}
+
+	// Same lookup order as run_simple_command
+	struct mrsh_state_priv *priv = state_get_priv(check->state);
+	struct mrsh_function *fn = mrsh_hashtable_get(&priv->functions, name);
+	if (fn != NULL) {
+		return check_function(check, fn);
+	} else if (!mrsh_has_builtin(name)) {
+		return false;
+	}
+
+	for (size_t i = 0; i < sizeof(restorable_builtins) /
+			sizeof(restorable_builtins[0]); ++i) {
+		if (strcmp(name, restorable_builtins[i]) == 0) {
+			return true;
+		}
+	}
+
+	if (strcmp(name, "break") == 0 || strcmp(name, "continue") == 0) {
+		return check->loops > 0;
+	} else if (strcmp(name, "return") == 0) {
+		return check->functions > 0;
+	} else if (strcmp(name, "cd") == 0) {
+		check->cwd = true;
+		return true;
+	} else if (strcmp(name, "umask") == 0) {
+		check->umask = true;
+		return true;
+	} else if (strcmp(name, "set") == 0) {
+		return check_set_arguments(&sc->arguments);
+	} else if (strcmp(name, "unset") == 0) {
+		// Functions can't be unset, the function table isn't saved
+		for (size_t i = 0; i < sc->arguments.len; ++i) {
+			const char *arg = word_literal(sc->arguments.data[i]);
+			if (arg == NULL || (arg[0] == '-' && strcmp(arg, "-v") != 0)) {
+				return false;
+			}
+		}
+		return true;
+	} else if (strcmp(name, "command") == 0) {
+		// Only `command -v` and `command -V`, which don't run anything
+		if (sc->arguments.len == 0) {
+			return false;
+		}
+		const char *arg = word_literal(sc->arguments.data[0]);
+		return arg != NULL &&
+			(strcmp(arg, "-v") == 0 || strcmp(arg, "-V") == 0);
+	}
+	return false;
+}
+
+static bool check_and_or_list(struct in_process_check *check,
+		const struct mrsh_and_or_list *and_or_list) {
+	switch (and_or_list->type) {
+	case MRSH_AND_OR_LIST_PIPELINE:;
+		struct mrsh_pipeline *pl = mrsh_and_or_list_get_pipeline(and_or_list);
+		// Pipelines are forked anyway
+		return pl->commands.len == 1 && check_command(check, pl->commands.data[0]);
+	case MRSH_AND_OR_LIST_BINOP:;
+		struct mrsh_binop *binop = mrsh_and_or_list_get_binop(and_or_list);
+		return check_and_or_list(check, binop->left) &&
+			check_and_or_list(check, binop->right);
+	}
+	abort();
+}
+
+static bool check_command_list_array(struct in_process_check *check,
+		const struct mrsh_array *array) {
+	for (size_t i = 0; i < array->len; ++i) {
+		struct mrsh_command_list *list = array->data[i];
+		if (list->ampersand ||
+				!check_and_or_list(check, list->and_or_list)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool check_command(struct in_process_check *check,
+		const struct mrsh_command *cmd) {
+	switch (cmd->type) {
+	case MRSH_SIMPLE_COMMAND:;
+		struct mrsh_simple_command *sc = mrsh_command_get_simple_command(cmd);
+		return check_simple_command(check, sc);
+	case MRSH_BRACE_GROUP:;
+		struct mrsh_brace_group *bg = mrsh_command_get_brace_group(cmd);
+		return check_command_list_array(check, &bg->body);
+	case MRSH_IF_CLAUSE:;
+		struct mrsh_if_clause *ic = mrsh_command_get_if_clause(cmd);
+		return check_command_list_array(check, &ic->condition) &&
+			check_command_list_array(check, &ic->body) &&
+			(ic->else_part == NULL || check_command(check, ic->else_part));
+	case MRSH_LOOP_CLAUSE:;
+		struct mrsh_loop_clause *lc = mrsh_command_get_loop_clause(cmd);
+		++check->loops;
+		bool loop_ok = check_command_list_array(check, &lc->condition) &&
+			check_command_list_array(check, &lc->body);
+		--check->loops;
+		return loop_ok;
+	case MRSH_FOR_CLAUSE:;
+		struct mrsh_for_clause *fc = mrsh_command_get_for_clause(cmd);
+		++check->loops;
+		bool for_ok = check_command_list_array(check, &fc->body);
+		--check->loops;
+		return for_ok;
+	case MRSH_CASE_CLAUSE:;
+		struct mrsh_case_clause *cc = mrsh_command_get_case_clause(cmd);
+		for (size_t i = 0; i < cc->items.len; ++i) {
+			struct mrsh_case_item *ci = cc->items.data[i];
+			if (!check_command_list_array(check, &ci->body)) {
+				return false;
+			}
+		}
+		return true;
+	case MRSH_SUBSHELL:
+	case MRSH_FUNCTION_DEFINITION:
+		return false;
+	}
+	abort();
+}
+
+/**
+ * Returns the file used to capture the output of a command substitution at the
+ * current nesting level, creating it if necessary. The output of builtins is
+ * written to a file descriptor, and unlike a pipe, a file can't fill up before
+ * it's read.
+ */
+static int get_capture_fd(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	if (priv->capture_depth < priv->capture_fds_len) {
+		return priv->capture_fds[priv->capture_depth];
+	}
+
+	int fd = create_temp_file(state);
+	if (fd < 0) {
+		return -1;
+	}
+
+	int *fds = realloc(priv->capture_fds,
+		(priv->capture_fds_len + 1) * sizeof(int));
+	if (fds == NULL) {
+		close(fd);
+		return -1;
+	}
+	fds[priv->capture_fds_len++] = fd;
+	priv->capture_fds = fds;
+	return fd;
+}
+
+/**
+ * Runs a command substitution without forking, if all of its commands are
+ * builtins or functions whose effects on the shell state can be undone.
+ * Returns false if the command substitution needs to run in a subshell.
+ */
+static bool run_in_process(struct mrsh_context *ctx,
+		struct mrsh_program *prog, struct mrsh_buffer *buf, int *status) {
+	struct mrsh_state *state = ctx->state;
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	// A command substitution containing a single trap command prints the
+	// traps of the parent shell
+	struct in_process_check check = { .state = state };
+	bool ok = is_print_traps(prog) ||
+		check_command_list_array(&check, &prog->body);
+	mrsh_array_finish(&check.visiting);
+	if (!ok) {
+		return false;
+	}
+
+	// Without a capture file, e.g. if the temporary directory isn't
+	// writable, fall back to a subshell
+	int capture_fd = get_capture_fd(state);
+	if (capture_fd < 0) {
+		return false;
+	}
+
+	struct mrsh_snapshot snapshot;
+	if (!snapshot_save(state, &snapshot, check.cwd, check.umask)) {
+		return false;
+	}
+	fflush(stdout);
+	int stdout_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	if (stdout_fd < 0 || dup2(capture_fd, STDOUT_FILENO) < 0) {
+		if (stdout_fd >= 0) {
+			close(stdout_fd);
+		}
+		snapshot_restore(state, &snapshot);
+		return false;
+	}
+	++priv->capture_depth;
+
+	// Positional parameters, loops and branches are isolated in a new frame
+	struct mrsh_call_frame *frame = state->frame;
+	push_frame(state, frame->argc, (const char **)frame->argv);
+
+	struct mrsh_context child_ctx = *ctx;
+	child_ctx.tail = false;
+	int ret = run_command_list_array(&child_ctx, &prog->body);
+	fflush(stdout);
+	if (state->exit >= 0) {
+		*status = state->exit;
+	} else {
+		*status = ret >= 0 ? ret : 1;
+	}
+
+	pop_frame(state);
+	--priv->capture_depth;
+	dup2(stdout_fd, STDOUT_FILENO);
+	close(stdout_fd);
+	snapshot_restore(state, &snapshot);
+
+	if (lseek(capture_fd, 0, SEEK_SET) < 0 ||
+			!buffer_read_from(buf, capture_fd) ||
+			ftruncate(capture_fd, 0) != 0 ||
+			lseek(capture_fd, 0, SEEK_SET) < 0) {
+		perror("failed to read command substitution output");
+		*status = TASK_STATUS_ERROR;
+	}
+	return true;
+}
+
+/**
+ * The output of a command substitution run in a subshell, which is read as it
+ * is written.
+ */
+struct command_output {
+	struct mrsh_process *process;
+	int fd; // -1 once the whole output has been read
+};
+
+static struct command_output *start_subshell(struct mrsh_context *ctx,
+		struct mrsh_program *prog) {
+	struct command_output *out = calloc(1, sizeof(struct command_output));
+	if (out == NULL) {
+		return NULL;
+	}
+
+	int fds[2];
+	if (pipe(fds) != 0) {
+		perror("pipe");
+		free(out);
+		return NULL;
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		free(out);
+		return NULL;
+	} else if (pid == 0) {
+		close(fds[0]);
+
+		if (fds[1] != STDOUT_FILENO) {
+			dup2(fds[1], STDOUT_FILENO);
+			close(fds[1]);
+		}
+
+		init_job_child_process(ctx->state);
+
+		// When a subshell is entered, traps that are not being ignored shall
+		// be set to the default actions, except in the case of a command
+		// substitution containing only a single trap command, when the traps
+		// need not be altered.
+		if (!is_print_traps(prog)) {
+			reset_caught_traps(ctx->state);
+		}
+
+		mrsh_run_program(ctx->state, prog);
+
+		exit(ctx->state->exit >= 0 ? ctx->state->exit : 0);
+	}
+
+	out->process = process_create(ctx->state, pid);
+	close(fds[1]);
+	out->fd = fds[0];
+	return out;
+}
+
+int command_output_start(struct mrsh_context *ctx, struct mrsh_program *prog,
+		struct mrsh_buffer *buf, struct command_output **out) {
+	*out = NULL;
+	if (prog == NULL) {
+		return 0;
+	}
+
+	// The command may change the directories listed for the expansion in
+	// progress
+	if (ctx->glob_cache != NULL) {
+		glob_cache_finish(ctx->glob_cache);
+	}
+
+	int status;
+	if (run_in_process(ctx, prog, buf, &status)) {
+		return status;
+	}
+
+	*out = start_subshell(ctx, prog);
+	return *out != NULL ? 0 : TASK_STATUS_ERROR;
+}
+
+int command_output_read(struct command_output *out, struct mrsh_buffer *buf) {
+	if (out->fd < 0) {
+		return 0;
+	}
+
+	while (true) {
+		char *dst = mrsh_buffer_reserve(buf, READ_SIZE);
+		if (dst == NULL) {
+			return TASK_STATUS_ERROR;
+		}
+
+		ssize_t n = read(out->fd, dst, READ_SIZE);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n < 0) {
+			perror("read");
+			return TASK_STATUS_ERROR;
+		} else if (n == 0) {
+			close(out->fd);
+			out->fd = -1;
+			return 0;
+		}
+
+		buf->len += n;
+		return 1;
+	}
+}
+
+int command_output_finish(struct command_output *out) {
+	if (out->fd >= 0) {
+		// The writer gets SIGPIPE if it isn't done yet
+		close(out->fd);
+	}
+	int ret = job_wait_process(out->process);
+	process_release(out->process);
+	free(out);
+	return ret;
+}
+
+int run_command_substitution(struct mrsh_context *ctx,
+		struct mrsh_program *prog, struct mrsh_buffer *buf) {
+	struct command_output *out;
+	int ret = command_output_start(ctx, prog, buf, &out);
+	if (out == NULL) {
+		return ret;
+	}
+
+	do {
+		ret = command_output_read(out, buf);
+	} while (ret > 0);
+
+	int status = command_output_finish(out);
+	return ret < 0 ? ret : status;
+}
@@ -32,6 +32,8 @@ int run_pipeline(struct mrsh_context *ctx, struct mrsh_pipeline *pl) {
 
 	assert(pl->commands.len > 0);
 	if (pl->commands.len == 1) {
+		// The exit status needs to be negated after the command has run
+		child_ctx.tail = ctx->tail && !pl->bang;
 		int ret = run_command(&child_ctx, pl->commands.data[0]);
 		if (pl->bang && ret >= 0) {
 			ret = !ret;
@@ -64,6 +66,7 @@ int run_pipeline(struct mrsh_context *ctx, struct mrsh_pipeline *pl) {
 			return TASK_STATUS_ERROR;
 		} else if (pid == 0) {
 			priv->child = true;
+			child_ctx.tail = true;
 
 			init_child(&child_ctx, getpid());
 			if (ctx->state->options & MRSH_OPT_MONITOR) {
@@ -126,6 +129,9 @@ int run_pipeline(struct mrsh_context *ctx, struct mrsh_pipeline *pl) {
 			break;
 		}
 	}
+	for (size_t i = 0; i < procs.len; ++i) {
+		process_release(procs.data[i]);
+	}
 	mrsh_array_finish(&procs);
 	if (pl->bang && ret >= 0) {
 		ret = !ret;
@@ -5,22 +5,28 @@
 #include <mrsh/ast.h>
 #include <mrsh/builtin.h>
 #include <mrsh/entry.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "shell/bytecode.h"
 #include "shell/shell.h"
 #include "shell/path.h"
 #include "shell/redir.h"
 #include "shell/word.h"
 #include "shell/task.h"
+#include "shell/trap.h"
 
-static void populate_env_iterator(const char *key, void *_var, void *_) {
-	struct mrsh_variable *var = _var;
-	if ((var->attribs & MRSH_VAR_ATTRIB_EXPORT)) {
-		setenv(key, var->value, 1);
-	}
-}
+/**
+ * The expansions of a simple command, for a single execution. Words are
+ * expanded into this struct, so that the AST is left untouched.
+ */
+struct simple_command_expansion {
+	struct mrsh_array args; // char *, NULL-terminated
+	struct mrsh_array assignments; // char *, one value per AST assignment
+	struct mrsh_array io_redirects; // struct expanded_redirect *
+};
 
 /**
  * Put the process into its job's process group. This has to be done both in the
@@ -38,79 +44,343 @@ static struct mrsh_process *init_child(struct mrsh_context *ctx, pid_t pid) {
 	return proc;
 }
 
-static int run_process(struct mrsh_context *ctx, struct mrsh_simple_command *sc,
+/**
+ * Searches PATH again when the remembered location of a utility has failed
+ * with `err`, in case the utility has been removed or moved. Returns NULL if
+ * there's no other location to try.
+ */
+static char *find_moved_utility(struct mrsh_state *state, const char *name,
+		const char *path, int err) {
+	if ((err != ENOENT && err != ENOTDIR) || strchr(name, '/') != NULL) {
+		return NULL;
+	}
+
+	forget_utility(state, name);
+	char *new_path = find_utility(state, name, true);
+	if (new_path != NULL && strcmp(new_path, path) == 0) {
+		// The utility is still there, e.g. its interpreter is missing
+		free(new_path);
+		return NULL;
+	}
+	return new_path;
+}
+
+/**
+ * Prepare the current child process and execute the utility. This function
+ * never returns.
+ */
+static void exec_process(struct mrsh_context *ctx,
+		const struct mrsh_simple_command *sc,
+		const struct simple_command_expansion *exp, const char *path,
 		char **argv) {
 	struct mrsh_state *state = ctx->state;
 	struct mrsh_state_priv *priv = state_get_priv(state);
 
-	// The pipeline is responsible for creating the job
-	assert(ctx->job != NULL);
+	init_child(ctx, getpid());
+	if (state->options & MRSH_OPT_MONITOR) {
+		init_job_child_process(state);
+	}
 
-	char *path = expand_path(ctx->state, argv[0], true, false);
-	if (!path) {
-		fprintf(stderr, "%s: not found\n", argv[0]);
-		return 127;
+	for (size_t i = 0; i < sc->assignments.len; ++i) {
+		struct mrsh_assignment *assign = sc->assignments.data[i];
+		uint32_t prev_attribs = 0;
+		if (mrsh_env_get(state, assign->name, &prev_attribs)
+				&& (prev_attribs & MRSH_VAR_ATTRIB_READONLY)) {
+			fprintf(stderr, "cannot modify readonly variable %s\n",
+					assign->name);
+			exit(1);
+		}
+		// We're in the child process, so this only affects the utility
+		mrsh_env_set(state, assign->name, exp->assignments.data[i],
+			prev_attribs | MRSH_VAR_ATTRIB_EXPORT);
 	}
 
-	pid_t pid = fork();
-	if (pid < 0) {
-		perror("fork");
-		return TASK_STATUS_ERROR;
-	} else if (pid == 0) {
-		init_child(ctx, getpid());
-		if (state->options & MRSH_OPT_MONITOR) {
-			init_job_child_process(state);
-		}
-
-		for (size_t i = 0; i < sc->assignments.len; ++i) {
-			struct mrsh_assignment *assign = sc->assignments.data[i];
-			uint32_t prev_attribs;
-			if (mrsh_env_get(state, assign->name, &prev_attribs)
-					&& (prev_attribs & MRSH_VAR_ATTRIB_READONLY)) {
-				fprintf(stderr, "cannot modify readonly variable %s\n",
-						assign->name);
-				exit(1);
-			}
-			char *value = mrsh_word_str(assign->value);
-			setenv(assign->name, value, true);
-			free(value);
+	for (size_t i = 0; i < exp->io_redirects.len; ++i) {
+		const struct expanded_redirect *redir = exp->io_redirects.data[i];
+
+		int redir_fd;
+		int fd = process_redir(state, redir, &redir_fd);
+		if (fd < 0) {
+			exit(1);
 		}
 
-		mrsh_hashtable_for_each(&priv->variables,
-			populate_env_iterator, NULL);
+		if (fd == redir_fd) {
+			continue;
+		}
 
-		for (size_t i = 0; i < sc->io_redirects.len; ++i) {
-			struct mrsh_io_redirect *redir = sc->io_redirects.data[i];
+		int ret = dup2(fd, redir_fd);
+		if (ret < 0) {
+			fprintf(stderr, "cannot duplicate file descriptor: %s\n",
+				strerror(errno));
+			exit(1);
+		}
+	}
 
-			int redir_fd;
-			int fd = process_redir(redir, &redir_fd);
-			if (fd < 0) {
-				exit(1);
-			}
+	execve(path, argv, (char **)priv->envp.data);
+	int err = errno;
 
-			if (fd == redir_fd) {
-				continue;
-			}
+	// Only this child forgets the stale location: the shell keeps trying it
+	// first
+	char *new_path = find_moved_utility(state, argv[0], path, err);
+	if (new_path != NULL) {
+		execve(new_path, argv, (char **)priv->envp.data);
+		err = errno;
+	}
 
-			int ret = dup2(fd, redir_fd);
-			if (ret < 0) {
-				fprintf(stderr, "cannot duplicate file descriptor: %s\n",
-					strerror(errno));
-				exit(1);
+	// Something went wrong
+	fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+	exit(127);
+}
+
+/**
+ * Checks whether the utility can be started with posix_spawn. Otherwise, the
+ * child needs to be prepared by exec_process after a fork.
+ */
+static bool can_spawn(struct mrsh_context *ctx,
+		const struct mrsh_simple_command *sc) {
+	struct mrsh_state *state = ctx->state;
+	// The child needs to set up its process group and signals
+	if (state->options & MRSH_OPT_MONITOR) {
+		return false;
+	}
+	// The child reports the error
+	for (size_t i = 0; i < sc->assignments.len; ++i) {
+		struct mrsh_assignment *assign = sc->assignments.data[i];
+		uint32_t attribs = 0;
+		if (mrsh_env_get(state, assign->name, &attribs) != NULL &&
+				(attribs & MRSH_VAR_ATTRIB_READONLY)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool env_entry_has_name(const char *entry, const char *name) {
+	size_t len = strlen(name);
+	return strncmp(entry, name, len) == 0 && entry[len] == '=';
+}
+
+/**
+ * Builds the environment of the utility: the exported variables, overridden
+ * by the assignments of the command. Only the entries of the assignments are
+ * allocated, they are added after the others.
+ */
+static bool build_envp(struct mrsh_array *envp, struct mrsh_state *state,
+		const struct mrsh_simple_command *sc,
+		const struct simple_command_expansion *exp, size_t *first) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	for (size_t i = 0; priv->envp.data[i] != NULL; ++i) {
+		const char *entry = priv->envp.data[i];
+		bool assigned = false;
+		for (size_t j = 0; !assigned && j < sc->assignments.len; ++j) {
+			const struct mrsh_assignment *assign = sc->assignments.data[j];
+			assigned = env_entry_has_name(entry, assign->name);
+		}
+		if (!assigned && mrsh_array_add(envp, (char *)entry) < 0) {
+			return false;
+		}
+	}
+
+	*first = envp->len;
+	for (size_t i = 0; i < sc->assignments.len; ++i) {
+		const struct mrsh_assignment *assign = sc->assignments.data[i];
+		// Only the last assignment to a variable is visible
+		bool overridden = false;
+		for (size_t j = i + 1; !overridden && j < sc->assignments.len; ++j) {
+			const struct mrsh_assignment *next = sc->assignments.data[j];
+			overridden = strcmp(assign->name, next->name) == 0;
+		}
+		if (overridden) {
+			continue;
+		}
+
+		const char *value = exp->assignments.data[i];
+		size_t name_len = strlen(assign->name), value_len = strlen(value);
+		char *entry = malloc(name_len + value_len + 2);
+		if (entry == NULL || mrsh_array_add(envp, entry) < 0) {
+			free(entry);
+			return false;
+		}
+		memcpy(entry, assign->name, name_len);
+		entry[name_len] = '=';
+		memcpy(entry + name_len + 1, value, value_len + 1);
+	}
+
+	return mrsh_array_add(envp, NULL) >= 0;
+}
+
+/**
+ * Opens the redirections of the command in the shell, and adds the actions
+ * moving them to their place in the child. Opened files are appended to
+ * `fds`, to be closed once the child has been started.
+ */
+static bool spawn_redirects(struct mrsh_state *state,
+		posix_spawn_file_actions_t *actions,
+		const struct simple_command_expansion *exp, int *fds, size_t *nfds) {
+	size_t len = exp->io_redirects.len;
+	// Zero-length VLAs are undefined behaviour
+	int src_fds[len + 1], redir_fds[len + 1];
+	int max_redir_fd = STDERR_FILENO;
+	for (size_t i = 0; i < len; ++i) {
+		const struct expanded_redirect *exp_redir = exp->io_redirects.data[i];
+		int fd = process_redir(state, exp_redir, &redir_fds[i]);
+		if (fd < 0) {
+			return false;
+		}
+		src_fds[i] = fd;
+		if (redir_fds[i] > max_redir_fd) {
+			max_redir_fd = redir_fds[i];
+		}
+
+		enum mrsh_io_redirect_op op = exp_redir->redir->op;
+		if (op != MRSH_IO_LESSAND && op != MRSH_IO_GREATAND) {
+			fds[(*nfds)++] = fd;
+		}
+	}
+
+	// The actions run in order in the child. Files opened by the shell must
+	// not be overwritten by an earlier action before being moved.
+	for (size_t i = 0; i < *nfds; ++i) {
+		if (fds[i] > max_redir_fd) {
+			continue;
+		}
+		int fd = fcntl(fds[i], F_DUPFD_CLOEXEC, max_redir_fd + 1);
+		if (fd < 0) {
+			fprintf(stderr, "cannot duplicate file descriptor: %s\n",
+				strerror(errno));
+			return false;
+		}
+		for (size_t j = 0; j < len; ++j) {
+			if (src_fds[j] == fds[i]) {
+				src_fds[j] = fd;
 			}
 		}
+		close(fds[i]);
+		fds[i] = fd;
+	}
+
+	for (size_t i = 0; i < len; ++i) {
+		if (posix_spawn_file_actions_adddup2(actions, src_fds[i],
+				redir_fds[i]) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Starts the utility with posix_spawn, which doesn't copy the address space of
+ * the shell like fork does, and waits for it.
+ */
+static int spawn_process(struct mrsh_context *ctx,
+		const struct mrsh_simple_command *sc,
+		const struct simple_command_expansion *exp, const char *path,
+		char **argv) {
+	struct mrsh_state_priv *priv = state_get_priv(ctx->state);
+
+	posix_spawn_file_actions_t actions;
+	if (posix_spawn_file_actions_init(&actions) != 0) {
+		return TASK_STATUS_ERROR;
+	}
+
+	// Zero-length VLAs are undefined behaviour
+	int fds[exp->io_redirects.len + 1];
+	size_t nfds = 0;
+	int ret = 0;
+	if (!spawn_redirects(ctx->state, &actions, exp, fds, &nfds)) {
+		ret = 1;
+	}
+
+	struct mrsh_array envp = {0};
+	size_t first_entry = 0;
+	char **env = (char **)priv->envp.data;
+	if (ret == 0 && sc->assignments.len > 0) {
+		if (build_envp(&envp, ctx->state, sc, exp, &first_entry)) {
+			env = (char **)envp.data;
+		} else {
+			ret = TASK_STATUS_ERROR;
+		}
+	}
+
+	pid_t pid;
+	if (ret == 0) {
+		int err = posix_spawn(&pid, path, &actions, NULL, argv, env);
+		char *new_path = find_moved_utility(ctx->state, argv[0], path, err);
+		if (new_path != NULL) {
+			err = posix_spawn(&pid, new_path, &actions, NULL, argv, env);
+			free(new_path);
+		}
+		if (err == EBADF) {
+			// Only the file actions use file descriptors
+			fprintf(stderr, "cannot duplicate file descriptor: %s\n",
+				strerror(err));
+			ret = 1;
+		} else if (err != 0) {
+			fprintf(stderr, "%s: %s\n", argv[0], strerror(err));
+			ret = 127;
+		}
+	}
+
+	for (size_t i = 0; i < nfds; ++i) {
+		close(fds[i]);
+	}
+	for (size_t i = first_entry; i < envp.len; ++i) {
+		free(envp.data[i]);
+	}
+	mrsh_array_finish(&envp);
+	posix_spawn_file_actions_destroy(&actions);
+	if (ret != 0) {
+		return ret;
+	}
+
+	struct mrsh_process *process = init_child(ctx, pid);
+	ret = job_wait_process(process);
+	process_release(process);
+	return ret;
+}
 
-		execv(path, argv);
+static int run_process(struct mrsh_context *ctx,
+		const struct mrsh_simple_command *sc,
+		const struct simple_command_expansion *exp, char **argv) {
+	// The pipeline is responsible for creating the job
+	assert(ctx->job != NULL);
+
+	char *path = find_utility(ctx->state, argv[0], true);
+	if (!path) {
+		fprintf(stderr, "%s: not found\n", argv[0]);
+		return 127;
+	}
 
-		// Something went wrong
-		fprintf(stderr, "%s: %s\n", argv[0], strerror(errno));
-		exit(127);
+	// If we're a child process about to exit, there's no need to fork again.
+	// Traps still need a shell to run them though.
+	if (ctx->tail && !has_caught_traps(ctx->state)) {
+		fflush(stdout);
+		fflush(stderr);
+		exec_process(ctx, sc, exp, path, argv);
+	}
+
+	if (can_spawn(ctx, sc)) {
+		int ret = spawn_process(ctx, sc, exp, path, argv);
+		free(path);
+		return ret;
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		free(path);
+		return TASK_STATUS_ERROR;
+	} else if (pid == 0) {
+		exec_process(ctx, sc, exp, path, argv);
 	}
 
 	free(path);
 
 	struct mrsh_process *process = init_child(ctx, pid);
-	return job_wait_process(process);
+	int ret = job_wait_process(process);
+	process_release(process);
+	return ret;
 }
 
 struct saved_fd {
@@ -142,21 +412,22 @@ static bool dup_and_save_fd(int fd, int redir_fd, struct saved_fd *saved) {
 	return true;
 }
 
-static int run_builtin(struct mrsh_context *ctx, struct mrsh_simple_command *sc,
-		int argc, char **argv) {
+static int run_builtin(struct mrsh_context *ctx,
+		const struct simple_command_expansion *exp, int argc, char **argv) {
 	// Duplicate old FDs to be able to restore them later
 	// Zero-length VLAs are undefined behaviour
-	struct saved_fd fds[sc->io_redirects.len + 1];
+	struct saved_fd fds[exp->io_redirects.len + 1];
 	for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); ++i) {
 		fds[i].dup_fd = fds[i].redir_fd = -1;
 	}
 
-	for (size_t i = 0; i < sc->io_redirects.len; ++i) {
-		struct mrsh_io_redirect *redir = sc->io_redirects.data[i];
+	for (size_t i = 0; i < exp->io_redirects.len; ++i) {
+		const struct expanded_redirect *exp_redir = exp->io_redirects.data[i];
+		const struct mrsh_io_redirect *redir = exp_redir->redir;
 		struct saved_fd *saved = &fds[i];
 
 		int redir_fd;
-		int fd = process_redir(redir, &redir_fd);
+		int fd = process_redir(ctx->state, exp_redir, &redir_fd);
 		if (fd < 0) {
 			return TASK_STATUS_ERROR;
 		}
@@ -164,6 +435,13 @@ static int run_builtin(struct mrsh_context *ctx, struct mrsh_simple_command *sc,
 		if (!dup_and_save_fd(fd, redir_fd, saved)) {
 			return TASK_STATUS_ERROR;
 		}
+
+		// Files opened for the redirection must not outlive the builtin,
+		// otherwise e.g. a script written by printf can't be executed
+		if (fd != redir_fd && redir->op != MRSH_IO_LESSAND &&
+				redir->op != MRSH_IO_GREATAND) {
+			close(fd);
+		}
 	}
 
 	// TODO: environment from assignements
@@ -192,125 +470,220 @@ static int run_builtin(struct mrsh_context *ctx, struct mrsh_simple_command *sc,
 	return ret;
 }
 
-static int run_assignments(struct mrsh_context *ctx, struct mrsh_array *assignments) {
+/**
+ * Computes the attributes of a variable about to be assigned. Returns false if
+ * the variable is readonly.
+ */
+static bool assignment_attribs(struct mrsh_context *ctx, const char *name,
+		uint32_t *attribs) {
+	uint32_t prev_attribs = 0;
+	if (env_get_attribs(ctx->state, name, &prev_attribs)
+			&& (prev_attribs & MRSH_VAR_ATTRIB_READONLY)) {
+		fprintf(stderr, "cannot modify readonly variable %s\n", name);
+		return false;
+	}
+	// Exported variables stay exported
+	*attribs = prev_attribs & MRSH_VAR_ATTRIB_EXPORT;
+	if ((ctx->state->options & MRSH_OPT_ALLEXPORT)) {
+		*attribs = MRSH_VAR_ATTRIB_EXPORT;
+	}
+	return true;
+}
+
+int run_assignment(struct mrsh_context *ctx, const char *name,
+		const char *value) {
+	uint32_t attribs;
+	if (!assignment_attribs(ctx, name, &attribs)) {
+		return TASK_STATUS_ERROR;
+	}
+	mrsh_env_set(ctx->state, name, value, attribs);
+	return 0;
+}
+
+int run_number_assignment(struct mrsh_context *ctx, const char *name,
+		long value) {
+	uint32_t attribs;
+	if (!assignment_attribs(ctx, name, &attribs)) {
+		return TASK_STATUS_ERROR;
+	}
+	env_set_number(ctx->state, name, value, attribs);
+	return 0;
+}
+
+static int run_assignments(struct mrsh_context *ctx,
+		const struct mrsh_array *assignments, const struct mrsh_array *values) {
 	for (size_t i = 0; i < assignments->len; ++i) {
-		struct mrsh_assignment *assign = assignments->data[i];
-		char *new_value = mrsh_word_str(assign->value);
-		uint32_t attribs = MRSH_VAR_ATTRIB_NONE;
-		if ((ctx->state->options & MRSH_OPT_ALLEXPORT)) {
-			attribs = MRSH_VAR_ATTRIB_EXPORT;
-		}
-		uint32_t prev_attribs = 0;
-		if (mrsh_env_get(ctx->state, assign->name, &prev_attribs) != NULL
-				&& (prev_attribs & MRSH_VAR_ATTRIB_READONLY)) {
-			free(new_value);
-			fprintf(stderr, "cannot modify readonly variable %s\n",
-				assign->name);
-			return TASK_STATUS_ERROR;
+		const struct mrsh_assignment *assign = assignments->data[i];
+		int ret = run_assignment(ctx, assign->name, values->data[i]);
+		if (ret < 0) {
+			return ret;
 		}
-		mrsh_env_set(ctx->state, assign->name, new_value, attribs);
-		free(new_value);
 	}
 
 	return 0;
 }
 
 static int expand_assignments(struct mrsh_context *ctx,
-		struct mrsh_array *assignments) {
+		const struct mrsh_array *assignments, struct mrsh_array *values) {
+	mrsh_array_reserve(values, assignments->len);
 	for (size_t i = 0; i < assignments->len; ++i) {
-		struct mrsh_assignment *assign = assignments->data[i];
-		expand_tilde(ctx->state, &assign->value, true);
-		int ret = run_word(ctx, &assign->value);
+		const struct mrsh_assignment *assign = assignments->data[i];
+		struct mrsh_word *value;
+		int ret = run_word(ctx, assign->value, &value,
+			TILDE_EXPANSION_ASSIGNMENT);
 		if (ret < 0) {
 			return ret;
 		}
+		mrsh_array_add(values, mrsh_word_str(value));
+		mrsh_word_destroy(value);
 	}
 	return 0;
 }
 
-static struct mrsh_simple_command *copy_simple_command(
-		const struct mrsh_simple_command *sc) {
-	struct mrsh_command *cmd = mrsh_command_copy(&sc->command);
-	return mrsh_command_get_simple_command(cmd);
+/**
+ * Appends a word made only of strings to the buffer. Returns false if the word
+ * needs to be expanded first.
+ */
+static bool append_word_str(struct mrsh_buffer *buf,
+		const struct mrsh_word *word) {
+	switch (word->type) {
+	case MRSH_WORD_STRING:;
+		const struct mrsh_word_string *ws = mrsh_word_get_string(word);
+		return mrsh_buffer_append(buf, ws->str, strlen(ws->str));
+	case MRSH_WORD_LIST:;
+		const struct mrsh_word_list *wl = mrsh_word_get_list(word);
+		for (size_t i = 0; i < wl->children.len; ++i) {
+			if (!append_word_str(buf, wl->children.data[i])) {
+				return false;
+			}
+		}
+		return true;
+	default:
+		return false;
+	}
 }
 
-int run_simple_command(struct mrsh_context *ctx, struct mrsh_simple_command *sc) {
-	struct mrsh_state *state = ctx->state;
-	struct mrsh_state_priv *priv = state_get_priv(state);
+static int expand_here_document(struct mrsh_context *ctx,
+		const struct mrsh_array *lines, struct mrsh_buffer *buf) {
+	for (size_t i = 0; i < lines->len; ++i) {
+		const struct mrsh_word *line = lines->data[i];
 
-	if (sc->name == NULL) {
-		// Copy each assignment from the AST, because during expansion and
-		// substitution we'll mutate the tree
-		struct mrsh_array assignments = {0};
-		mrsh_array_reserve(&assignments, sc->assignments.len);
-		for (size_t i = 0; i < sc->assignments.len; ++i) {
-			struct mrsh_assignment *assign = sc->assignments.data[i];
-			mrsh_array_add(&assignments, mrsh_assignment_copy(assign));
+		// Lines without any expansion are copied as-is
+		size_t len = buf->len;
+		if (!append_word_str(buf, line)) {
+			buf->len = len;
+
+			struct mrsh_word *expanded;
+			int ret = run_word(ctx, line, &expanded, TILDE_EXPANSION_NAME);
+			if (ret < 0) {
+				return ret;
+			}
+			append_word_str(buf, expanded);
+			mrsh_word_destroy(expanded);
 		}
+		mrsh_buffer_append_char(buf, '\n');
+	}
+	return 0;
+}
 
-		int ret = expand_assignments(ctx, &assignments);
+static int expand_io_redirects(struct mrsh_context *ctx,
+		const struct mrsh_array *io_redirects, struct mrsh_array *expanded) {
+	mrsh_array_reserve(expanded, io_redirects->len);
+	for (size_t i = 0; i < io_redirects->len; ++i) {
+		const struct mrsh_io_redirect *redir = io_redirects->data[i];
+
+		struct expanded_redirect *exp_redir =
+			calloc(1, sizeof(struct expanded_redirect));
+		exp_redir->redir = redir;
+		mrsh_array_add(expanded, exp_redir);
+
+		struct mrsh_word *name;
+		int ret = run_word(ctx, redir->name, &name, TILDE_EXPANSION_NAME);
 		if (ret < 0) {
 			return ret;
 		}
+		exp_redir->name = mrsh_word_str(name);
+		mrsh_word_destroy(name);
 
-		ret = run_assignments(ctx, &assignments);
+		ret = expand_here_document(ctx, &redir->here_document,
+			&exp_redir->here_document);
 		if (ret < 0) {
 			return ret;
 		}
+	}
+	return 0;
+}
 
-		for (size_t i = 0; i < assignments.len; ++i) {
-			struct mrsh_assignment *assign = assignments.data[i];
-			mrsh_assignment_destroy(assign);
-		}
-		mrsh_array_finish(&assignments);
-
-		return 0;
+static void free_str_array(struct mrsh_array *array) {
+	for (size_t i = 0; i < array->len; ++i) {
+		free(array->data[i]);
 	}
+	mrsh_array_finish(array);
+}
 
-	// Copy the command from the AST, because during expansion and substitution
-	// we'll mutate the tree
-	sc = copy_simple_command(sc);
+static void expansion_finish(struct simple_command_expansion *exp) {
+	free_str_array(&exp->args);
+	free_str_array(&exp->assignments);
+	for (size_t i = 0; i < exp->io_redirects.len; ++i) {
+		struct expanded_redirect *exp_redir = exp->io_redirects.data[i];
+		free(exp_redir->name);
+		mrsh_buffer_finish(&exp_redir->here_document);
+		free(exp_redir);
+	}
+	mrsh_array_finish(&exp->io_redirects);
+}
 
-	struct mrsh_array args = {0};
-	int ret = expand_word(ctx, sc->name, &args);
+static int expand_simple_command(struct mrsh_context *ctx,
+		const struct mrsh_simple_command *sc,
+		struct simple_command_expansion *exp) {
+	// Pathname expansions of the arguments read each directory once
+	struct glob_cache cache = {0};
+	struct mrsh_context args_ctx = *ctx;
+	args_ctx.glob_cache = &cache;
+	int ret = expand_word(&args_ctx, sc->name, &exp->args);
+	for (size_t i = 0; ret >= 0 && i < sc->arguments.len; ++i) {
+		const struct mrsh_word *arg = sc->arguments.data[i];
+		ret = expand_word(&args_ctx, arg, &exp->args);
+	}
+	glob_cache_finish(&cache);
 	if (ret < 0) {
 		return ret;
 	}
-	for (size_t i = 0; i < sc->arguments.len; ++i) {
-		struct mrsh_word *arg = sc->arguments.data[i];
-		ret = expand_word(ctx, arg, &args);
-		if (ret < 0) {
-			return ret;
-		}
-	}
-	assert(args.len > 0);
-	mrsh_array_add(&args, NULL);
+	assert(exp->args.len > 0);
+	mrsh_array_add(&exp->args, NULL);
 
-	ret = expand_assignments(ctx, &sc->assignments);
+	ret = expand_assignments(ctx, &sc->assignments, &exp->assignments);
 	if (ret < 0) {
 		return ret;
 	}
 
-	for (size_t i = 0; i < sc->io_redirects.len; ++i) {
-		struct mrsh_io_redirect *redir = sc->io_redirects.data[i];
-		expand_tilde(state, &redir->name, false);
-		ret = run_word(ctx, &redir->name);
-		if (ret < 0) {
-			return ret;
-		}
-		for (size_t j = 0; j < redir->here_document.len; ++j) {
-			struct mrsh_word **line_word_ptr =
-				(struct mrsh_word **)&redir->here_document.data[j];
-			expand_tilde(state, line_word_ptr, false);
-			ret = run_word(ctx, line_word_ptr);
-			if (ret < 0) {
-				return ret;
-			}
+	return expand_io_redirects(ctx, &sc->io_redirects, &exp->io_redirects);
+}
+
+static int _run_simple_command(struct mrsh_context *ctx,
+		struct mrsh_simple_command *sc) {
+	struct mrsh_state *state = ctx->state;
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	struct simple_command_expansion exp = {0};
+
+	if (sc->name == NULL) {
+		int ret = expand_assignments(ctx, &sc->assignments, &exp.assignments);
+		if (ret >= 0) {
+			ret = run_assignments(ctx, &sc->assignments, &exp.assignments);
 		}
+		expansion_finish(&exp);
+		return ret < 0 ? ret : 0;
 	}
 
-	char **argv = (char **)args.data;
-	int argc = args.len - 1; // argv is NULL-terminated
+	int ret = expand_simple_command(ctx, sc, &exp);
+	if (ret < 0) {
+		expansion_finish(&exp);
+		return ret;
+	}
+
+	char **argv = (char **)exp.args.data;
+	int argc = exp.args.len - 1; // argv is NULL-terminated
 	const char *argv_0 = argv[0];
 
 	if ((state->options & MRSH_OPT_XTRACE)) {
@@ -324,26 +697,57 @@ int run_simple_command(struct mrsh_context *ctx, struct mrsh_simple_command *sc)
 	}
 
 	ret = -1;
-	const struct mrsh_function *fn_def =
+	struct mrsh_function *fn_def =
 		mrsh_hashtable_get(&priv->functions, argv_0);
 	if (fn_def != NULL) {
 		push_frame(state, argc, (const char **)argv);
-		// fn_def may be free'd during run_command when overwritten with another
-		// function, so we need to copy it.
-		struct mrsh_command *body = mrsh_command_copy(fn_def->body);
-		ret = run_command(ctx, body);
-		mrsh_command_destroy(body);
+		// fn_def may be unset or overwritten with another function during
+		// run_command, so we need to hold a reference
+		function_ref(fn_def);
+		const char *prev_source = priv->source;
+		priv->source = fn_def->source;
+		bool profile = state->options & MRSH_OPT_PROFILE;
+		if (profile) {
+			profile_begin_function(state, argv_0);
+		}
+		struct mrsh_context fn_ctx = *ctx;
+		fn_ctx.tail = false;
+		if ((state->options & MRSH_OPT_BYTECODE) && fn_def->code == NULL) {
+			fn_def->code = bytecode_compile_command(fn_def->body);
+		}
+		if ((state->options & MRSH_OPT_BYTECODE) && fn_def->code != NULL) {
+			ret = run_bytecode(&fn_ctx, fn_def->code);
+		} else {
+			ret = run_command(&fn_ctx, fn_def->body);
+		}
+		if (ret == TASK_STATUS_INTERRUPTED && call_frame_get_priv(
+				state->frame)->branch_control == MRSH_BRANCH_RETURN) {
+			// The status has been set by the return builtin
+			ret = state->last_status;
+		}
+		if (profile) {
+			profile_end_function(state);
+		}
+		priv->source = prev_source;
+		function_unref(fn_def);
 		pop_frame(state);
 	} else if (mrsh_has_builtin(argv_0)) {
-		ret = run_builtin(ctx, sc, argc, argv);
+		ret = run_builtin(ctx, &exp, argc, argv);
 	} else {
-		ret = run_process(ctx, sc, argv);
+		ret = run_process(ctx, sc, &exp, argv);
 	}
 
-	mrsh_command_destroy(&sc->command);
-	for (size_t i = 0; i < args.len; ++i) {
-		free(args.data[i]);
+	expansion_finish(&exp);
+	return ret;
+}
+
+int run_simple_command(struct mrsh_context *ctx, struct mrsh_simple_command *sc) {
+	if (!(ctx->state->options & MRSH_OPT_PROFILE)) {
+		return _run_simple_command(ctx, sc);
 	}
-	mrsh_array_finish(&args);
+
+	profile_begin_command(ctx->state, sc);
+	int ret = _run_simple_command(ctx, sc);
+	profile_end_command(ctx->state);
 	return ret;
 }
@@ -2,12 +2,13 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <fnmatch.h>
 #include <mrsh/ast.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "shell/bytecode.h"
+#include "shell/pattern.h"
 #include "shell/shell.h"
 #include "shell/task.h"
 #include "shell/trap.h"
@@ -38,7 +39,12 @@ static int run_subshell(struct mrsh_context *ctx, struct mrsh_array *array) {
 			}
 		}
 
-		int ret = run_command_list_array(ctx, array);
+		// Without job control, the subshell doesn't need a process group of
+		// its own, so the last command can replace it
+		struct mrsh_context child_ctx = *ctx;
+		child_ctx.tail = !(ctx->state->options & MRSH_OPT_MONITOR);
+
+		int ret = run_command_list_array(&child_ctx, array);
 		if (ret < 0) {
 			exit(127);
 		}
@@ -50,11 +56,16 @@ static int run_subshell(struct mrsh_context *ctx, struct mrsh_array *array) {
 	}
 
 	struct mrsh_process *proc = process_create(ctx->state, pid);
-	return job_wait_process(proc);
+	int ret = job_wait_process(proc);
+	process_release(proc);
+	return ret;
 }
 
 static int run_if_clause(struct mrsh_context *ctx, struct mrsh_if_clause *ic) {
-	int ret = run_command_list_array(ctx, &ic->condition);
+	struct mrsh_context cond_ctx = *ctx;
+	cond_ctx.tail = false;
+
+	int ret = run_command_list_array(&cond_ctx, &ic->condition);
 	if (ret < 0) {
 		return ret;
 	}
@@ -69,7 +80,13 @@ static int run_if_clause(struct mrsh_context *ctx, struct mrsh_if_clause *ic) {
 	}
 }
 
-static int run_loop_clause(struct mrsh_context *ctx, struct mrsh_loop_clause *lc) {
+static int run_loop_clause(struct mrsh_context *_ctx,
+		struct mrsh_loop_clause *lc) {
+	// Loop bodies can be executed more than once
+	struct mrsh_context loop_ctx = *_ctx;
+	loop_ctx.tail = false;
+	struct mrsh_context *ctx = &loop_ctx;
+
 	struct mrsh_call_frame_priv *frame_priv =
 		call_frame_get_priv(ctx->state->frame);
 	int loop_num = ++frame_priv->nloops;
@@ -107,15 +124,15 @@ static int run_loop_clause(struct mrsh_context *ctx, struct mrsh_loop_clause *lc
 
 interrupt:
 		if (frame_priv->nloops < loop_num) {
-			loop_ret = TASK_STATUS_INTERRUPTED; // break to parent loop
-			break;
+			// Break to parent loop, which has already been accounted for
+			return TASK_STATUS_INTERRUPTED;
 		}
+		loop_ret = 0;
 		switch (frame_priv->branch_control) {
 		case MRSH_BRANCH_BREAK:
 		case MRSH_BRANCH_RETURN:
 		case MRSH_BRANCH_EXIT:
 			break_loop = true;
-			loop_ret = 0;
 			break;
 		case MRSH_BRANCH_CONTINUE:
 			break;
@@ -129,35 +146,41 @@ interrupt:
 	return loop_ret;
 }
 
-static int run_for_clause(struct mrsh_context *ctx, struct mrsh_for_clause *fc) {
+static int run_for_clause(struct mrsh_context *_ctx,
+		struct mrsh_for_clause *fc) {
+	struct mrsh_context loop_ctx = *_ctx;
+	loop_ctx.tail = false;
+	struct mrsh_context *ctx = &loop_ctx;
+
 	struct mrsh_call_frame_priv *frame_priv =
 		call_frame_get_priv(ctx->state->frame);
 	int loop_num = ++frame_priv->nloops;
 
-	struct mrsh_array fields = {0};
-	for (size_t i = 0; i < fc->word_list.len; i++) {
-		struct mrsh_word *word = fc->word_list.data[i];
-		int ret = expand_word(ctx, word, &fields);
-		if (ret < 0) {
-			return ret;
-		}
+	struct for_fields fields = {0};
+	int ret = for_fields_init(ctx, &fields, &fc->word_list);
+	if (ret < 0) {
+		for_fields_finish(&fields);
+		return ret;
 	}
 
 	int loop_ret = 0;
-	size_t word_index = 0;
 	while (ctx->state->exit == -1) {
-		if (word_index == fields.len) {
+		const char *field;
+		ret = for_fields_next(&fields, &field);
+		if (ret < 0) {
+			for_fields_finish(&fields);
+			return ret;
+		} else if (ret == 0) {
 			break;
 		}
 
-		mrsh_env_set(ctx->state, fc->name, fields.data[word_index],
-			MRSH_VAR_ATTRIB_NONE);
-		word_index++;
+		mrsh_env_set(ctx->state, fc->name, field, MRSH_VAR_ATTRIB_NONE);
 
 		loop_ret = run_command_list_array(ctx, &fc->body);
 		if (loop_ret == TASK_STATUS_INTERRUPTED) {
 			goto interrupt;
 		} else if (loop_ret < 0) {
+			for_fields_finish(&fields);
 			return loop_ret;
 		}
 
@@ -165,16 +188,17 @@ static int run_for_clause(struct mrsh_context *ctx, struct mrsh_for_clause *fc)
 
 interrupt:
 		if (frame_priv->nloops < loop_num) {
-			loop_ret = TASK_STATUS_INTERRUPTED; // break to parent loop
+			// Break to parent loop, which has already been accounted for
+			loop_ret = TASK_STATUS_INTERRUPTED;
 			break;
 		}
 		bool break_loop = false;
+		loop_ret = 0;
 		switch (frame_priv->branch_control) {
 		case MRSH_BRANCH_BREAK:
 		case MRSH_BRANCH_RETURN:
 		case MRSH_BRANCH_EXIT:
 			break_loop = true;
-			loop_ret = 0;
 			break;
 		case MRSH_BRANCH_CONTINUE:
 			break;
@@ -184,21 +208,45 @@ interrupt:
 		}
 	}
 
-	for (size_t i = 0; i < fields.len; i++) {
-		free(fields.data[i]);
-	}
-	mrsh_array_finish(&fields);
+	for_fields_finish(&fields);
 
-	--frame_priv->nloops;
+	if (loop_ret != TASK_STATUS_INTERRUPTED) {
+		--frame_priv->nloops;
+	}
 	return loop_ret;
 }
 
+int match_case_pattern(struct mrsh_context *ctx,
+		const struct mrsh_word *pattern_word, const char *str) {
+	struct mrsh_word *expanded;
+	int ret = run_word(ctx, pattern_word, &expanded, TILDE_EXPANSION_NAME);
+	if (ret < 0) {
+		return ret;
+	}
+	bool selected;
+	char *pattern_str = word_to_pattern(expanded);
+	if (pattern_str != NULL) {
+		const struct pattern *pattern =
+			pattern_cache_get(ctx->state, pattern_str);
+		free(pattern_str);
+		if (pattern == NULL) {
+			mrsh_word_destroy(expanded);
+			return TASK_STATUS_ERROR;
+		}
+		selected = pattern_match(pattern, str);
+	} else {
+		char *expanded_str = mrsh_word_str(expanded);
+		selected = strcmp(expanded_str, str) == 0;
+		free(expanded_str);
+	}
+	mrsh_word_destroy(expanded);
+	return selected;
+}
+
 static int run_case_clause(struct mrsh_context *ctx, struct mrsh_case_clause *cc) {
-	struct mrsh_word *word = mrsh_word_copy(cc->word);
-	expand_tilde(ctx->state, &word, false);
-	int ret = run_word(ctx, &word);
+	struct mrsh_word *word;
+	int ret = run_word(ctx, cc->word, &word, TILDE_EXPANSION_NAME);
 	if (ret < 0) {
-		mrsh_word_destroy(word);
 		return ret;
 	}
 	char *word_str = mrsh_word_str(word);
@@ -210,23 +258,12 @@ static int run_case_clause(struct mrsh_context *ctx, struct mrsh_case_clause *cc
 
 		bool selected = false;
 		for (size_t j = 0; j < ci->patterns.len; ++j) {
-			// TODO: this mutates the AST
-			struct mrsh_word **word_ptr =
-				(struct mrsh_word **)&ci->patterns.data[j];
-			expand_tilde(ctx->state, word_ptr, false);
-			int ret = run_word(ctx, word_ptr);
+			int ret = match_case_pattern(ctx, ci->patterns.data[j], word_str);
 			if (ret < 0) {
+				free(word_str);
 				return ret;
 			}
-			char *pattern = word_to_pattern(*word_ptr);
-			if (pattern != NULL) {
-				selected = fnmatch(pattern, word_str, 0) == 0;
-				free(pattern);
-			} else {
-				char *str = mrsh_word_str(*word_ptr);
-				selected = strcmp(str, word_str) == 0;
-				free(str);
-			}
+			selected = ret > 0;
 			if (selected) {
 				break;
 			}
@@ -246,11 +283,13 @@ static int run_function_definition(struct mrsh_context *ctx,
 		struct mrsh_function_definition *fnd) {
 	struct mrsh_state_priv *priv = state_get_priv(ctx->state);
 
-	struct mrsh_function *fn = calloc(1, sizeof(struct mrsh_function));
-	fn->body = mrsh_command_copy(fnd->body);
+	struct mrsh_function *fn = function_create(mrsh_command_copy(fnd->body));
+	if (priv->source != NULL) {
+		fn->source = strdup(priv->source);
+	}
 	struct mrsh_function *old_fn =
 		mrsh_hashtable_set(&priv->functions, fnd->name, fn);
-	function_destroy(old_fn);
+	function_unref(old_fn);
 	return 0;
 }
 
@@ -293,7 +332,9 @@ int run_and_or_list(struct mrsh_context *ctx, struct mrsh_and_or_list *and_or_li
 		return run_pipeline(ctx, pl);
 	case MRSH_AND_OR_LIST_BINOP:;
 		struct mrsh_binop *binop = mrsh_and_or_list_get_binop(and_or_list);
-		int left_status = run_and_or_list(ctx, binop->left);
+		struct mrsh_context left_ctx = *ctx;
+		left_ctx.tail = false;
+		int left_status = run_and_or_list(&left_ctx, binop->left);
 		switch (binop->type) {
 		case MRSH_BINOP_AND:
 			if (left_status != 0) {
@@ -325,58 +366,75 @@ static struct mrsh_process *init_async_child(struct mrsh_context *ctx, pid_t pid
 	return proc;
 }
 
-int run_command_list_array(struct mrsh_context *ctx, struct mrsh_array *array) {
+int run_async_command_list(struct mrsh_context *ctx,
+		struct mrsh_command_list *list) {
 	struct mrsh_state *state = ctx->state;
 	struct mrsh_state_priv *priv = state_get_priv(state);
 
+	struct mrsh_context child_ctx = *ctx;
+	child_ctx.background = true;
+	child_ctx.tail = true;
+	if (child_ctx.job == NULL) {
+		child_ctx.job = job_create(state, &list->node);
+	}
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return TASK_STATUS_ERROR;
+	} else if (pid == 0) {
+		ctx = NULL; // Use child_ctx instead
+		priv->child = true;
+
+		init_async_child(&child_ctx, getpid());
+		if (state->options & MRSH_OPT_MONITOR) {
+			init_job_child_process(state);
+		}
+
+		if (!(state->options & MRSH_OPT_MONITOR)) {
+			// If job control is disabled, stdin is /dev/null
+			int fd = open("/dev/null", O_CLOEXEC | O_RDONLY);
+			if (fd < 0) {
+				fprintf(stderr, "failed to open /dev/null: %s\n",
+					strerror(errno));
+				exit(1);
+			}
+			if (fd != STDIN_FILENO) {
+				dup2(fd, STDIN_FILENO);
+				close(fd);
+			}
+		}
+
+		int ret = run_and_or_list(&child_ctx, list->and_or_list);
+		if (ret < 0) {
+			exit(127);
+		}
+		exit(ret);
+	}
+
+	// The process is released by the wait builtin, once its status has been
+	// reported
+	struct mrsh_process *proc = init_async_child(&child_ctx, pid);
+	proc->async = true;
+	priv->last_async_pid = pid;
+	return 0;
+}
+
+int run_command_list_array(struct mrsh_context *ctx, struct mrsh_array *array) {
+	struct mrsh_state *state = ctx->state;
+
+	struct mrsh_context list_ctx = *ctx;
 	int ret = 0;
 	for (size_t i = 0; i < array->len; ++i) {
 		struct mrsh_command_list *list = array->data[i];
+		list_ctx.tail = ctx->tail && i == array->len - 1;
 		if (list->ampersand) {
-			struct mrsh_context child_ctx = *ctx;
-			child_ctx.background = true;
-			if (child_ctx.job == NULL) {
-				child_ctx.job = job_create(state, &list->node);
-			}
-
-			pid_t pid = fork();
-			if (pid < 0) {
-				perror("fork");
-				return TASK_STATUS_ERROR;
-			} else if (pid == 0) {
-				ctx = NULL; // Use child_ctx instead
-				priv->child = true;
-
-				init_async_child(&child_ctx, getpid());
-				if (state->options & MRSH_OPT_MONITOR) {
-					init_job_child_process(state);
-				}
-
-				if (!(state->options & MRSH_OPT_MONITOR)) {
-					// If job control is disabled, stdin is /dev/null
-					int fd = open("/dev/null", O_CLOEXEC | O_RDONLY);
-					if (fd < 0) {
-						fprintf(stderr, "failed to open /dev/null: %s\n",
-							strerror(errno));
-						exit(1);
-					}
-					if (fd != STDIN_FILENO) {
-						dup2(fd, STDIN_FILENO);
-						close(fd);
-					}
-				}
-
-				int ret = run_and_or_list(&child_ctx, list->and_or_list);
-				if (ret < 0) {
-					exit(127);
-				}
-				exit(ret);
+			ret = run_async_command_list(ctx, list);
+			if (ret < 0) {
+				return ret;
 			}
-
-			ret = 0;
-			init_async_child(&child_ctx, pid);
 		} else {
-			ret = run_and_or_list(ctx, list->and_or_list);
+			ret = run_and_or_list(&list_ctx, list->and_or_list);
 			if (ret < 0) {
 				return ret;
 			}
@@ -433,17 +491,31 @@ void mrsh_destroy_terminated_jobs(struct mrsh_state *state) {
 
 int mrsh_run_program(struct mrsh_state *state, struct mrsh_program *prog) {
 	struct mrsh_context ctx = { .state = state };
-	int ret = run_command_list_array(&ctx, &prog->body);
+	int ret;
+	struct bytecode *code = NULL;
+	if (state->options & MRSH_OPT_BYTECODE) {
+		code = bytecode_compile_program(prog);
+	}
+	if (code != NULL) {
+		ret = run_bytecode(&ctx, code);
+		bytecode_destroy(code);
+	} else {
+		ret = run_command_list_array(&ctx, &prog->body);
+	}
 	run_pending_traps(state);
 	return ret;
 }
 
 int mrsh_run_word(struct mrsh_state *state, struct mrsh_word **word) {
-	expand_tilde(state, word, false);
-
 	struct mrsh_context ctx = { .state = state };
 	int last_status = state->last_status;
-	int ret = run_word(&ctx, word);
+	struct mrsh_word *result;
+	int ret = run_word(&ctx, *word, &result, TILDE_EXPANSION_NAME);
 	state->last_status = last_status;
+	if (ret < 0) {
+		return ret;
+	}
+	mrsh_word_destroy(*word);
+	*word = result;
 	return ret;
 }
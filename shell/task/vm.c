@@ -0,0 +1,356 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <mrsh/builtin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "shell/bytecode.h"
+#include "shell/pattern.h"
+#include "shell/shell.h"
+#include "shell/task.h"
+
+enum vm_block_type {
+	VM_BLOCK_JOB,
+	VM_BLOCK_LOOP,
+	VM_BLOCK_CASE,
+};
+
+/**
+ * A block entered by the code and not left yet. Blocks are left in reverse
+ * order, either by the matching instruction or when a command is interrupted.
+ */
+struct vm_block {
+	enum vm_block_type type;
+	size_t begin; // index of the instruction which entered the block
+
+	// VM_BLOCK_JOB
+	struct mrsh_job *prev_job;
+	// VM_BLOCK_LOOP
+	int loop_num;
+	int status; // status of the last run of the loop body
+	struct for_fields fields; // for loops only
+	// VM_BLOCK_CASE
+	char *word;
+};
+
+/**
+ * Leave a block. When a `break` or `continue` with a count is leaving a loop,
+ * the loop has already been accounted for.
+ */
+static void leave_block(struct mrsh_context *ctx, struct vm_block *block,
+		bool end_loop) {
+	switch (block->type) {
+	case VM_BLOCK_JOB:
+		ctx->job = block->prev_job;
+		break;
+	case VM_BLOCK_LOOP:
+		for_fields_finish(&block->fields);
+		if (end_loop) {
+			--call_frame_get_priv(ctx->state->frame)->nloops;
+		}
+		break;
+	case VM_BLOCK_CASE:
+		free(block->word);
+		break;
+	}
+}
+
+static int run_simple(struct mrsh_context *ctx, struct mrsh_pipeline *pl) {
+	struct mrsh_simple_command *sc =
+		mrsh_command_get_simple_command(pl->commands.data[0]);
+	if (ctx->job != NULL) {
+		return run_simple_command(ctx, sc);
+	}
+
+	// Same as run_pipeline, without negating the status
+	struct mrsh_context child_ctx = *ctx;
+	child_ctx.job = job_create(ctx->state, &pl->and_or_list.node);
+	return run_simple_command(&child_ctx, sc);
+}
+
+static int run_builtin(struct mrsh_context *ctx,
+		const struct bytecode_instr *instr) {
+	struct mrsh_state *state = ctx->state;
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	char **argv = instr->arg.builtin.argv;
+
+	// Functions take precedence over builtins. Tracing and profiling are left
+	// to run_simple_command.
+	if ((state->options & (MRSH_OPT_XTRACE | MRSH_OPT_PROFILE)) ||
+			mrsh_hashtable_get(&priv->functions, argv[0]) != NULL) {
+		return run_simple(ctx, instr->pipeline);
+	}
+
+	int ret = mrsh_run_builtin(state, instr->arg.builtin.argc, argv);
+
+	// In case stdout/stderr are pipes, we need to flush to ensure output lines
+	// aren't out-of-order
+	fflush(stdout);
+	fflush(stderr);
+	return ret;
+}
+
+static int run_assign(struct mrsh_context *ctx,
+		const struct bytecode_instr *instr) {
+	if (ctx->state->options & MRSH_OPT_PROFILE) {
+		return run_simple(ctx, instr->pipeline);
+	}
+
+	int ret;
+	if (instr->op == BC_ASSIGN_ARITHM) {
+		long result;
+		if (!mrsh_run_arithm_expr(ctx->state, instr->arg.assign.expr,
+				&result)) {
+			return TASK_STATUS_ERROR;
+		}
+		ret = run_number_assignment(ctx, instr->arg.assign.name, result);
+	} else {
+		ret = run_assignment(ctx, instr->arg.assign.name,
+			instr->arg.assign.value);
+	}
+	return ret < 0 ? ret : 0;
+}
+
+/**
+ * Find the and-or list whose left operand contains the instruction at `index`,
+ * which has failed with a fatal error. Returns the index of the BC_AND or BC_OR
+ * instruction ending the innermost one, or 0 if there's none.
+ */
+static size_t find_and_or(const struct bytecode *code, size_t index) {
+	// Left operands are nested: the first one ending after the instruction
+	// and starting before it is the innermost one
+	for (size_t i = index + 1; i < code->len; ++i) {
+		const struct bytecode_instr *instr = &code->instrs[i];
+		if ((instr->op == BC_AND || instr->op == BC_OR) &&
+				instr->arg.left <= index) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+int run_bytecode(struct mrsh_context *ctx, const struct bytecode *code) {
+	struct mrsh_state *state = ctx->state;
+
+	// Zero-length VLAs are undefined behaviour
+	struct vm_block blocks[code->max_depth + 1];
+	size_t depth = 0;
+
+	struct mrsh_context cmd_ctx = *ctx;
+	int status = 0;
+	size_t pc = 0;
+	while (true) {
+		size_t index = pc++;
+		const struct bytecode_instr *instr = &code->instrs[index];
+		struct vm_block *block = depth > 0 ? &blocks[depth - 1] : NULL;
+		cmd_ctx.tail = ctx->tail && instr->tail;
+
+		switch (instr->op) {
+		case BC_END:
+			assert(depth == 0);
+			return status;
+		case BC_PIPELINE:
+			status = run_pipeline(&cmd_ctx, instr->pipeline);
+			break;
+		case BC_COMMAND:
+			status = run_command(&cmd_ctx, instr->arg.command);
+			break;
+		case BC_SIMPLE_COMMAND:
+			status = run_simple(&cmd_ctx, instr->pipeline);
+			break;
+		case BC_BUILTIN:
+			status = run_builtin(&cmd_ctx, instr);
+			break;
+		case BC_ASSIGN:
+		case BC_ASSIGN_ARITHM:
+			status = run_assign(&cmd_ctx, instr);
+			break;
+		case BC_ASYNC:
+			status = run_async_command_list(&cmd_ctx, instr->arg.list);
+			break;
+		case BC_NOT:
+			if (status >= 0) {
+				status = !status;
+			}
+			break;
+		case BC_CLEAR:
+			status = 0;
+			break;
+		case BC_LIST_END:
+			state->last_status = status;
+			break;
+		case BC_JUMP:
+			pc = instr->target;
+			break;
+		case BC_JUMP_IF_ZERO:
+			if (status == 0) {
+				pc = instr->target;
+			}
+			break;
+		case BC_JUMP_IF_NONZERO:
+			if (status != 0) {
+				pc = instr->target;
+			}
+			break;
+		case BC_AND:
+			if (status != 0) {
+				pc = instr->target;
+			}
+			break;
+		case BC_OR:
+			if (status == 0) {
+				pc = instr->target;
+			} else if (status == TASK_STATUS_ERROR) {
+				// Run the right operand
+				continue;
+			}
+			break;
+		case BC_JOB_BEGIN:
+			blocks[depth++] = (struct vm_block){
+				.type = VM_BLOCK_JOB,
+				.begin = pc - 1,
+				.prev_job = cmd_ctx.job,
+			};
+			if (cmd_ctx.job == NULL) {
+				cmd_ctx.job = job_create(state,
+					&instr->pipeline->and_or_list.node);
+			}
+			break;
+		case BC_LOOP_BEGIN:
+		case BC_FOR_BEGIN:;
+			struct mrsh_call_frame_priv *frame_priv =
+				call_frame_get_priv(state->frame);
+			block = &blocks[depth++];
+			*block = (struct vm_block){
+				.type = VM_BLOCK_LOOP,
+				.begin = pc - 1,
+				.loop_num = ++frame_priv->nloops,
+			};
+			if (instr->op == BC_LOOP_BEGIN) {
+				break;
+			}
+			status = for_fields_init(&cmd_ctx, &block->fields,
+				&instr->arg.for_clause->word_list);
+			break;
+		case BC_LOOP_TEST:
+			if (state->exit != -1) {
+				pc = instr->target;
+			}
+			break;
+		case BC_FOR_NEXT:;
+			const char *field;
+			int next = state->exit != -1 ? 0 :
+				for_fields_next(&block->fields, &field);
+			if (next < 0) {
+				status = next;
+			} else if (next == 0) {
+				pc = instr->target;
+			} else {
+				mrsh_env_set(state, instr->arg.for_clause->name, field,
+					MRSH_VAR_ATTRIB_NONE);
+			}
+			break;
+		case BC_LOOP_NEXT:
+			block->status = status;
+			pc = instr->target;
+			break;
+		case BC_LOOP_END:
+			status = block->status;
+			leave_block(&cmd_ctx, block, true);
+			--depth;
+			break;
+		case BC_JOB_END:
+			leave_block(&cmd_ctx, block, true);
+			--depth;
+			break;
+		case BC_CASE_BEGIN:;
+			struct mrsh_word *word;
+			status = run_word(&cmd_ctx, instr->arg.case_clause->word, &word,
+				TILDE_EXPANSION_NAME);
+			if (status < 0) {
+				break;
+			}
+			blocks[depth++] = (struct vm_block){
+				.type = VM_BLOCK_CASE,
+				.begin = pc - 1,
+				.word = mrsh_word_str(word),
+			};
+			mrsh_word_destroy(word);
+			break;
+		case BC_CASE_MATCH:;
+			int ret;
+			if (instr->arg.pattern.compiled != NULL) {
+				ret = pattern_match(instr->arg.pattern.compiled, block->word);
+			} else if (instr->arg.pattern.literal != NULL) {
+				ret = strcmp(instr->arg.pattern.literal, block->word) == 0;
+			} else {
+				ret = match_case_pattern(&cmd_ctx, instr->arg.pattern.word,
+					block->word);
+			}
+			if (ret < 0) {
+				status = ret;
+			} else if (ret > 0) {
+				pc = instr->target;
+			}
+			break;
+		case BC_CASE_END:
+			leave_block(&cmd_ctx, block, true);
+			--depth;
+			status = 0;
+			break;
+		}
+
+		if (status >= 0) {
+			continue;
+		}
+
+		// A fatal error in the left operand of an and-or list is handled by
+		// the list, after leaving the blocks entered by the operand
+		if (status == TASK_STATUS_ERROR) {
+			size_t and_or = find_and_or(code, index);
+			if (and_or != 0) {
+				size_t left = code->instrs[and_or].arg.left;
+				while (depth > 0 && blocks[depth - 1].begin >= left) {
+					leave_block(&cmd_ctx, &blocks[depth - 1], true);
+					--depth;
+				}
+				pc = and_or;
+				continue;
+			}
+		}
+
+		// The command has failed or has been interrupted: leave blocks until
+		// reaching a loop handling the interruption
+		struct mrsh_call_frame_priv *frame_priv =
+			call_frame_get_priv(state->frame);
+		while (depth > 0) {
+			block = &blocks[depth - 1];
+			if (status == TASK_STATUS_INTERRUPTED &&
+					block->type == VM_BLOCK_LOOP) {
+				if (frame_priv->nloops >= block->loop_num) {
+					break;
+				}
+				// Break to parent loop
+				leave_block(&cmd_ctx, block, false);
+			} else {
+				leave_block(&cmd_ctx, block, true);
+			}
+			--depth;
+		}
+		if (depth == 0) {
+			return status;
+		}
+
+		block->status = status = 0;
+		switch (frame_priv->branch_control) {
+		case MRSH_BRANCH_BREAK:
+		case MRSH_BRANCH_RETURN:
+		case MRSH_BRANCH_EXIT:
+			pc = code->instrs[block->begin].target;
+			break;
+		case MRSH_BRANCH_CONTINUE:
+			pc = block->begin + 1;
+			break;
+		}
+	}
+}
@@ -1,7 +1,6 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <errno.h>
-#include <fnmatch.h>
 #include <mrsh/buffer.h>
 #include <mrsh/parser.h>
 #include <stdio.h>
@@ -10,134 +9,20 @@
 #include <string.h>
 #include <unistd.h>
 #include "builtin.h"
+#include "shell/pattern.h"
 #include "shell/process.h"
 #include "shell/task.h"
 #include "shell/word.h"
 
-#define READ_SIZE 1024
-
-static bool buffer_read_from(struct mrsh_buffer *buf, int fd) {
-	while (true) {
-		char *dst = mrsh_buffer_reserve(buf, READ_SIZE);
-
-		ssize_t n = read(fd, dst, READ_SIZE);
-		if (n < 0 && errno == EINTR) {
-			continue;
-		} else if (n < 0) {
-			perror("read");
-			return false;
-		} else if (n == 0) {
-			break;
-		}
-
-		buf->len += n;
-	}
-
-	return true;
-}
-
-static bool naive_word_streq(struct mrsh_word *word, const char *str) {
-	while (word->type == MRSH_WORD_LIST) {
-		struct mrsh_word_list *wl = mrsh_word_get_list(word);
-		if (wl->children.len != 1) {
-			return false;
-		}
-		word = wl->children.data[0];
-	}
-	if (word->type != MRSH_WORD_STRING) {
-		return false;
-	}
-	struct mrsh_word_string *ws = mrsh_word_get_string(word);
-	return strcmp(ws->str, "trap") == 0;
-}
-
-static bool is_print_traps(struct mrsh_program *program) {
-	if (program->body.len != 1) {
-		return false;
-	}
-	struct mrsh_command_list *cl = program->body.data[0];
-	if (cl->ampersand || cl->and_or_list->type != MRSH_AND_OR_LIST_PIPELINE) {
-		return false;
-	}
-	struct mrsh_pipeline *pipeline =
-		mrsh_and_or_list_get_pipeline(cl->and_or_list);
-	if (pipeline->bang || pipeline->commands.len != 1) {
-		return false;
-	}
-	struct mrsh_command *cmd = pipeline->commands.data[0];
-	if (cmd->type != MRSH_SIMPLE_COMMAND) {
-		return false;
-	}
-	struct mrsh_simple_command *sc = mrsh_command_get_simple_command(cmd);
-	if (sc->name == NULL || !naive_word_streq(sc->name, "trap")) {
-		return false;
-	}
-	if (sc->arguments.len == 1) {
-		struct mrsh_word *arg = sc->arguments.data[0];
-		return naive_word_streq(arg, "--");
-	} else {
-		return sc->arguments.len == 0;
-	}
-}
-
-static void swap_words(struct mrsh_word **word_ptr, struct mrsh_word *new_word) {
-	mrsh_word_destroy(*word_ptr);
-	*word_ptr = new_word;
-}
-
-static int run_word_command(struct mrsh_context *ctx, struct mrsh_word **word_ptr) {
-	struct mrsh_word_command *wc = mrsh_word_get_command(*word_ptr);
-
-	int fds[2];
-	if (pipe(fds) != 0) {
-		perror("pipe");
-		return TASK_STATUS_ERROR;
-	}
-
-	pid_t pid = fork();
-	if (pid < 0) {
-		perror("fork");
-		close(fds[0]);
-		close(fds[1]);
-		return TASK_STATUS_ERROR;
-	} else if (pid == 0) {
-		close(fds[0]);
-
-		if (fds[1] != STDOUT_FILENO) {
-			dup2(fds[1], STDOUT_FILENO);
-			close(fds[1]);
-		}
-
-		init_job_child_process(ctx->state);
-
-		// When a subshell is entered, traps that are not being ignored shall
-		// be set to the default actions, except in the case of a command
-		// substitution containing only a single trap command, when the traps
-		// need not be altered.
-		if (!wc->program || !is_print_traps(wc->program)) {
-			reset_caught_traps(ctx->state);
-		}
-
-		if (wc->program != NULL) {
-			mrsh_run_program(ctx->state, wc->program);
-		}
-
-		exit(ctx->state->exit >= 0 ? ctx->state->exit : 0);
-	}
-
-	struct mrsh_process *process = process_create(ctx->state, pid);
-
-	close(fds[1]);
-	int child_fd = fds[0];
-
+static int run_word_command(struct mrsh_context *ctx,
+		const struct mrsh_word_command *wc, struct mrsh_word **result) {
 	struct mrsh_buffer buf = {0};
-	if (!buffer_read_from(&buf, child_fd)) {
+	int ret = run_command_substitution(ctx, wc->program, &buf);
+	if (ret < 0) {
 		mrsh_buffer_finish(&buf);
-		close(child_fd);
-		return TASK_STATUS_ERROR;
+		return ret;
 	}
 	mrsh_buffer_append_char(&buf, '\0');
-	close(child_fd);
 
 	// Trim newlines at the end
 	ssize_t i = buf.len - 2;
@@ -149,8 +34,8 @@ static int run_word_command(struct mrsh_context *ctx, struct mrsh_word **word_pt
 	struct mrsh_word_string *ws =
 		mrsh_word_string_create(mrsh_buffer_steal(&buf), false);
 	ws->split_fields = true;
-	swap_words(word_ptr, &ws->word);
-	return job_wait_process(process);
+	*result = &ws->word;
+	return ret;
 }
 
 static const char *parameter_get_value(struct mrsh_state *state,
@@ -177,14 +62,8 @@ static const char *parameter_get_value(struct mrsh_state *state,
 		sprintf(value, "%d", (int)getpid());
 		return value;
 	} else if (strcmp(name, "!") == 0) {
-		for (ssize_t i = priv->jobs.len - 1; i >= 0; i--) {
-			struct mrsh_job *job = priv->jobs.data[i];
-			if (job->processes.len == 0) {
-				continue;
-			}
-			struct mrsh_process *process =
-				job->processes.data[job->processes.len - 1];
-			sprintf(value, "%d", process->pid);
+		if (priv->last_async_pid > 0) {
+			sprintf(value, "%d", (int)priv->last_async_pid);
 			return value;
 		}
 		/* Standard is unclear on what to do in this case, mimic dash */
@@ -250,12 +129,13 @@ static struct mrsh_word *create_word_string(const char *str) {
 	return &ws->word;
 }
 
-static struct mrsh_word *copy_word_or_null(struct mrsh_word *word) {
-	if (word != NULL) {
-		return mrsh_word_copy(word);
-	} else {
-		return create_word_string("");
+static int run_word_or_null(struct mrsh_context *ctx,
+		const struct mrsh_word *word, struct mrsh_word **result) {
+	if (word == NULL) {
+		*result = create_word_string("");
+		return 0;
 	}
+	return run_word(ctx, word, result, TILDE_EXPANSION_NONE);
 }
 
 static bool is_null_word(const struct mrsh_word *word) {
@@ -278,7 +158,7 @@ static bool is_null_word(const struct mrsh_word *word) {
 }
 
 static int apply_parameter_cond_op(struct mrsh_context *ctx,
-		struct mrsh_word_parameter *wp, struct mrsh_word *value,
+		const struct mrsh_word_parameter *wp, struct mrsh_word *value,
 		struct mrsh_word **result) {
 	switch (wp->op) {
 	case MRSH_PARAM_NONE:
@@ -287,16 +167,14 @@ static int apply_parameter_cond_op(struct mrsh_context *ctx,
 	case MRSH_PARAM_MINUS: // Use Default Values
 		if (value == NULL || (wp->colon && is_null_word(value))) {
 			mrsh_word_destroy(value);
-			*result = copy_word_or_null(wp->arg);
-		} else {
-			*result = value;
+			return run_word_or_null(ctx, wp->arg, result);
 		}
+		*result = value;
 		return 0;
 	case MRSH_PARAM_EQUAL: // Assign Default Values
 		if (value == NULL || (wp->colon && is_null_word(value))) {
 			mrsh_word_destroy(value);
-			*result = copy_word_or_null(wp->arg);
-			int ret = run_word(ctx, result);
+			int ret = run_word_or_null(ctx, wp->arg, result);
 			if (ret < 0) {
 				return ret;
 			}
@@ -312,8 +190,9 @@ static int apply_parameter_cond_op(struct mrsh_context *ctx,
 			mrsh_word_destroy(value);
 			char *err_msg;
 			if (wp->arg != NULL) {
-				struct mrsh_word *err_msg_word = mrsh_word_copy(wp->arg);
-				int ret = run_word(ctx, &err_msg_word);
+				struct mrsh_word *err_msg_word;
+				int ret = run_word(ctx, wp->arg, &err_msg_word,
+					TILDE_EXPANSION_NONE);
 				if (ret < 0) {
 					return ret;
 				}
@@ -333,12 +212,12 @@ static int apply_parameter_cond_op(struct mrsh_context *ctx,
 		return 0;
 	case MRSH_PARAM_PLUS: // Use Alternative Value
 		if (value == NULL || (wp->colon && is_null_word(value))) {
+			mrsh_word_destroy(value);
 			*result = create_word_string("");
-		} else {
-			*result = copy_word_or_null(wp->arg);
+			return 0;
 		}
 		mrsh_word_destroy(value);
-		return 0;
+		return run_word_or_null(ctx, wp->arg, result);
 	default:
 		abort(); // unreachable
 	}
@@ -358,49 +237,26 @@ static char *trim_str(const char *str, const char *cut, bool suffix) {
 	return strdup(str);
 }
 
-static char *trim_pattern(const char *str, const char *pattern, bool suffix,
-		bool largest) {
-	size_t len = strlen(str);
-	ssize_t begin, end, delta;
-	if ((!suffix && !largest) || (suffix && largest)) {
-		begin = 0;
-		end = len;
-		delta = 1;
-	} else {
-		begin = len - 1;
-		end = -1;
-		delta = -1;
+static char *trim_pattern(struct mrsh_state *state, const char *str,
+		const char *pattern_str, bool suffix, bool largest) {
+	const struct pattern *pattern = pattern_cache_get(state, pattern_str);
+	if (pattern == NULL) {
+		return strdup(str);
 	}
 
-	char *buf = strdup(str);
-	for (ssize_t i = begin; i != end; i += delta) {
-		char ch = buf[i];
-		buf[i] = '\0';
-
-		const char *match, *trimmed;
-		if (!suffix) {
-			match = buf;
-			trimmed = str + i;
-		} else {
-			match = str + i;
-			trimmed = buf;
-		}
-
-		if (fnmatch(pattern, match, 0) == 0) {
-			char *result = strdup(trimmed);
-			free(buf);
-			return result;
-		}
-
-		buf[i] = ch;
+	char *result;
+	if (!suffix) {
+		ssize_t n = pattern_match_prefix(pattern, str, largest);
+		result = strdup(str + (n > 0 ? n : 0));
+	} else {
+		ssize_t n = pattern_match_suffix(pattern, str, largest);
+		result = strndup(str, strlen(str) - (n > 0 ? n : 0));
 	}
-	free(buf);
-
-	return strdup(str);
+	return result;
 }
 
 static int apply_parameter_str_op(struct mrsh_context *ctx,
-		struct mrsh_word_parameter *wp, const char *str,
+		const struct mrsh_word_parameter *wp, const char *str,
 		struct mrsh_word **result) {
 	switch (wp->op) {
 	case MRSH_PARAM_LEADING_HASH: // String Length
@@ -434,8 +290,8 @@ static int apply_parameter_str_op(struct mrsh_context *ctx,
 		bool largest = wp->op == MRSH_PARAM_DPERCENT ||
 			wp->op == MRSH_PARAM_DHASH;
 
-		struct mrsh_word *pattern = mrsh_word_copy(wp->arg);
-		int ret = run_word(ctx, &pattern);
+		struct mrsh_word *pattern;
+		int ret = run_word(ctx, wp->arg, &pattern, TILDE_EXPANSION_NONE);
 		if (ret < 0) {
 			return ret;
 		}
@@ -449,7 +305,8 @@ static int apply_parameter_str_op(struct mrsh_context *ctx,
 			free(arg);
 		} else {
 			mrsh_word_destroy(pattern);
-			result_str = trim_pattern(str, pattern_str, suffix, largest);
+			result_str = trim_pattern(ctx->state, str, pattern_str, suffix,
+				largest);
 			free(pattern_str);
 		}
 
@@ -462,16 +319,28 @@ static int apply_parameter_str_op(struct mrsh_context *ctx,
 	}
 }
 
-static int _run_word(struct mrsh_context *ctx, struct mrsh_word **word_ptr,
-		bool double_quoted) {
-	struct mrsh_word *word = *word_ptr;
-
+/**
+ * Expands `word` into `result`. `first` and `last` indicate whether `word`
+ * begins or ends the top-level word, for tilde expansion purposes.
+ */
+static int _run_word(struct mrsh_context *ctx, const struct mrsh_word *word,
+		struct mrsh_word **result, bool double_quoted,
+		enum tilde_expansion tilde, bool first, bool last) {
 	int ret;
 	switch (word->type) {
 	case MRSH_WORD_STRING:;
+		const struct mrsh_word_string *ws = mrsh_word_get_string(word);
+		if (tilde != TILDE_EXPANSION_NONE && !double_quoted) {
+			*result = expand_tilde_string(ctx->state, ws,
+				tilde == TILDE_EXPANSION_ASSIGNMENT, first, last);
+			if (*result != NULL) {
+				return 0;
+			}
+		}
+		*result = mrsh_word_copy(word);
 		return 0;
 	case MRSH_WORD_PARAMETER:;
-		struct mrsh_word_parameter *wp = mrsh_word_get_parameter(word);
+		const struct mrsh_word_parameter *wp = mrsh_word_get_parameter(word);
 
 		const char *value = parameter_get_value(ctx->state, wp->name);
 		char lineno[16];
@@ -484,7 +353,7 @@ static int _run_word(struct mrsh_context *ctx, struct mrsh_word **word_ptr,
 			value = lineno;
 		}
 
-		struct mrsh_word *result = NULL;
+		struct mrsh_word *expanded = NULL;
 		switch (wp->op) {
 		case MRSH_PARAM_NONE:
 		case MRSH_PARAM_MINUS:
@@ -505,7 +374,7 @@ static int _run_word(struct mrsh_context *ctx, struct mrsh_word **word_ptr,
 				value_word = NULL;
 			}
 
-			ret = apply_parameter_cond_op(ctx, wp, value_word, &result);
+			ret = apply_parameter_cond_op(ctx, wp, value_word, &expanded);
 			if (ret < 0) {
 				return ret;
 			}
@@ -524,42 +393,40 @@ static int _run_word(struct mrsh_context *ctx, struct mrsh_word **word_ptr,
 				return TASK_STATUS_ERROR;
 			}
 
-			ret = apply_parameter_str_op(ctx, wp, value, &result);
+			ret = apply_parameter_str_op(ctx, wp, value, &expanded);
 			if (ret < 0) {
 				return ret;
 			}
 			break;
 		}
 
-		if (result == NULL) {
+		if (expanded == NULL) {
 			if ((ctx->state->options & MRSH_OPT_NOUNSET)) {
 				fprintf(stderr, "%s: %s: unbound variable\n",
 						ctx->state->frame->argv[0], wp->name);
 				return TASK_STATUS_ERROR;
 			}
-			result = create_word_string("");
-		}
-		mark_word_split_fields(result);
-		if (result->type != MRSH_WORD_STRING) {
-			ret = run_word(ctx, &result);
-			if (ret < 0) {
-				return ret;
-			}
+			expanded = create_word_string("");
 		}
-		swap_words(word_ptr, result);
+		mark_word_split_fields(expanded);
+		*result = expanded;
 		return 0;
-	case MRSH_WORD_COMMAND:
-		return run_word_command(ctx, word_ptr);
+	case MRSH_WORD_COMMAND:;
+		const struct mrsh_word_command *wc = mrsh_word_get_command(word);
+		return run_word_command(ctx, wc, result);
 	case MRSH_WORD_ARITHMETIC:;
 		// For arithmetic words, we need to expand the arithmetic expression
 		// before parsing and evaluating it
-		struct mrsh_word_arithmetic *wa = mrsh_word_get_arithmetic(word);
-		ret = run_word(ctx, &wa->body);
+		const struct mrsh_word_arithmetic *wa =
+			mrsh_word_get_arithmetic(word);
+		struct mrsh_word *body;
+		ret = run_word(ctx, wa->body, &body, TILDE_EXPANSION_NONE);
 		if (ret < 0) {
 			return ret;
 		}
 
-		char *body_str = mrsh_word_str(wa->body);
+		char *body_str = mrsh_word_str(body);
+		mrsh_word_destroy(body);
 		struct mrsh_parser *parser =
 			mrsh_parser_with_data(body_str, strlen(body_str));
 		free(body_str);
@@ -577,17 +444,17 @@ static int _run_word(struct mrsh_context *ctx, struct mrsh_word **word_ptr,
 			}
 			ret = TASK_STATUS_ERROR;
 		} else {
-			long result;
-			if (!mrsh_run_arithm_expr(ctx->state, expr, &result)) {
+			long value;
+			if (!mrsh_run_arithm_expr(ctx->state, expr, &value)) {
 				ret = TASK_STATUS_ERROR;
 			} else {
 				char buf[32];
-				snprintf(buf, sizeof(buf), "%ld", result);
+				snprintf(buf, sizeof(buf), "%ld", value);
 
 				struct mrsh_word_string *ws =
 					mrsh_word_string_create(strdup(buf), false);
 				ws->split_fields = true;
-				swap_words(word_ptr, &ws->word);
+				*result = &ws->word;
 				ret = 0;
 			}
 		}
@@ -595,108 +462,304 @@ static int _run_word(struct mrsh_context *ctx, struct mrsh_word **word_ptr,
 		mrsh_parser_destroy(parser);
 		return ret;
 	case MRSH_WORD_LIST:;
-		struct mrsh_word_list *wl = mrsh_word_get_list(word);
+		const struct mrsh_word_list *wl = mrsh_word_get_list(word);
 
+		struct mrsh_array children = {0};
+		mrsh_array_reserve(&children, wl->children.len);
 		struct mrsh_array at_sign_words = {0};
 		for (size_t i = 0; i < wl->children.len; ++i) {
-			struct mrsh_word **child_ptr =
-				(struct mrsh_word **)&wl->children.data[i];
+			const struct mrsh_word *child = wl->children.data[i];
 
 			bool is_at_sign = false;
-			if ((*child_ptr)->type == MRSH_WORD_PARAMETER) {
-				struct mrsh_word_parameter *wp =
-					mrsh_word_get_parameter(*child_ptr);
+			if (child->type == MRSH_WORD_PARAMETER) {
+				const struct mrsh_word_parameter *wp =
+					mrsh_word_get_parameter(child);
 				is_at_sign = strcmp(wp->name, "@") == 0;
 			}
 
-			ret = _run_word(ctx, child_ptr,
-				double_quoted || wl->double_quoted);
+			struct mrsh_word *child_result;
+			ret = _run_word(ctx, child, &child_result,
+				double_quoted || wl->double_quoted, tilde, first && i == 0,
+				last && i == wl->children.len - 1);
 			if (ret < 0) {
+				for (size_t j = 0; j < children.len; ++j) {
+					mrsh_word_destroy(children.data[j]);
+				}
+				mrsh_array_finish(&children);
+				mrsh_array_finish(&at_sign_words);
 				return ret;
 			}
+			mrsh_array_add(&children, child_result);
 
 			if (wl->double_quoted && is_at_sign) {
 				// Fucking $@ needs special handling: we need to extract the
 				// fields it expands to outside of the double quotes
-				mrsh_array_add(&at_sign_words, *child_ptr);
+				mrsh_array_add(&at_sign_words, child_result);
 			}
 		}
 
-		if (at_sign_words.len > 0) {
-			// We need to put $@ expansions outside of the double quotes.
-			// Disclaimer: this is a PITA.
-			struct mrsh_array quoted = {0};
-			struct mrsh_array unquoted = {0};
-			size_t at_sign_idx = 0;
-			for (size_t i = 0; i < wl->children.len; i++) {
-				struct mrsh_word *child = wl->children.data[i];
-				wl->children.data[i] = NULL; // steal the child
-				if (at_sign_idx >= at_sign_words.len ||
-						child != at_sign_words.data[at_sign_idx]) {
-					mrsh_array_add(&quoted, child);
-					continue;
-				}
-
-				if (quoted.len > 0) {
-					struct mrsh_word_list *quoted_wl =
-						mrsh_word_list_create(&quoted, true);
-					mrsh_array_add(&unquoted, &quoted_wl->word);
-					// `unquoted` has been stolen by mrsh_word_list_create
-					quoted = (struct mrsh_array){0};
-				}
-
-				mrsh_array_add(&unquoted, at_sign_words.data[at_sign_idx]);
+		if (at_sign_words.len == 0) {
+			struct mrsh_word_list *result_wl =
+				mrsh_word_list_create(&children, wl->double_quoted);
+			*result = &result_wl->word;
+			return 0;
+		}
 
-				at_sign_idx++;
+		// We need to put $@ expansions outside of the double quotes.
+		// Disclaimer: this is a PITA.
+		struct mrsh_array quoted = {0};
+		struct mrsh_array unquoted = {0};
+		size_t at_sign_idx = 0;
+		for (size_t i = 0; i < children.len; i++) {
+			struct mrsh_word *child = children.data[i];
+			if (at_sign_idx >= at_sign_words.len ||
+					child != at_sign_words.data[at_sign_idx]) {
+				mrsh_array_add(&quoted, child);
+				continue;
 			}
+
 			if (quoted.len > 0) {
 				struct mrsh_word_list *quoted_wl =
 					mrsh_word_list_create(&quoted, true);
 				mrsh_array_add(&unquoted, &quoted_wl->word);
+				// `quoted` has been stolen by mrsh_word_list_create
+				quoted = (struct mrsh_array){0};
 			}
 
-			struct mrsh_word_list *unquoted_wl =
-				mrsh_word_list_create(&unquoted, false);
-			swap_words(word_ptr, &unquoted_wl->word);
+			mrsh_array_add(&unquoted, child);
+
+			at_sign_idx++;
+		}
+		if (quoted.len > 0) {
+			struct mrsh_word_list *quoted_wl =
+				mrsh_word_list_create(&quoted, true);
+			mrsh_array_add(&unquoted, &quoted_wl->word);
 		}
+		mrsh_array_finish(&children);
 		mrsh_array_finish(&at_sign_words);
 
+		struct mrsh_word_list *unquoted_wl =
+			mrsh_word_list_create(&unquoted, false);
+		*result = &unquoted_wl->word;
 		return 0;
 	}
 	abort();
 }
 
-int run_word(struct mrsh_context *ctx, struct mrsh_word **word_ptr) {
-	return _run_word(ctx, word_ptr, false);
+int run_word(struct mrsh_context *ctx, const struct mrsh_word *word,
+		struct mrsh_word **result, enum tilde_expansion tilde) {
+	return _run_word(ctx, word, result, false, tilde, true, true);
+}
+
+/**
+ * Perform field splitting and pathname expansion on an expanded word.
+ */
+static int split_and_expand_pathnames(struct mrsh_array *expanded_fields,
+		const struct mrsh_word *word, const struct ifs_table *ifs,
+		bool noglob, struct glob_cache *cache) {
+	struct mrsh_array fields = {0};
+	split_fields(&fields, word, ifs);
+
+	bool ok = true;
+	if (noglob) {
+		get_fields_str(expanded_fields, &fields);
+	} else {
+		ok = expand_pathnames(expanded_fields, &fields, cache);
+	}
+
+	for (size_t i = 0; i < fields.len; ++i) {
+		mrsh_word_destroy(fields.data[i]);
+	}
+	mrsh_array_finish(&fields);
+
+	return ok ? 0 : TASK_STATUS_ERROR;
 }
 
 int expand_word(struct mrsh_context *ctx, const struct mrsh_word *_word,
 		struct mrsh_array *expanded_fields) {
-	struct mrsh_word *word = mrsh_word_copy(_word);
-	expand_tilde(ctx->state, &word, false);
+	if (_word->literal) {
+		// No expansion, field splitting nor pathname expansion to perform
+		mrsh_array_add(expanded_fields, mrsh_word_str(_word));
+		return 0;
+	}
 
-	int ret = run_word(ctx, &word);
+	struct mrsh_word *word;
+	int ret = run_word(ctx, _word, &word, TILDE_EXPANSION_NAME);
 	if (ret < 0) {
 		return ret;
 	}
 
-	struct mrsh_array fields = {0};
-	const char *ifs = mrsh_env_get(ctx->state, "IFS", NULL);
-	split_fields(&fields, word, ifs);
+	int split_ret = split_and_expand_pathnames(expanded_fields, word,
+		get_ifs_table(ctx->state), ctx->state->options & MRSH_OPT_NOGLOB,
+		ctx->glob_cache);
 	mrsh_word_destroy(word);
 
-	if (ctx->state->options & MRSH_OPT_NOGLOB) {
-		get_fields_str(expanded_fields, &fields);
-	} else {
-		if (!expand_pathnames(expanded_fields, &fields)) {
-			return TASK_STATUS_ERROR;
+	return split_ret < 0 ? split_ret : ret;
+}
+
+/**
+ * Returns the command substitution if the word is made only of an unquoted
+ * one, NULL otherwise.
+ */
+static const struct mrsh_word_command *get_command_word(
+		const struct mrsh_word *word) {
+	while (word->type == MRSH_WORD_LIST) {
+		const struct mrsh_word_list *wl = mrsh_word_get_list(word);
+		if (wl->double_quoted || wl->children.len != 1) {
+			return NULL;
+		}
+		word = wl->children.data[0];
+	}
+	if (word->type != MRSH_WORD_COMMAND) {
+		return NULL;
+	}
+	return mrsh_word_get_command(word);
+}
+
+/**
+ * Split the first `len` bytes of the command output into fields. At the end of
+ * the output, trailing newlines are removed first.
+ */
+static int split_output(struct for_fields *ff, size_t len, bool end) {
+	struct mrsh_buffer *buf = &ff->buf;
+	size_t str_len = len;
+	if (end) {
+		while (str_len > 0 && buf->data[str_len - 1] == '\n') {
+			--str_len;
 		}
 	}
 
-	for (size_t i = 0; i < fields.len; ++i) {
-		mrsh_word_destroy(fields.data[i]);
+	char *str = malloc(str_len + 1);
+	if (str == NULL) {
+		return TASK_STATUS_ERROR;
 	}
-	mrsh_array_finish(&fields);
+	memcpy(str, buf->data, str_len);
+	str[str_len] = '\0';
+	buf->len -= len;
+	memmove(buf->data, buf->data + len, buf->len);
 
+	struct mrsh_word_string *ws = mrsh_word_string_create(str, false);
+	ws->split_fields = true;
+	int ret = split_and_expand_pathnames(&ff->fields, &ws->word, &ff->ifs,
+		ff->noglob, NULL);
+	mrsh_word_destroy(&ws->word);
 	return ret;
 }
+
+/**
+ * Returns a position in the command output such that the output before it can
+ * be split on its own, because the fields it contains are complete. Returns 0
+ * if there is none. Only the output after `from` is new.
+ */
+static size_t output_split_point(const struct for_fields *ff, size_t from) {
+	const uint8_t *classes = ff->ifs.classes;
+	const unsigned char *data = (const unsigned char *)ff->buf.data;
+	size_t len = ff->buf.len;
+
+	// The output can be split at its end if the delimiter there can't be
+	// extended by the output following it. This is the case if it already
+	// contains a non-white space character.
+	bool complete = ff->ifs.only_space;
+	for (size_t i = len; i > 0 && classes[data[i - 1]] != IFS_NONE; --i) {
+		complete = complete || classes[data[i - 1]] == IFS_OTHER;
+		if (complete) {
+			return len;
+		}
+	}
+
+	// Otherwise, split before the last field
+	for (size_t i = len - 1; i > 0 && i >= from; --i) {
+		if (classes[data[i]] == IFS_NONE && classes[data[i - 1]] != IFS_NONE) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+int for_fields_init(struct mrsh_context *ctx, struct for_fields *ff,
+		const struct mrsh_array *words) {
+	size_t len = words->len;
+	const struct mrsh_word_command *wc = NULL;
+	if (len > 0) {
+		wc = get_command_word(words->data[len - 1]);
+		if (wc != NULL) {
+			--len;
+		}
+	}
+
+	struct glob_cache cache = {0};
+	struct mrsh_context words_ctx = *ctx;
+	words_ctx.glob_cache = &cache;
+	for (size_t i = 0; i < len; ++i) {
+		int ret = expand_word(&words_ctx, words->data[i], &ff->fields);
+		if (ret < 0) {
+			glob_cache_finish(&cache);
+			return ret;
+		}
+	}
+	glob_cache_finish(&cache);
+	if (wc == NULL) {
+		return 0;
+	}
+
+	// Changes to IFS or to the noglob option made by the loop body don't
+	// apply to the remaining fields
+	ifs_table_init(&ff->ifs, mrsh_env_get(ctx->state, "IFS", NULL));
+	ff->noglob = ctx->state->options & MRSH_OPT_NOGLOB;
+
+	int ret = command_output_start(ctx, wc->program, &ff->buf, &ff->output);
+	if (ret < 0) {
+		return ret;
+	}
+	if (ff->output == NULL) {
+		// The command has been run in the shell process
+		return split_output(ff, ff->buf.len, true);
+	}
+	return 0;
+}
+
+int for_fields_next(struct for_fields *ff, const char **field) {
+	while (ff->next == ff->fields.len) {
+		for (size_t i = 0; i < ff->fields.len; ++i) {
+			free(ff->fields.data[i]);
+		}
+		ff->fields.len = ff->next = 0;
+
+		if (ff->output == NULL) {
+			return 0;
+		}
+
+		size_t prev_len = ff->buf.len;
+		int ret = command_output_read(ff->output, &ff->buf);
+		if (ret < 0) {
+			return ret;
+		} else if (ret == 0) {
+			command_output_finish(ff->output);
+			ff->output = NULL;
+			ret = split_output(ff, ff->buf.len, true);
+		} else {
+			size_t pos = output_split_point(ff, prev_len);
+			if (pos > 0) {
+				ret = split_output(ff, pos, false);
+			}
+		}
+		if (ret < 0) {
+			return ret;
+		}
+	}
+
+	*field = ff->fields.data[ff->next++];
+	return 1;
+}
+
+void for_fields_finish(struct for_fields *ff) {
+	for (size_t i = 0; i < ff->fields.len; ++i) {
+		free(ff->fields.data[i]);
+	}
+	mrsh_array_finish(&ff->fields);
+	if (ff->output != NULL) {
+		command_output_finish(ff->output);
+	}
+	mrsh_buffer_finish(&ff->buf);
+	ifs_table_finish(&ff->ifs);
+}
@@ -123,6 +123,19 @@ bool reset_caught_traps(struct mrsh_state *state) {
 	return true;
 }
 
+bool has_caught_traps(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+
+	for (size_t i = 0; i < MRSH_NSIG; i++) {
+		struct mrsh_trap *trap = &priv->traps[i];
+		if (trap->set && trap->action == MRSH_TRAP_CATCH) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool run_pending_traps(struct mrsh_state *state) {
 	struct mrsh_state_priv *priv = state_get_priv(state);
 	static bool in_trap = false;
@@ -142,7 +155,10 @@ bool run_pending_traps(struct mrsh_state *state) {
 				break;
 			}
 
+			const char *prev_source = priv->source;
+			priv->source = "trap";
 			int ret = mrsh_run_program(state, trap->program);
+			priv->source = prev_source;
 			if (ret < 0) {
 				return false;
 			}
@@ -1,12 +1,12 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
-#include <ctype.h>
-#include <glob.h>
 #include <mrsh/buffer.h>
 #include <pwd.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include "shell/glob.h"
 #include "shell/shell.h"
 #include "shell/word.h"
 
@@ -57,20 +57,39 @@ static ssize_t expand_tilde_at(struct mrsh_state *state, const char *str,
 	return slash - str;
 }
 
-static void _expand_tilde(struct mrsh_state *state, struct mrsh_word **word_ptr,
-		bool assignment, bool first, bool last) {
-	struct mrsh_word *word = *word_ptr;
-	switch (word->type) {
-	case MRSH_WORD_STRING:;
-		struct mrsh_word_string *ws = mrsh_word_get_string(word);
-		if (ws->single_quoted) {
-			break;
+struct mrsh_word *expand_tilde_string(struct mrsh_state *state,
+		const struct mrsh_word_string *ws, bool assignment, bool first,
+		bool last) {
+	if (ws->single_quoted) {
+		return NULL;
+	}
+
+	struct mrsh_array words = {0};
+
+	const char *str = ws->str;
+	if (first) {
+		char *expanded;
+		ssize_t offset = expand_tilde_at(state, str, last, &expanded);
+		if (offset >= 0) {
+			mrsh_array_add(&words,
+				mrsh_word_string_create(expanded, true));
+			str += offset;
 		}
+	}
 
-		struct mrsh_array words = {0};
+	if (assignment) {
+		while (true) {
+			const char *colon = strchr(str, ':');
+			if (colon == NULL) {
+				break;
+			}
+
+			char *slice = strndup(str, colon - str + 1);
+			mrsh_array_add(&words,
+				mrsh_word_string_create(slice, false));
+
+			str = colon + 1;
 
-		const char *str = ws->str;
-		if (first) {
 			char *expanded;
 			ssize_t offset = expand_tilde_at(state, str, last, &expanded);
 			if (offset >= 0) {
@@ -79,37 +98,29 @@ static void _expand_tilde(struct mrsh_state *state, struct mrsh_word **word_ptr,
 				str += offset;
 			}
 		}
+	}
 
-		if (assignment) {
-			while (true) {
-				const char *colon = strchr(str, ':');
-				if (colon == NULL) {
-					break;
-				}
-
-				char *slice = strndup(str, colon - str + 1);
-				mrsh_array_add(&words,
-					mrsh_word_string_create(slice, false));
-
-				str = colon + 1;
+	if (words.len == 0) {
+		return NULL;
+	}
 
-				char *expanded;
-				ssize_t offset = expand_tilde_at(state, str, last, &expanded);
-				if (offset >= 0) {
-					mrsh_array_add(&words,
-						mrsh_word_string_create(expanded, true));
-					str += offset;
-				}
-			}
-		}
+	char *trailing = strdup(str);
+	mrsh_array_add(&words, mrsh_word_string_create(trailing, false));
 
-		if (words.len > 0) {
-			char *trailing = strdup(str);
-			mrsh_array_add(&words,
-				mrsh_word_string_create(trailing, false));
+	struct mrsh_word_list *wl = mrsh_word_list_create(&words, false);
+	return &wl->word;
+}
 
-			struct mrsh_word_list *wl = mrsh_word_list_create(&words, false);
-			*word_ptr = &wl->word;
+static void _expand_tilde(struct mrsh_state *state, struct mrsh_word **word_ptr,
+		bool assignment, bool first, bool last) {
+	struct mrsh_word *word = *word_ptr;
+	switch (word->type) {
+	case MRSH_WORD_STRING:;
+		struct mrsh_word_string *ws = mrsh_word_get_string(word);
+		struct mrsh_word *expanded =
+			expand_tilde_string(state, ws, assignment, first, last);
+		if (expanded != NULL) {
+			*word_ptr = expanded;
 			mrsh_word_destroy(word);
 		}
 		break;
@@ -135,11 +146,51 @@ void expand_tilde(struct mrsh_state *state, struct mrsh_word **word_ptr,
 	_expand_tilde(state, word_ptr, assignment, true, true);
 }
 
+void ifs_table_init(struct ifs_table *table, const char *ifs) {
+	table->value = ifs != NULL ? strdup(ifs) : NULL;
+	if (ifs == NULL) {
+		ifs = " \t\n";
+	}
+
+	memset(table->classes, IFS_NONE, sizeof(table->classes));
+	table->classes[0] = IFS_END;
+	table->only_space = true;
+	for (const char *c = ifs; *c != '\0'; ++c) {
+		bool space = *c == ' ' || *c == '\t' || *c == '\n';
+		table->classes[(unsigned char)*c] = space ? IFS_SPACE : IFS_OTHER;
+		table->only_space = table->only_space && space;
+	}
+}
+
+void ifs_table_finish(struct ifs_table *table) {
+	free(table->value);
+	table->value = NULL;
+}
+
+const struct ifs_table *get_ifs_table(struct mrsh_state *state) {
+	struct mrsh_state_priv *priv = state_get_priv(state);
+	struct ifs_table *table = &priv->ifs_table;
+
+	const char *ifs = mrsh_env_get(state, "IFS", NULL);
+	if (priv->ifs_table_valid) {
+		if (ifs == NULL ? table->value == NULL :
+				table->value != NULL && strcmp(ifs, table->value) == 0) {
+			return table;
+		}
+		ifs_table_finish(table);
+	}
+
+	ifs_table_init(table, ifs);
+	priv->ifs_table_valid = true;
+	return table;
+}
+
 struct split_fields_data {
 	struct mrsh_array *fields;
+	const struct ifs_table *ifs;
 	struct mrsh_word_list *cur_field;
-	const char *ifs, *ifs_non_space;
-	bool in_ifs, in_ifs_non_space;
+	bool in_field; // the current field isn't empty
+	bool after_space; // a field has just been ended by IFS white space
 };
 
 static void add_to_cur_field(struct split_fields_data *data,
@@ -149,6 +200,59 @@ static void add_to_cur_field(struct split_fields_data *data,
 		mrsh_array_add(data->fields, data->cur_field);
 	}
 	mrsh_array_add(&data->cur_field->children, word);
+	data->in_field = true;
+	data->after_space = false;
+}
+
+static void add_delimiter(struct split_fields_data *data,
+		enum ifs_char_class class) {
+	if (data->in_field) {
+		data->cur_field = NULL;
+		data->in_field = false;
+		data->after_space = class == IFS_SPACE;
+	} else if (class == IFS_OTHER) {
+		// A non-white space delimiter right after the beginning or another
+		// delimiter, except IFS white space, delimits an empty field
+		if (!data->after_space) {
+			struct mrsh_word_string *ws =
+				mrsh_word_string_create(strdup(""), false);
+			mrsh_array_add(data->fields, &ws->word);
+		}
+		data->after_space = false;
+	}
+}
+
+static void split_string(struct split_fields_data *data, const char *str) {
+	const uint8_t *classes = data->ifs->classes;
+	while (true) {
+		// Find the end of the run of regular characters
+		size_t len = 0;
+		while (classes[(unsigned char)str[len]] == IFS_NONE) {
+			++len;
+		}
+
+		if (len > 0) {
+			struct mrsh_word_string *ws =
+				mrsh_word_string_create(strndup(str, len), false);
+			if (data->cur_field == NULL && str[len] != '\0') {
+				// The field is delimited on both ends: no need for a list
+				mrsh_array_add(data->fields, &ws->word);
+				data->in_field = true;
+			} else {
+				add_to_cur_field(data, &ws->word);
+			}
+			str += len;
+		}
+
+		enum ifs_char_class class;
+		while ((class = classes[(unsigned char)*str]) != IFS_NONE) {
+			if (class == IFS_END) {
+				return;
+			}
+			add_delimiter(data, class);
+			++str;
+		}
+	}
 }
 
 static void _split_fields(struct split_fields_data *data,
@@ -159,41 +263,10 @@ static void _split_fields(struct split_fields_data *data,
 
 		if (ws->single_quoted || !ws->split_fields) {
 			add_to_cur_field(data, mrsh_word_copy(word));
-			data->in_ifs = data->in_ifs_non_space = false;
 			return;
 		}
 
-		struct mrsh_buffer buf = {0};
-		size_t len = strlen(ws->str);
-		for (size_t i = 0; i < len; ++i) {
-			char c = ws->str[i];
-			if (strchr(data->ifs, c) == NULL) {
-				mrsh_buffer_append_char(&buf, c);
-				data->in_ifs = data->in_ifs_non_space = false;
-				continue;
-			}
-
-			bool is_ifs_non_space = strchr(data->ifs_non_space, c) != NULL;
-			if (!data->in_ifs || (is_ifs_non_space && data->in_ifs_non_space)) {
-				mrsh_buffer_append_char(&buf, '\0');
-				char *str = mrsh_buffer_steal(&buf);
-				add_to_cur_field(data,
-					&mrsh_word_string_create(str, false)->word);
-				data->cur_field = NULL;
-				data->in_ifs = true;
-			} else if (is_ifs_non_space) {
-				data->in_ifs_non_space = true;
-			}
-		}
-
-		if (!data->in_ifs) {
-			mrsh_buffer_append_char(&buf, '\0');
-			char *str = mrsh_buffer_steal(&buf);
-			add_to_cur_field(data,
-				&mrsh_word_string_create(str, false)->word);
-		}
-
-		mrsh_buffer_finish(&buf);
+		split_string(data, ws->str);
 		break;
 	case MRSH_WORD_LIST:;
 		const struct mrsh_word_list *wl = mrsh_word_get_list(word);
@@ -214,38 +287,25 @@ static void _split_fields(struct split_fields_data *data,
 }
 
 void split_fields(struct mrsh_array *fields, const struct mrsh_word *word,
-		const char *ifs) {
-	if (ifs == NULL) {
-		ifs = " \t\n";
-	} else if (ifs[0] == '\0') {
-		mrsh_array_add(fields, mrsh_word_copy(word));
-		return;
-	}
-
-	size_t ifs_len = strlen(ifs);
-	char *ifs_non_space = calloc(ifs_len, sizeof(char));
-	size_t ifs_non_space_len = 0;
-	for (size_t i = 0; i < ifs_len; ++i) {
-		if (!isspace(ifs[i])) {
-			ifs_non_space[ifs_non_space_len++] = ifs[i];
-		}
-	}
-
+		const struct ifs_table *ifs) {
 	struct split_fields_data data = {
 		.fields = fields,
 		.ifs = ifs,
-		.ifs_non_space = ifs_non_space,
-		.in_ifs = true,
 	};
 	_split_fields(&data, word);
+}
 
-	free(ifs_non_space);
+static char *field_str(const struct mrsh_word *field) {
+	if (field->type == MRSH_WORD_STRING) {
+		return strdup(mrsh_word_get_string(field)->str);
+	}
+	return mrsh_word_str(field);
 }
 
 void get_fields_str(struct mrsh_array *strs, const struct mrsh_array *fields) {
 	for (size_t i = 0; i < fields->len; i++) {
 		struct mrsh_word *word = fields->data[i];
-		mrsh_array_add(strs, mrsh_word_str(word));
+		mrsh_array_add(strs, field_str(word));
 	}
 }
 
@@ -335,33 +395,32 @@ char *word_to_pattern(const struct mrsh_word *word) {
 }
 
 bool expand_pathnames(struct mrsh_array *expanded,
-		const struct mrsh_array *fields) {
-	for (size_t i = 0; i < fields->len; ++i) {
+		const struct mrsh_array *fields, struct glob_cache *cache) {
+	// Without a cache shared with the other words, the fields of this word
+	// still share one
+	struct glob_cache word_cache = {0};
+	if (cache == NULL) {
+		cache = &word_cache;
+	}
+
+	bool ok = true;
+	for (size_t i = 0; ok && i < fields->len; ++i) {
 		const struct mrsh_word *field = fields->data[i];
 
 		char *pattern = word_to_pattern(field);
 		if (pattern == NULL) {
-			mrsh_array_add(expanded, mrsh_word_str(field));
+			mrsh_array_add(expanded, field_str(field));
 			continue;
 		}
 
-		glob_t glob_buf;
-		int ret = glob(pattern, GLOB_NOSORT, NULL, &glob_buf);
-		if (ret == 0) {
-			for (size_t i = 0; i < glob_buf.gl_pathc; ++i) {
-				mrsh_array_add(expanded, strdup(glob_buf.gl_pathv[i]));
-			}
-			globfree(&glob_buf);
-		} else if (ret == GLOB_NOMATCH) {
+		size_t len = expanded->len;
+		ok = glob_expand(cache, pattern, expanded);
+		if (ok && expanded->len == len) {
 			mrsh_array_add(expanded, mrsh_word_str(field));
-		} else {
-			fprintf(stderr, "glob failed: %d\n", ret);
-			free(pattern);
-			return false;
 		}
-
 		free(pattern);
 	}
 
-	return true;
+	glob_cache_finish(&word_cache);
+	return ok;
 }
@@ -49,3 +49,18 @@ echo "(a+=1) =" $((a+=1)) "->" $a
 echo "(a-=4) =" $((a-=4)) "->" $a
 echo "(a*=9) =" $((a*=9)) "->" $a
 echo "(a/=3) =" $((a/=3)) "->" $a
+
+# Variables keep their string and integer values in sync
+i=0
+while [ $i -lt 3 ]; do
+	i=$((i+1))
+	: $((j+=i))
+done
+echo "i =" $i "j =" $j
+export j
+sh -c 'echo "exported j =" $j'
+j=abc
+echo "j =" $j
+a=5
+(a=$((a*2)); echo "a in subshell =" $a)
+echo "a =" $a "a+1 =" $((a+1))
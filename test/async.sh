@@ -24,3 +24,24 @@ echo Job 2 exited with status $s2
 #kill -kill $pid
 #wait $pid
 #echo $pid was terminated by a SIG$(kill -l $?) signal.
+
+echo >&2 "Wait for jobs finishing in any order"
+sh -c "sleep 0.2; exit 3" &
+p1=$!
+sh -c "exit 4" &
+p2=$!
+wait $p1
+s1=$?
+wait $p2
+s2=$?
+echo Job 1 exited with status $s1
+echo Job 2 exited with status $s2
+
+echo >&2 "Wait for many jobs"
+i=0
+while [ $i -lt 200 ]; do
+	: &
+	i=$((i+1))
+done
+wait
+echo Waited for all jobs: $?
@@ -89,3 +89,37 @@ case hello in
 	*)
 		echo pass
 esac
+
+echo "patterns are expanded on each run"
+for x in a b; do
+	p=$x
+	case a in
+		$p)
+			echo "$x matches"
+			;;
+		*)
+			echo "$x doesn't match"
+			;;
+	esac
+done
+
+echo "bracket expressions and quoting"
+for x in a B 3 - ']' '*' '\' '[a'; do
+	case "$x" in
+		[[:digit:]])
+			echo "$x digit"
+			;;
+		"*"|\\)
+			echo "$x quoted"
+			;;
+		[a)
+			echo "$x unclosed bracket"
+			;;
+		[!a-z]|[]])
+			echo "$x not a lowercase letter"
+			;;
+		*)
+			echo "$x other"
+			;;
+	esac
+done
@@ -23,3 +23,8 @@ then
 else
 	echo "ko"
 fi
+
+# Assignments only apply to the environment of the utility
+export ASSIGNED=old
+ASSIGNED=new NOT_EXPORTED=x NOT_EXPORTED=y sh -c 'echo $ASSIGNED $NOT_EXPORTED'
+echo $ASSIGNED ${NOT_EXPORTED-unset}
@@ -0,0 +1,137 @@
+#!/bin/sh
+
+dir=$(mktemp -d)
+MRSH_CACHE_DIR="$dir/cache"
+lib="$dir/lib.sh"
+
+cat >"$lib" <<'END'
+greet() {
+	case "$1" in
+	a|b) echo "greet $1" ;;
+	*) echo "other ${1:-none} $(echo "sub $1") $((1 + 2))" ;;
+	esac
+}
+for i in 1 2; do
+	if [ "$i" = 1 ]; then greet a; else greet "x y"; fi
+done
+x=1 && echo "x=$x" || echo no
+! false | cat 2>/dev/null >&2 && echo "pipeline"
+END
+# Files modified less than a few seconds ago aren't cached
+touch -t 200001010000 "$lib"
+
+echo "Sourcing a file"
+. "$lib"
+
+echo "Sourcing a file again"
+. "$lib"
+greet
+
+echo "Sourcing a modified file"
+echo 'echo "appended"' >>"$lib"
+. "$lib"
+
+# Only mrsh caches parsed files: the checks run mrsh directly, and other
+# shells print the expected output instead
+check_cache() {
+	cached="$dir/cached.sh"
+	cache="$dir/dot-cache"
+	cat >"$cached" <<-'END'
+	echo "line $LINENO"
+	f() {
+	echo "f at line $LINENO"
+	}
+	END
+	touch -t 200001010000 "$cached"
+
+	echo "Sourced files are cached"
+	MRSH_CACHE_DIR=$cache "$MRSH" -c '. "$1"; f' sh "$cached"
+	ls "$cache" | grep -c '\.ast$'
+	ls -i "$cache" >"$dir/inodes"
+	MRSH_CACHE_DIR=$cache "$MRSH" -c '. "$1"; f' sh "$cached"
+	ls -i "$cache" | cmp -s - "$dir/inodes" && echo "cache file reused"
+
+	echo "Sourced files rewritten with the same size are parsed again"
+	cat >"$cached" <<-'END'
+	echo "LINE $LINENO"
+	f() {
+	echo "F AT LINE $LINENO"
+	}
+	END
+	MRSH_CACHE_DIR=$cache "$MRSH" -c '. "$1"; f' sh "$cached"
+	cat >"$cached" <<-'END'
+	echo "line $LINENO"
+	f() {
+	echo "f at line $LINENO" )
+	END
+	MRSH_CACHE_DIR=$cache "$MRSH" -c '. "$1"' sh "$cached" 2>&1 |
+		sed "s|$dir|DIR|"
+
+	script="$dir/script.sh"
+	cache="$dir/script-cache"
+	cat >"$script" <<-'END'
+	echo "line $LINENO"
+
+	if true; then
+	echo "line $LINENO"
+	fi
+	END
+	touch -t 200001010000 "$script"
+
+	echo "Scripts are cached"
+	MRSH_CACHE_DIR=$cache "$MRSH" "$script"
+	ls "$cache" | grep -c '\.ast$'
+	ls -i "$cache" >"$dir/inodes"
+	MRSH_CACHE_DIR=$cache "$MRSH" "$script"
+	ls -i "$cache" | cmp -s - "$dir/inodes" && echo "cache file reused"
+
+	echo "Scripts rewritten with the same size are parsed again"
+	cat >"$script" <<-'END'
+	echo "LINE $LINENO"
+
+	if true; then
+	echo "LINE $LINENO"
+	fi
+	END
+	MRSH_CACHE_DIR=$cache "$MRSH" "$script"
+	cat >"$script" <<-'END'
+	echo "line $LINENO"
+
+	f() true then
+	echo "line $LINENO"
+	fi
+	END
+	MRSH_CACHE_DIR=$cache "$MRSH" "$script" 2>&1 | sed "s|$dir|DIR|"
+}
+
+if (set -o bytecode) 2>/dev/null; then
+	check_cache
+else
+	cat <<-'END'
+	Sourced files are cached
+	line 1
+	f at line 3
+	1
+	line 1
+	f at line 3
+	cache file reused
+	Sourced files rewritten with the same size are parsed again
+	LINE 1
+	F AT LINE 3
+	DIR/cached.sh 3:26: expected '}'
+	Scripts are cached
+	line 1
+	line 4
+	1
+	line 1
+	line 4
+	cache file reused
+	Scripts rewritten with the same size are parsed again
+	LINE 1
+	LINE 4
+	line 1
+	DIR/script.sh:3:5: syntax error: expected a compound command
+	END
+fi
+
+rm -rf "$dir"
@@ -0,0 +1,19 @@
+#!/bin/sh
+
+echo "Exported and unexported variables"
+export mrsh_a=1
+mrsh_b=2
+env | grep '^mrsh_' | sort
+
+echo "Assignments before a utility"
+mrsh_b=3 mrsh_c=4 env | grep '^mrsh_' | sort
+env | grep '^mrsh_' | sort
+
+echo "Exported variables stay exported"
+mrsh_a=changed
+export mrsh_b
+env | grep '^mrsh_' | sort
+
+echo "Unset variables"
+unset mrsh_a
+env | grep '^mrsh_' | sort
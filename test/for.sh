@@ -37,3 +37,39 @@ echo "Field splitting in for loop, with IFS set"
 		echo $c
 	done
 )
+
+echo "Command substitution output split while the loop runs"
+for c in $(i=0; while [ $i -lt 2000 ]; do echo "line $i"; i=$((i+1)); done); do
+	last=$c
+done
+echo $last
+(
+	IFS=':'
+	for c in $(echo a:b c; echo d:e); do
+		IFS=' '
+		echo "$c"
+	done
+)
+(
+	set -f
+	for c in $(i=0; while [ $i -lt 2000 ]; do echo '*'; i=$((i+1)); done); do
+		set +f
+		last=$c
+	done
+	echo "$last"
+)
+for c in $(i=0; while [ $i -lt 20000 ]; do echo $i; i=$((i+1)); done); do
+	echo $c
+	break
+done
+f() {
+	for c in $(echo 1 2 3); do
+		[ $c = 2 ] && return $c
+	done
+}
+f
+echo $?
+for c in $(false); do
+	echo invalid
+done
+echo $?
@@ -35,3 +35,12 @@ func_e hello
 
 output=$(func_a)
 echo "output is $output"
+
+func_redefine() {
+	func_redefine() {
+		echo "new definition"
+	}
+	echo "old definition"
+}
+func_redefine
+func_redefine
@@ -3,7 +3,7 @@ dir=$(dirname "$0")
 testcase="$1"
 
 echo "Running with mrsh"
-mrsh_out=$("$MRSH" "$testcase")
+mrsh_out=$("$MRSH" $MRSH_FLAGS "$testcase")
 mrsh_ret=$?
 echo "Running with reference shell ($REF_SH)"
 ref_out=$("$REF_SH" "$testcase")
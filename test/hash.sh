@@ -0,0 +1,44 @@
+#!/bin/sh
+
+dir=$(mktemp -d)
+mkdir "$dir/a" "$dir/b"
+printf '#!/bin/sh\necho a\n' >"$dir/a/hashtest"
+printf '#!/bin/sh\necho b\n' >"$dir/b/hashtest"
+chmod +x "$dir/a/hashtest" "$dir/b/hashtest"
+oldpath=$PATH
+
+echo "Utility is found in PATH"
+PATH="$dir/a:$oldpath"
+hashtest
+hashtest
+
+echo "Assigning PATH forgets remembered locations"
+PATH="$dir/b:$oldpath"
+hashtest
+
+echo "hash -r forgets remembered locations"
+PATH="$dir/a:$oldpath"
+hashtest
+rm "$dir/a/hashtest"
+hash -r
+hashtest 2>/dev/null || echo "not found"
+
+echo "Removed utilities are searched again"
+PATH="$dir/a:$dir/b:$oldpath"
+printf '#!/bin/sh\necho a\n' >"$dir/a/hashtest"
+chmod +x "$dir/a/hashtest"
+hashtest
+rm "$dir/a/hashtest"
+hashtest
+hashtest
+hash | grep -c hashtest
+
+echo "hash remembers utilities"
+PATH="$dir/b:$oldpath"
+hash hashtest
+echo $?
+hash idontexist 2>/dev/null
+echo $?
+
+PATH=$oldpath
+rm -r "$dir"
@@ -31,6 +31,27 @@ while true; do
 done
 echo stop
 
+echo "continue on the last iteration shouldn't affect the loop status"
+n=0
+while [ "$n" != 3 ]; do
+	n=$((n+1))
+	continue
+done; echo "status: $?"
+
+echo "break and continue with a count"
+for a in 1 2; do
+	for b in 1 2; do
+		for c in 1 2; do
+			break 2
+		done
+		echo "b $b"
+	done
+	for b in 1 2; do
+		continue 2
+	done
+	echo "a $a"
+done; echo "status: $?"
+
 echo "exit in infinite loop should exit immediately"
 while true
 do
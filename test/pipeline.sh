@@ -35,3 +35,6 @@ echo "Pipeline with brace group"
 #		i=$((i+1))
 #	done
 #) | head -n 1
+
+echo "Pipeline with external command after a list"
+{ false; sh -c 'echo "status $0"' $?; } | sed s/status/Status/
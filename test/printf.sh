@@ -0,0 +1,35 @@
+#!/bin/sh
+
+echo "echo interprets escapes"
+echo "a\tb\\c" "d"
+echo "\0101\0102"
+echo "before\cafter"
+echo -n "no newline"
+echo
+
+echo "printf conversions"
+printf '%d|%i|%o|%u|%x|%X\n' 42 -7 8 3 255 255
+printf '%5d|%-5d|%05d|%+d\n' 1 2 3 4
+printf '%s|%10s|%-10s|%.2s\n' abc def ghi jklmn
+printf '%c|%c\n' xyz ""
+printf '%.2f|%e|%g\n' 3.14159 1000 0.5
+printf '%*d|%.*s\n' 4 7 3 abcdef
+printf '%%|\101|\n'
+
+echo "printf character constants"
+printf '%d %d\n' "'A" '"a'
+
+echo "printf reuses the format"
+printf '%s=%s\n' a 1 b 2 c
+printf 'no conversion\n' extra arguments
+
+echo "printf %b"
+printf '%b|%s\n' 'a\tb' 'a\tb'
+printf '%b\n' 'one\ctwo' three
+printf '%b' '\0060\n'
+
+echo "printf invalid numbers"
+printf '%d\n' 12abc 2>/dev/null
+echo $?
+printf '%d\n' abc 2>/dev/null
+echo $?
@@ -9,3 +9,82 @@ uname >&2
 echo 2>&1 "stderr to stdout"
 uname 2>&1
 #(echo >&2 asdf) 2>&1
+
+echo >&2 "Here-documents"
+x=world
+cat <<EOF
+hello $x $(echo sub) `echo bq` $((1 + 2))
+	tab \$x \\
+EOF
+cat <<'EOF'
+hello $x $(echo sub)
+EOF
+cat <<-EOF
+	trimmed $x
+	EOF
+cat <<A <<B
+first
+A
+second
+B
+cat <<EOF
+EOF
+
+echo >&2 "Large here-documents"
+big=$(i=0; while [ $i -lt 1000 ]; do echo "line $i"; i=$((i+1)); done)
+wc -c <<EOF
+$big
+EOF
+cat <<EOF | tail -n 2
+$big
+EOF
+i=0
+while [ $i -lt 3 ]; do
+	wc -l <<-EOF
+	$big
+	$i
+	EOF
+	i=$((i+1))
+done
+
+# Redirections of utilities are applied in order
+dir=$(mktemp -d)
+sh -c 'echo three >&3; echo four >&4' 4>"$dir/4" 3>"$dir/3"
+cat "$dir/3" "$dir/4"
+sh -c 'echo three >&3; echo four >&4' 3>"$dir/3" 4>&3
+cat "$dir/3"
+sh -c 'echo err >&2' 2>&1 >/dev/null | tr a-z A-Z
+rm -rf "$dir"
+
+# Large here-documents don't need a writable temporary directory
+(
+	TMPDIR=/nonexistent
+	wc -c <<-EOF
+	$big
+	EOF
+	cat <<-EOF | tail -n 1
+	$big
+	EOF
+)
+
+echo >&2 "Failed redirections in and-or lists"
+echo hi >/nonexistent/x || echo fail
+echo next
+(true && echo hi >/nonexistent/x) || echo subshell
+for i in 1 2; do
+	echo $i >/nonexistent/x || continue
+	echo unreachable
+done
+i=0
+while echo $i >/nonexistent/x || [ $i -lt 2 ]; do
+	i=$((i+1))
+done
+echo $i
+case x in
+x) echo hi >/nonexistent/x || echo case ;;
+esac
+f() {
+	echo hi >/nonexistent/x || return 3
+}
+f
+echo $?
@@ -30,3 +30,9 @@ then
 fi
 
 func_c
+
+func_d() {
+	return 3
+}
+
+func_d || echo "func d returned $?"
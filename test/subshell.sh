@@ -17,3 +17,22 @@ echo "Multi-line subshell"
 	echo a
 	echo b
 )
+
+echo "Subshell with external commands"
+(sh -c 'exit 3'; echo "after first")
+(true && sh -c 'exit 4')
+echo $?
+
+echo "Command substitution isolation"
+f() {
+	v=inner
+	echo "f $1"
+}
+v=outer
+out=$(f arg; unset v; cd /; umask 077; exit 3; echo unreachable)
+echo "$out $v"
+[ "$(pwd)" != / ] && echo "cwd restored"
+umask
+echo $(echo nested $(f deep))
+lines=$(i=0; while [ $i -lt 10000 ]; do echo line $i; i=$((i+1)); done)
+echo ${#lines}
@@ -0,0 +1,94 @@
+#!/bin/sh
+
+t() {
+	test "$@"
+	echo "test $*: $?"
+	[ "$@" ]
+	echo "[ $* ]: $?"
+}
+
+echo "Zero and one argument"
+t
+t ""
+t a
+t !
+t -n
+
+echo "Two arguments"
+t ! ""
+t ! a
+t -n ""
+t -n a
+t -z ""
+t -z a
+
+echo "Three arguments"
+t a = a
+t a = b
+t a != b
+t "" != ""
+t ! = !
+t ! -n ""
+t ! -z ""
+t "(" a ")"
+t "(" "" ")"
+t a -a ""
+t a -o ""
+t -n = -n
+
+echo "Four arguments"
+t ! a = b
+t ! "(" a ")"
+t "(" ! a ")"
+t "(" -n "" ")"
+
+echo "More arguments"
+t a = a -a b = b
+t a = b -o b = b
+t a = b -a b = b -o c = c
+t ! a = b -a ! "" != ""
+t "(" a = b -o b = b ")" -a c = c
+
+echo "Integers"
+t 1 -eq 1
+t 1 -eq 2
+t -3 -lt 2
+t 10 -gt 9
+t 10 -ge 10
+t 10 -le 9
+t 4 -ne 4
+t 007 -eq 7
+
+echo "Files"
+dir=$(mktemp -d)
+cd "$dir" || exit 1
+touch file
+echo data >data
+mkdir dir
+ln -s file link
+t -e file
+t -e nope
+t -f file
+t -f dir
+t -d dir
+t -d file
+t -s file
+t -s data
+t -h link
+t -L file
+t -r file
+t -x dir
+t -p file
+t -S file
+t file -ef link
+t file -ef data
+t -t 42
+cd /
+rm -r "$dir"
+
+echo "Errors"
+t 1 -eq a 2>/dev/null
+t a b 2>/dev/null
+t "(" a 2>/dev/null
+[ a 2>/dev/null
+echo "[ a: $?"
@@ -96,6 +96,10 @@ echo ${x#$HOME}
 # ${parameter##word}
 x=/one/two/three
 echo ${x##*/}
+x=abcabc
+echo "${x#abcabc}|${x##*}|${x%abcabc}|${x%%*}|${x#*}|${x%*}"
+echo "${x#*b}|${x##*b}|${x%b*}|${x%%b*}|${x#[[:lower:]]}|${x%?}"
+echo "${x#"*"}|${x%\c}|${x##[!a]*}|${x##a*[bc]}"
 
 echo ""
 echo "Command Substitution"
@@ -109,6 +113,44 @@ echo `
 	echo asdf
 `
 
-# Field Splitting
+echo ""
+echo "Field Splitting"
+fields() {
+	printf "%s:" "$#"
+	printf "[%s]" "$@"
+	echo
+}
+x="  a  b	c
+d  "
+fields $x
+(
+	IFS=": "
+	for x in : :: a: a:: :a " : " "a : b" " a:b : c::" ""; do
+		fields $x
+	done
+	x="a:b"
+	fields $x"" "$x"$x ''$x''
+	IFS=""
+	fields $x
+	x=""
+	fields $x
+)
 # Pathname Expansion
+dir=$(mktemp -d)
+touch "$dir/axb" "$dir/a*b"
+cd "$dir" || exit 1
+echo a*b
+echo a\*b "a*"b 'a*b'
+echo [ a[b ] ~x
+# Matches are sorted, hidden files need an explicit period and the same
+# directory can be expanded several times by the same command
+mkdir src src/sub .hidden
+touch b.c a.c .a.c src/m.c src/n.h src/sub/z.c
+echo *.c *.c .*.c ?.c [!a].c
+echo */ */*.c src/*/*.c src//*.h ./src/*.h
+echo nomatch* src/nomatch/* src/sub/
+x="*.c src/*"
+echo $x
+cd - >/dev/null
+rm -rf "$dir"
 # Quote Removal